@@ -1,15 +1,26 @@
 #ifndef RADIX_TREE_HPP
 #define RADIX_TREE_HPP
 
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <new>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "radix_tree_it.hpp"
 #include "radix_tree_node.hpp"
+#include "radix_tree_stats.hpp"
 #include <functional>
 
+#if __cplusplus >= 201103L
+#include <atomic>
+typedef std::atomic<long> radix_tree_refcount;
+#else
+typedef long radix_tree_refcount;
+#endif
+
 template<typename K>
 K radix_substr(const K &key, int begin, int num);
 
@@ -37,19 +48,147 @@ inline int radix_length<std::string>(const std::string &key)
     return static_cast<int>(key.size());
 }
 
-template <typename K, typename T, typename Compare>
-class radix_tree {
+// heap bytes a key holds beyond its own object, for compact()'s count;
+// overload it for keys that own storage
+template<typename K>
+std::size_t radix_key_bytes(const K &)
+{
+    return 0;
+}
+
+template<>
+inline std::size_t radix_key_bytes<std::string>(const std::string &key)
+{
+    // no more than an empty string's capacity fits in the object itself
+    return key.capacity() > std::string().capacity() ? key.capacity() + 1 : 0;
+}
+
+// FNV-1a over the key units; overload it for keys that hash better another way
+template<typename K>
+std::size_t radix_hash(const K &key)
+{
+    std::size_t hash = 2166136261u;
+    int len = radix_length(key);
+
+    for (int i = 0; i < len; i++) {
+        hash ^= static_cast<std::size_t>(key[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// Where a tree allocates its nodes and entries, see set_memory_resource();
+// radix_tree_arena.hpp has a huge-page backed implementation. Blocks are
+// given back with the size they were allocated with.
+class radix_tree_memory_resource {
+public:
+    virtual ~radix_tree_memory_resource() { }
+
+    virtual void* allocate(std::size_t size) = 0;
+    virtual void deallocate(void *p, std::size_t size) = 0;
+};
+
+inline void* radix_tree_allocate(radix_tree_memory_resource *res, std::size_t size)
+{
+    return res == NULL ? ::operator new(size) : res->allocate(size);
+}
+
+inline void radix_tree_deallocate(radix_tree_memory_resource *res, void *p, std::size_t size)
+{
+    if (p == NULL)
+        return;
+
+    if (res == NULL)
+        ::operator delete(p);
+    else
+        res->deallocate(p, size);
+}
+
+template <typename K, typename T, typename Compare, typename Stats> struct radix_tree_parallel;
+
+// Holds the comparator of a tree, which derives from it, so that an
+// empty one such as std::less takes no room; a comparator that is a
+// function pointer is kept as a member.
+template <typename Compare>
+class radix_tree_compare : private Compare {
+public:
+    explicit radix_tree_compare(const Compare &pred) : Compare(pred) { }
+
+    const Compare& predicate() const {
+        return *this;
+    }
+    void set_predicate(const Compare &pred) {
+        static_cast<Compare&>(*this) = pred;
+    }
+};
+
+template <typename R, typename A, typename B>
+class radix_tree_compare<R (*)(A, B)> {
+public:
+    typedef R (*compare_type)(A, B);
+
+    explicit radix_tree_compare(compare_type pred) : m_pred(pred) { }
+
+    compare_type predicate() const {
+        return m_pred;
+    }
+    void set_predicate(compare_type pred) {
+        m_pred = pred;
+    }
+
+private:
+    compare_type m_pred;
+};
+
+template <typename K, typename T, typename Compare, typename Stats>
+class radix_tree : private radix_tree_compare<Compare>, private radix_tree_owner<K, T, Compare> {
+    friend struct radix_tree_parallel<K, T, Compare, Stats>;
+
 public:
     typedef K key_type;
     typedef T mapped_type;
     typedef std::pair<const K, T> value_type;
     typedef radix_tree_it<K, T, Compare>   iterator;
+    typedef radix_tree_const_it<K, T, Compare> const_iterator;
     typedef std::size_t           size_type;
 
-	radix_tree() : m_size(0), m_root(NULL), m_predicate(Compare()) { }
-	explicit radix_tree(Compare pred) : m_size(0), m_root(NULL), m_predicate(pred) { }
+	radix_tree() : radix_tree_compare<Compare>(Compare()), m_size(0), m_root(NULL), m_refs(NULL), m_cache(NULL), m_cache_mask(0), m_filter(NULL), m_filter_mask(0), m_resource(NULL), m_compact_key(), m_compacting(false), m_stale(false) { }
+	explicit radix_tree(Compare pred) : radix_tree_compare<Compare>(pred), m_size(0), m_root(NULL), m_refs(NULL), m_cache(NULL), m_cache_mask(0), m_filter(NULL), m_filter_mask(0), m_resource(NULL), m_compact_key(), m_compacting(false), m_stale(false) { }
     ~radix_tree() {
-        delete m_root;
+        release();
+        delete [] m_cache;
+        delete [] m_filter;
+    }
+
+    // Copies share all nodes with the source and cost O(1). Nodes are
+    // counted, and a change to either side copies only the nodes on the
+    // path from the root down to where it writes, O(depth), as the
+    // copied parents now hold the untouched subtrees along with the
+    // originals; the other side keeps seeing the state at the time of
+    // the copy. Lookups never copy, const or not: a mutable iterator of a
+    // tree that shares nodes copies the path to its entry once it is
+    // dereferenced, which also moves other iterators of the tree that
+    // point on that path to stale nodes. Iterators of a tree that has
+    // copied paths step from the root by key, O(depth) per step, as the
+    // shared nodes below a copied one link to their old parent; a
+    // non-const begin() on a tree that no longer shares nodes relinks
+    // them, and so do the calls that rework the whole tree (merge,
+    // intersect, subtract, remove_if, compact), which also copy whatever
+    // is still shared. A mutable iterator taken before a copy writes
+    // into both sides. Assignment is O(1) as well, save that a filter on
+    // the target is refilled from other's, or rebuilt over the new
+    // entries if other has none of the same size.
+    radix_tree(const radix_tree& other);
+    radix_tree& operator =(const radix_tree &other);
+
+    // O(1) consistent view of the tree, for readers such as exporters
+    radix_tree snapshot() const {
+        return *this;
+    }
+    // true while copies of the tree may share nodes with it
+    bool shared() const {
+        return m_refs != NULL && *m_refs > 1;
     }
 
     size_type size()  const {
@@ -59,14 +198,73 @@ public:
         return m_size == 0;
     }
     void clear() {
-        delete m_root;
-        m_root = NULL;
+        release();
+        filter_clear();
         m_size = 0;
+        m_compacting = false;
+    }
+
+    // Hot-key cache in front of find(): a direct-mapped table from
+    // radix_hash(key) to the node holding the key, answered with one probe
+    // and one key compare. A slot is cleared as soon as its entry goes
+    // away, so a hit is always exact; hits and misses are reported to the
+    // stats policy. Const finds fill it as well, which is safe from several
+    // reader threads at once in C++11. slots is rounded up to a power of
+    // two, 0 turns the cache off, and copies start without one.
+    void set_cache_size(size_type slots);
+    size_type cache_size() const {
+        return m_cache != NULL ? m_cache_mask + 1 : 0;
+    }
+
+    // Negative-lookup filter in front of find(): a counting Bloom filter
+    // over the stored keys, kept up to date by every mutation. A key is
+    // hashed to one 64-byte block, so a definite miss costs one cache line
+    // and no descent. Each block holds 128 4-bit counters, of which a key
+    // sets 6; about 6 bytes per key give a false-positive rate near 1%.
+    // Rejected lookups and false positives are reported to the stats
+    // policy. bytes is rounded up to a power of two blocks, 0 turns the
+    // filter off, and copies start without one.
+    void set_filter_size(size_type bytes);
+    size_type filter_size() const {
+        return m_filter != NULL ? (m_filter_mask + 1) * filter_block : 0;
+    }
+
+    // Nodes and entries come from res, or from the global heap if it is
+    // NULL, the default. Changing it moves the tree's nodes over by
+    // copying them. Copies of a tree allocate from the same resource, which
+    // must outlive all of them; merge() copies the nodes of a tree with
+    // another resource before splicing them in.
+    void set_memory_resource(radix_tree_memory_resource *res);
+    radix_tree_memory_resource* memory_resource() const {
+        return m_resource;
+    }
+
+    // instrumentation policy, see radix_tree_stats.hpp
+    Stats& stats() {
+        return m_stats;
+    }
+    const Stats& stats() const {
+        return m_stats;
     }
 
+    // The non-const lookups hand out mutable iterators, which copy what
+    // they write to if the tree shares nodes (see the copy constructor).
+    // The const ones never modify the tree, and a tree that is no longer
+    // written to can be read through a const reference from any number of
+    // threads, while its copies are changed on others.
     iterator find(const K &key);
     iterator begin();
     iterator end();
+    const_iterator find(const K &key) const;
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    // Cuts the tree into at most n ranges of consecutive entries that
+    // together cover it, for handing to separate threads. The cuts follow
+    // subtrees and no entries are counted, so the ranges are balanced by
+    // the shape of the tree rather than exactly.
+    typedef std::pair<const_iterator, const_iterator> const_range;
+    void split(size_type n, std::vector<const_range> &ranges) const;
 
     std::pair<iterator, bool> insert(const value_type &val);
     bool erase(const K &key);
@@ -74,21 +272,140 @@ public:
     void prefix_match(const K &key, std::vector<iterator> &vec);
     void greedy_match(const K &key,  std::vector<iterator> &vec);
     iterator longest_match(const K &key);
+    void prefix_match(const K &key, std::vector<const_iterator> &vec) const;
+    void greedy_match(const K &key,  std::vector<const_iterator> &vec) const;
+    const_iterator longest_match(const K &key) const;
+
+    // every stored key that is a prefix of key, shortest first, found in a
+    // single descent; the last one is what longest_match returns
+    void all_prefixes_of(const K &key, std::vector<iterator> &vec);
+    void all_prefixes_of(const K &key, std::vector<const_iterator> &vec) const;
+
+    // Typo-tolerant lookups. The tree is descended with one Levenshtein
+    // row per edge unit, and a subtree is skipped as soon as every entry
+    // of the row exceeds max_edits. Results come out in key order.
+    //
+    // fuzzy_match finds the keys within max_edits insertions, deletions
+    // and substitutions of key; fuzzy_prefix_match finds the keys that
+    // start with such a string.
+    void fuzzy_match(const K &key, int max_edits, std::vector<iterator> &vec);
+    void fuzzy_prefix_match(const K &key, int max_edits, std::vector<iterator> &vec);
+    void fuzzy_match(const K &key, int max_edits, std::vector<const_iterator> &vec) const;
+    void fuzzy_prefix_match(const K &key, int max_edits, std::vector<const_iterator> &vec) const;
+
+    // Glob lookups for keys made of characters: '*' in pattern matches any
+    // run of units and '?' any single unit. The set of live pattern
+    // positions is stepped through the edge labels during the descent, a
+    // subtree is skipped as soon as the set runs empty, and one reached
+    // with only '*' left in the pattern is taken whole. Results come out
+    // in key order.
+    void pattern_match(const K &pattern, std::vector<iterator> &vec);
+    void pattern_match(const K &pattern, std::vector<const_iterator> &vec) const;
+    // hands every match to fn(const value_type &) as soon as it is found,
+    // stopping early once fn returns false
+    template<class _Function> void pattern_for_each(const K &pattern, _Function fn) const;
 
     T& operator[] (const K &lhs);
 
+    // Set operations. Both trees are walked in lockstep by edge label, so
+    // subtrees present on only one side are handled as a whole instead of
+    // key by key. They assume Compare orders labels lexicographically, as
+    // std::less does.
+    enum diff_kind { diff_removed, diff_added, diff_changed };
+    struct diff_type {
+        diff_kind kind;
+        iterator  lhs; // entry of *this, for removed and changed
+        iterator  rhs; // entry of other, for added and changed
+    };
+
+    // moves every entry of other whose key is not in *this into *this,
+    // splicing whole subtrees; entries with keys already present stay in other.
+    // Between trees on different memory resources the entries are copied,
+    // and if that throws, other keeps all of its entries while some may
+    // already be in *this as well.
+    void merge(radix_tree &other);
+    // erases the entries whose keys are not in other
+    void intersect(const radix_tree &other);
+    // erases the entries whose keys are in other
+    void subtract(const radix_tree &other);
+    // what changed going from *this to other, in key order
+    void diff(radix_tree &other, std::vector<diff_type> &vec);
+
+    // erases every entry whose key starts with key, detaching the whole
+    // subtree at once; returns the number of entries erased
+    size_type erase_prefix(const K &key);
+
+    // Batched updates. Each mutation starts its descent from the deepest
+    // node the previous key shares with it, rather than from the root, and
+    // nodes left without an entry are compressed once the batch has moved
+    // past them, so a key erased and one inserted below it cost no merge
+    // and split. Any order is applied correctly; a batch sorted by key
+    // shares the most work. Returns the number of keys inserted, values
+    // assigned and keys erased.
+    enum mutation_kind { mutation_insert, mutation_assign, mutation_erase };
+    struct mutation_type {
+        mutation_kind kind; // insert keeps an existing value, assign overwrites it
+        K key;
+        T value;            // unused by erase
+    };
+    size_type apply_batch(const std::vector<mutation_type> &batch);
+
+    // Relayout for trees that live long under churn. A pass walks the
+    // nodes depth-first and moves each into a block newly allocated from
+    // the memory resource, so that the nodes of one call come out back to
+    // back in lookup order; it also trims each child array to its size and
+    // merges any node left with neither an entry nor a second child. One
+    // call does at most max_nodes nodes, 0 for no limit, and the next call
+    // resumes after the last node done, even if the tree was modified in
+    // between. Entries stay where they are, so references to mapped values
+    // survive, but iterators do not. Only a resource that hands out blocks
+    // in order, such as radix_tree_arena, lays the nodes out back to back;
+    // without one the nodes stay where they are, as the global heap keeps
+    // no order worth moving them for, and a pass only trims and merges.
+    // Returns the bytes of nodes, child arrays and labels freed, less what
+    // the labels merged and the arrays regrown take.
+    size_type compact(size_type max_nodes = 0);
+    // true while a pass is part way through the tree
+    bool compacting() const {
+        return m_compacting;
+    }
+
+	// one pruning pass: pred sees the keys in order, matching entries are
+	// dropped in place and compressed paths are repaired on the way out
 	template<class _UnaryPred> void remove_if(_UnaryPred pred)
 	{
-		radix_tree<K, T, Compare>::iterator backIt;
-		for (radix_tree<K, T, Compare>::iterator it = begin(); it != end(); it = backIt)
-		{
-			backIt = it;
-			backIt++;
-			K toDelete = (*it).first;
-			if (pred(toDelete))
-			{
-				erase(toDelete);
+		unshare_all();
+
+		if (m_root == NULL)
+			return;
+
+		typedef std::pair<radix_tree_node<K, T, Compare>*, bool> visit_t;
+		std::vector<visit_t> work(1, visit_t(m_root, false));
+
+		while (! work.empty()) {
+			radix_tree_node<K, T, Compare> *node = work.back().first;
+			bool visited = work.back().second;
+			work.pop_back();
+
+			if (visited) {
+				compress(node);
+				continue;
+			}
+
+			// the node's own entry, seen before its subtrees
+			if (node->m_value != NULL && pred(node->m_value->first)) {
+				cache_erase(node);
+				filter_add(node->m_value->first, -1);
+				delete_value(node->m_value);
+				node->m_value = NULL;
+				m_size--;
 			}
+
+			work.push_back(visit_t(node, true));
+
+			typename radix_tree_node<K, T, Compare>::rit_child it;
+			for (it = node->m_children.rbegin(); it != node->m_children.rend(); ++it)
+				work.push_back(visit_t(it->second, false));
 		}
 	}
 
@@ -96,461 +413,2318 @@ public:
 private:
     size_type m_size;
     radix_tree_node<K, T, Compare>* m_root;
+    radix_tree_refcount *m_refs; // trees that may share nodes, NULL if there is no root
 
-	Compare m_predicate;
+    using radix_tree_compare<Compare>::predicate;
+    mutable Stats m_stats;
 
-    radix_tree_node<K, T, Compare>* begin(radix_tree_node<K, T, Compare> *node);
-    radix_tree_node<K, T, Compare>* find_node(const K &key, radix_tree_node<K, T, Compare> *node, int depth);
-    radix_tree_node<K, T, Compare>* append(radix_tree_node<K, T, Compare> *parent, const value_type &val);
-    radix_tree_node<K, T, Compare>* prepend(radix_tree_node<K, T, Compare> *node, const value_type &val);
-	void greedy_match(radix_tree_node<K, T, Compare> *node, std::vector<iterator> &vec);
+#if __cplusplus >= 201103L
+    typedef std::atomic<radix_tree_node<K, T, Compare>*> cache_slot;
+#else
+    typedef radix_tree_node<K, T, Compare>* cache_slot;
+#endif
+    cache_slot *m_cache;
+    size_type m_cache_mask;
 
-    radix_tree(const radix_tree& other); // delete
-    radix_tree& operator =(const radix_tree other); // delete
-};
+    static const size_type filter_block  = 64; // bytes, two counters each
+    static const int       filter_probes = 6;
 
-template <typename K, typename T, typename Compare>
-void radix_tree<K, T, Compare>::prefix_match(const K &key, std::vector<iterator> &vec)
-{
-    vec.clear();
+    unsigned char *m_filter;
+    size_type m_filter_mask; // blocks - 1
 
-    if (m_root == NULL)
-        return;
+    bool filter_test(const K &key) const;
+    void filter_add(const K &key, int delta);
+    void filter_update(radix_tree_node<K, T, Compare> *node, int delta);
+    void filter_clear();
 
-    radix_tree_node<K, T, Compare> *node;
-    K key_sub1, key_sub2;
+    radix_tree_memory_resource *m_resource; // NULL for the global heap
 
-    node = find_node(key, m_root, 0);
+    K m_compact_key;   // path of the node the pass goes on from
+    bool m_compacting;
 
-    if (node->m_is_leaf)
-        node = node->m_parent;
+    // a path was copied, so nodes below it may link to another parent
+    bool m_stale;
+
+    // what iterators handed out by the tree get to reach back to it
+    radix_tree_owner<K, T, Compare>* owner() {
+        return shared() || m_stale ? this : NULL;
+    }
+    radix_tree_owner<K, T, Compare>* owner() const {
+        return m_stale ? const_cast<radix_tree*>(this) : NULL;
+    }
+    radix_tree_node<K, T, Compare>* own(radix_tree_node<K, T, Compare> *node);
+    radix_tree_node<K, T, Compare>* next(radix_tree_node<K, T, Compare> *node) const;
 
-    int len = radix_length(key) - node->m_depth;
-    key_sub1 = radix_substr(key, node->m_depth, len);
-    key_sub2 = radix_substr(node->m_key, 0, len);
+    cache_slot* cache_slot_of(const K &key) const {
+        return m_cache != NULL ? &m_cache[radix_hash(key) & m_cache_mask] : NULL;
+    }
+    static radix_tree_node<K, T, Compare>* cache_load(const cache_slot &slot);
+    static void cache_store(cache_slot &slot, radix_tree_node<K, T, Compare> *node);
+    void cache_erase(radix_tree_node<K, T, Compare> *node);
+    void cache_flush();
+
+    radix_tree_node<K, T, Compare>* new_node();
+    radix_tree_node<K, T, Compare>* new_node(const value_type &val);
+    void delete_node(radix_tree_node<K, T, Compare> *node);
+    value_type* new_value(const value_type &val);
+    void delete_value(value_type *val);
+    void destroy(radix_tree_node<K, T, Compare> *node);
+    void release();
+    radix_tree_node<K, T, Compare>* copy_nodes();
+    radix_tree_node<K, T, Compare>* copy_node(radix_tree_node<K, T, Compare> *node, radix_tree_node<K, T, Compare> *parent);
+    radix_tree_node<K, T, Compare>* own_child(radix_tree_node<K, T, Compare> *parent, radix_tree_node<K, T, Compare> *child);
+    radix_tree_node<K, T, Compare>* unshare_path(const K &key);
+    void unshare_all();
+
+    radix_tree_node<K, T, Compare>* begin(radix_tree_node<K, T, Compare> *node) const;
+    radix_tree_node<K, T, Compare>* find_node(const K &key, radix_tree_node<K, T, Compare> *node, int depth, radix_tree_node<K, T, Compare> **last_entry = NULL) const;
+    radix_tree_node<K, T, Compare>* find_child(radix_tree_node<K, T, Compare> *node, const K &key, int depth) const;
+    radix_tree_node<K, T, Compare>* find_prefix_node(const K &key) const;
+    radix_tree_node<K, T, Compare>* find_greedy_node(const K &key) const;
+    radix_tree_node<K, T, Compare>* find_entry(const K &key) const;
+    radix_tree_node<K, T, Compare>* longest_match_node(const K &key) const;
+    radix_tree_node<K, T, Compare>* first_entry() const;
+    radix_tree_node<K, T, Compare>* append(radix_tree_node<K, T, Compare> *parent, const value_type &val);
+    radix_tree_node<K, T, Compare>* prepend(radix_tree_node<K, T, Compare> *node, const value_type &val);
+    radix_tree_node<K, T, Compare>* split_node(radix_tree_node<K, T, Compare> *node, int count);
+    radix_tree_node<K, T, Compare>* compress(radix_tree_node<K, T, Compare> *node);
+    radix_tree_node<K, T, Compare>* settle(radix_tree_node<K, T, Compare> *node, int depth);
+    radix_tree_node<K, T, Compare>* relocate(radix_tree_node<K, T, Compare> *node);
+    radix_tree_node<K, T, Compare>* skip_subtree(radix_tree_node<K, T, Compare> *node) const;
+    size_type node_bytes(const radix_tree_node<K, T, Compare> *node) const;
+    radix_tree_node<K, T, Compare>* seek_node(const K &path) const;
+    K path_of(const radix_tree_node<K, T, Compare> *node) const;
+    void erase_node(radix_tree_node<K, T, Compare> *node);
+    size_type count_entries(radix_tree_node<K, T, Compare> *node) const;
+    static int end_depth(const radix_tree_node<K, T, Compare> *node) {
+        return node->m_depth + radix_length(node->m_key);
+    }
 
-    if (key_sub1 != key_sub2)
-        return;
+    // cursor of the lockstep walk: the first m_lhs_off units of m_lhs's
+    // label and m_rhs_off units of m_rhs's label are consumed; a NULL
+    // side marks a subtree found on the other side only
+    struct walk_type {
+        radix_tree_node<K, T, Compare> *m_lhs;
+        int m_lhs_off;
+        radix_tree_node<K, T, Compare> *m_rhs;
+        int m_rhs_off;
+
+        walk_type(radix_tree_node<K, T, Compare> *lhs, int lhs_off, radix_tree_node<K, T, Compare> *rhs, int rhs_off) :
+            m_lhs(lhs), m_lhs_off(lhs_off), m_rhs(rhs), m_rhs_off(rhs_off) { }
+    };
+    struct branch_type {
+        radix_tree_node<K, T, Compare> *m_node;
+        int m_off;
+        const K *m_label; // rest of the label after m_off units
+
+        branch_type(radix_tree_node<K, T, Compare> *node, int off, const K *label) :
+            m_node(node), m_off(off), m_label(label) { }
+    };
+    template<class _Visitor> void co_walk(radix_tree_node<K, T, Compare> *lhs, radix_tree_node<K, T, Compare> *rhs, _Visitor &visitor);
+
+    struct diff_visitor;
+    struct collect_visitor;
+	template<class _It> void greedy_match(radix_tree_node<K, T, Compare> *node, std::vector<_It> &vec, radix_tree_owner<K, T, Compare> *owner) const;
+	template<class _It> void collect_prefixes(const K &key, std::vector<_It> &vec, radix_tree_owner<K, T, Compare> *owner) const;
+	template<class _It> void fuzzy_match(const K &key, int max_edits, bool prefix, std::vector<_It> &vec, radix_tree_owner<K, T, Compare> *owner) const;
+
+    template<class _It> struct pattern_collect {
+        std::vector<_It> *m_vec;
+        radix_tree_owner<K, T, Compare> *m_owner;
+        bool operator() (radix_tree_node<K, T, Compare> *node) {
+            m_vec->push_back(_It(node, m_owner));
+            return true;
+        }
+    };
+    template<class _Function> struct pattern_call {
+        _Function m_fn;
+        bool operator() (radix_tree_node<K, T, Compare> *node) {
+            return m_fn(static_cast<const value_type&>(*node->m_value));
+        }
+    };
+    template<class _Sink> void pattern_walk(const K &pattern, _Sink &sink) const;
+    void pattern_closure(const K &pattern, std::vector<char> &states) const;
+};
 
-    greedy_match(node, vec);
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree<K, T, Compare, Stats>::radix_tree(const radix_tree& other) :
+    radix_tree_compare<Compare>(other.predicate()),
+    m_size(other.m_size),
+    m_root(other.m_root),
+    m_refs(other.m_refs),
+    m_stats(other.m_stats),
+    m_cache(NULL),
+    m_cache_mask(0),
+    m_filter(NULL),
+    m_filter_mask(0),
+    m_resource(other.m_resource),
+    m_compact_key(),
+    m_compacting(false),
+    m_stale(other.m_stale)
+{
+    if (m_refs != NULL) {
+        ++*m_refs;
+        ++m_root->m_refs;
+    }
 }
 
-template <typename K, typename T, typename Compare>
-typename radix_tree<K, T, Compare>::iterator radix_tree<K, T, Compare>::longest_match(const K &key)
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree<K, T, Compare, Stats>& radix_tree<K, T, Compare, Stats>::operator =(const radix_tree &other)
 {
-    if (m_root == NULL)
-        return iterator(NULL);
+    if (this == &other || m_root == other.m_root)
+        return *this;
 
-    radix_tree_node<K, T, Compare> *node;
-    K key_sub;
+    if (other.m_refs != NULL) {
+        ++*other.m_refs;
+        ++other.m_root->m_refs;
+    }
 
-    node = find_node(key, m_root, 0);
+    release();
+
+    m_size      = other.m_size;
+    m_root      = other.m_root;
+    m_refs      = other.m_refs;
+    this->set_predicate(other.predicate());
+    m_resource  = other.m_resource;
+    m_compacting = false;
+    m_stale     = other.m_stale;
 
-    if (node->m_is_leaf)
-        return iterator(node);
+    if (m_filter != NULL && other.m_filter != NULL && m_filter_mask == other.m_filter_mask) {
+        std::copy(other.m_filter, other.m_filter + (m_filter_mask + 1) * filter_block, m_filter);
+    } else {
+        filter_clear();
+        filter_update(m_root, 1);
+    }
 
-    key_sub = radix_substr(key, node->m_depth, radix_length(node->m_key));
+    return *this;
+}
 
-    if (! (key_sub == node->m_key))
-        node = node->m_parent;
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::set_cache_size(size_type slots)
+{
+    delete [] m_cache;
+    m_cache      = NULL;
+    m_cache_mask = 0;
 
-    K nul = radix_substr(key, 0, 0);
+    if (slots == 0)
+        return;
 
-    while (node != NULL) {
-        typename radix_tree_node<K, T, Compare>::it_child it;
-        it = node->m_children.find(nul);
-        if (it != node->m_children.end() && it->second->m_is_leaf)
-            return iterator(it->second);
+    size_type size = 1;
+    while (size < slots)
+        size <<= 1;
 
-        node = node->m_parent;
-    }
+    m_cache      = new cache_slot[size];
+    m_cache_mask = size - 1;
 
-    return iterator(NULL);
+    cache_flush();
 }
 
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::cache_load(const cache_slot &slot)
+{
+#if __cplusplus >= 201103L
+    return slot.load(std::memory_order_relaxed);
+#else
+    return slot;
+#endif
+}
 
-template <typename K, typename T, typename Compare>
-typename radix_tree<K, T, Compare>::iterator radix_tree<K, T, Compare>::end()
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::cache_store(cache_slot &slot, radix_tree_node<K, T, Compare> *node)
 {
-    return iterator(NULL);
+#if __cplusplus >= 201103L
+    slot.store(node, std::memory_order_relaxed);
+#else
+    slot = node;
+#endif
 }
 
-template <typename K, typename T, typename Compare>
-typename radix_tree<K, T, Compare>::iterator radix_tree<K, T, Compare>::begin()
+// called before node's entry is dropped
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::cache_erase(radix_tree_node<K, T, Compare> *node)
 {
-    radix_tree_node<K, T, Compare> *node;
+    cache_slot *slot = cache_slot_of(node->m_value->first);
 
-    if (m_root == NULL || m_size == 0)
-        node = NULL;
-    else
-        node = begin(m_root);
+    if (slot != NULL && cache_load(*slot) == node)
+        cache_store(*slot, NULL);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::cache_flush()
+{
+    if (m_cache == NULL)
+        return;
 
-    return iterator(node);
+    for (size_type i = 0; i <= m_cache_mask; i++)
+        cache_store(m_cache[i], NULL);
 }
 
-template <typename K, typename T, typename Compare>
-radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare>::begin(radix_tree_node<K, T, Compare> *node)
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::set_filter_size(size_type bytes)
 {
-    if (node->m_is_leaf)
-        return node;
+    delete [] m_filter;
+    m_filter      = NULL;
+    m_filter_mask = 0;
+
+    if (bytes == 0)
+        return;
 
+    size_type blocks = 1;
+    while (blocks * filter_block < bytes)
+        blocks <<= 1;
 
-    assert(!node->m_children.empty());
+    m_filter      = new unsigned char[blocks * filter_block];
+    m_filter_mask = blocks - 1;
 
-    return begin(node->m_children.begin()->second);
+    filter_clear();
+    filter_update(m_root, 1);
 }
 
-template <typename K, typename T, typename Compare>
-T& radix_tree<K, T, Compare>::operator[] (const K &lhs)
+// false if key is certainly not in the tree
+template <typename K, typename T, typename Compare, typename Stats>
+bool radix_tree<K, T, Compare, Stats>::filter_test(const K &key) const
 {
-    iterator it = find(lhs);
-
-    if (it == end()) {
-        std::pair<K, T> val;
-        val.first = lhs;
-
-        std::pair<iterator, bool> ret;
-        ret = insert(val);
+    std::size_t hash = radix_hash(key);
+    const unsigned char *block = m_filter + (hash & m_filter_mask) * filter_block;
+    // the probes come from the bits above the block number
+    std::size_t h1 = hash / (m_filter_mask + 1);
+    std::size_t h2 = (h1 >> 7) | 1;
 
-        assert(ret.second == true);
+    for (int i = 0; i < filter_probes; i++) {
+        std::size_t bit = (h1 + i * h2) % (2 * filter_block);
 
-        it = ret.first;
+        if ((block[bit / 2] >> (bit % 2 * 4) & 0xf) == 0)
+            return false;
     }
 
-    return it->second;
+    return true;
 }
 
-template <typename K, typename T, typename Compare>
-void radix_tree<K, T, Compare>::greedy_match(const K &key, std::vector<iterator> &vec)
+// counts key in (delta 1) or out (delta -1); a counter that reached 15
+// stays there, as it no longer knows how many keys set it
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::filter_add(const K &key, int delta)
 {
-    radix_tree_node<K, T, Compare> *node;
-
-    vec.clear();
-
-    if (m_root == NULL)
+    if (m_filter == NULL)
         return;
 
-    node = find_node(key, m_root, 0);
+    std::size_t hash = radix_hash(key);
+    unsigned char *block = m_filter + (hash & m_filter_mask) * filter_block;
+    std::size_t h1 = hash / (m_filter_mask + 1);
+    std::size_t h2 = (h1 >> 7) | 1;
 
-    if (node->m_is_leaf)
-        node = node->m_parent;
+    for (int i = 0; i < filter_probes; i++) {
+        std::size_t bit   = (h1 + i * h2) % (2 * filter_block);
+        int         shift = bit % 2 * 4;
+        int         count = block[bit / 2] >> shift & 0xf;
 
-    greedy_match(node, vec);
+        if (count == 0xf || (delta < 0 && count == 0))
+            continue;
+
+        count += delta;
+        block[bit / 2] = static_cast<unsigned char>((block[bit / 2] & ~(0xf << shift)) | count << shift);
+    }
 }
 
-template <typename K, typename T, typename Compare>
-void radix_tree<K, T, Compare>::greedy_match(radix_tree_node<K, T, Compare> *node, std::vector<iterator> &vec)
+// filter_add for every entry under node
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::filter_update(radix_tree_node<K, T, Compare> *node, int delta)
 {
-    if (node->m_is_leaf) {
-        vec.push_back(iterator(node));
+    if (m_filter == NULL || node == NULL)
         return;
-    }
 
-	typename std::map<K, radix_tree_node<K, T, Compare>*>::iterator it;
+    std::vector<radix_tree_node<K, T, Compare>*> work(1, node);
+
+    while (! work.empty()) {
+        node = work.back();
+        work.pop_back();
 
-    for (it = node->m_children.begin(); it != node->m_children.end(); ++it) {
-        greedy_match(it->second, vec);
+        if (node->m_value != NULL)
+            filter_add(node->m_value->first, delta);
+
+        typename radix_tree_node<K, T, Compare>::it_child it;
+        for (it = node->m_children.begin(); it != node->m_children.end(); ++it)
+            work.push_back(it->second);
     }
 }
 
-template <typename K, typename T, typename Compare>
-void radix_tree<K, T, Compare>::erase(iterator it)
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::filter_clear()
 {
-    erase(it->first);
+    if (m_filter != NULL)
+        std::fill(m_filter, m_filter + (m_filter_mask + 1) * filter_block, 0);
 }
 
-template <typename K, typename T, typename Compare>
-bool radix_tree<K, T, Compare>::erase(const K &key)
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::release()
 {
-	if (m_root == NULL)
-		return 0;
-
-	radix_tree_node<K, T, Compare> *child;
-    radix_tree_node<K, T, Compare> *parent;
-    radix_tree_node<K, T, Compare> *grandparent;
-    K nul = radix_substr(key, 0, 0);
+    cache_flush();
 
-    child = find_node(key, m_root, 0);
+    if (m_refs != NULL && --*m_refs == 0)
+        delete m_refs;
 
-    if (! child->m_is_leaf)
-        return 0;
+    // frees the nodes no other tree holds
+    destroy(m_root);
 
-    parent = child->m_parent;
-    parent->m_children.erase(nul);
+    m_root  = NULL;
+    m_refs  = NULL;
+    m_stale = false;
+}
 
-    delete child;
+// copies node, which parent or the tree holds along with others, into a
+// node that only they hold; its children are now held by both
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::copy_node(radix_tree_node<K, T, Compare> *node, radix_tree_node<K, T, Compare> *parent)
+{
+    radix_tree_node<K, T, Compare> *copy = node->m_value != NULL ? new_node(*node->m_value) : new_node();
+
+    try {
+        copy->m_key = node->m_key;
+        copy->m_children.assign(node->m_children, m_resource);
+    } catch (...) {
+        delete_node(copy);
+        throw;
+    }
 
-    m_size--;
+    copy->m_parent = parent;
+    copy->m_depth  = node->m_depth;
 
-    if (parent == m_root)
-        return 1;
+    typename radix_tree_node<K, T, Compare>::it_child it;
+    for (it = copy->m_children.begin(); it != copy->m_children.end(); ++it)
+        ++it->second->m_refs;
 
-    if (parent->m_children.size() > 1)
-        return 1;
+    if (! copy->m_children.empty())
+        m_stale = true;
 
-    if (parent->m_children.empty()) {
-        grandparent = parent->m_parent;
-        grandparent->m_children.erase(parent->m_key);
-        delete parent;
-    } else {
-        grandparent = parent;
-    }
+    if (node->m_value != NULL) {
+        cache_slot *slot = cache_slot_of(node->m_value->first);
 
-    if (grandparent == m_root) {
-        return 1;
+        if (slot != NULL && cache_load(*slot) == node)
+            cache_store(*slot, copy);
     }
 
-    if (grandparent->m_children.size() == 1) {
-        // merge grandparent with the uncle
-        typename std::map<K, radix_tree_node<K, T, Compare>*>::iterator it;
-        it = grandparent->m_children.begin();
+    if (parent == NULL)
+        m_root = copy;
+    else
+        parent->m_children.replace(node, copy);
 
-        radix_tree_node<K, T, Compare> *uncle = it->second;
+    // the other holders may have let go meanwhile
+    destroy(node);
 
-        if (uncle->m_is_leaf)
-            return 1;
+    return copy;
+}
 
-        uncle->m_depth = grandparent->m_depth;
-        uncle->m_key   = radix_join(grandparent->m_key, uncle->m_key);
-        uncle->m_parent = grandparent->m_parent;
+// child of parent, which only this tree holds, made the tree's own
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::own_child(radix_tree_node<K, T, Compare> *parent, radix_tree_node<K, T, Compare> *child)
+{
+    if (child->m_refs > 1)
+        return copy_node(child, parent);
 
-        grandparent->m_children.erase(it);
+    child->m_parent = parent;
 
-        grandparent->m_parent->m_children.erase(grandparent->m_key);
-        grandparent->m_parent->m_children[uncle->m_key] = uncle;
+    return child;
+}
 
-        delete grandparent;
-    }
+// Gives the tree its own copy of every node on the path of key: those
+// find_node() passes and the child it stops at, which insert() and
+// erase_prefix() may change as well. Their m_parent is right afterwards.
+// Returns the node find_node() returns.
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::unshare_path(const K &key)
+{
+    if (m_root->m_refs > 1)
+        copy_node(m_root, NULL);
 
-    return 1;
-}
+    radix_tree_node<K, T, Compare> *node = m_root;
+    int len   = radix_length(key);
+    int depth = 0;
 
+    while (depth < len) {
+        radix_tree_node<K, T, Compare> *next = node->m_children.find_unit(key[depth]);
 
-template <typename K, typename T, typename Compare>
-radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare>::append(radix_tree_node<K, T, Compare> *parent, const value_type &val)
-{
-    int depth;
-    int len;
-    K   nul = radix_substr(val.first, 0, 0);
-    radix_tree_node<K, T, Compare> *node_c, *node_cc;
+        if (next == NULL)
+            break;
 
-    depth = parent->m_depth + radix_length(parent->m_key);
-    len   = radix_length(val.first) - depth;
+        next = own_child(node, next);
 
-    if (len == 0) {
-        node_c = new radix_tree_node<K, T, Compare>(val, m_predicate);
+        int len_node = radix_length(next->m_key);
+        bool match = len_node <= len - depth;
 
-        node_c->m_depth   = depth;
-        node_c->m_parent  = parent;
-        node_c->m_key     = nul;
-        node_c->m_is_leaf = true;
+        for (int i = 1; match && i < len_node; i++)
+            match = key[depth + i] == next->m_key[i];
 
-        parent->m_children[nul] = node_c;
+        if (! match)
+            break;
 
-        return node_c;
-    } else {
-        node_c = new radix_tree_node<K, T, Compare>(val, m_predicate);
+        depth += len_node;
+        node   = next;
+    }
 
-        K key_sub = radix_substr(val.first, depth, len);
+    return node;
+}
 
-        parent->m_children[key_sub] = node_c;
+// gives the tree its own copy of every node it shares and relinks all of
+// them to their parents, so that it is as if it had never been copied
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::unshare_all()
+{
+    if (m_root == NULL || ! (shared() || m_stale))
+        return;
 
-        node_c->m_depth  = depth;
-        node_c->m_parent = parent;
-        node_c->m_key    = key_sub;
+    if (m_root->m_refs > 1)
+        copy_node(m_root, NULL);
 
+    std::vector<radix_tree_node<K, T, Compare>*> work(1, m_root);
 
-		node_cc = new radix_tree_node<K, T, Compare>(val, m_predicate);
-        node_c->m_children[nul] = node_cc;
+    while (! work.empty()) {
+        radix_tree_node<K, T, Compare> *node = work.back();
+        work.pop_back();
 
-        node_cc->m_depth   = depth + len;
-        node_cc->m_parent  = node_c;
-        node_cc->m_key     = nul;
-        node_cc->m_is_leaf = true;
+        typename radix_tree_node<K, T, Compare>::it_child it;
+        for (it = node->m_children.begin(); it != node->m_children.end(); ++it)
+            work.push_back(own_child(node, it->second));
+    }
 
-        return node_cc;
+    if (shared()) {
+        if (--*m_refs == 0)
+            delete m_refs;
+        m_refs = new radix_tree_refcount(1);
     }
+
+    m_stale = false;
 }
 
-template <typename K, typename T, typename Compare>
-radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare>::prepend(radix_tree_node<K, T, Compare> *node, const value_type &val)
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::own(radix_tree_node<K, T, Compare> *node)
 {
-    int count;
-    int len1, len2;
+    if (! shared())
+        return node;
 
-    len1 = radix_length(node->m_key);
-    len2 = radix_length(val.first) - node->m_depth;
+    return unshare_path(node->m_value->first);
+}
 
-    for (count = 0; count < len1 && count < len2; count++) {
-        if (! (node->m_key[count] == val.first[count + node->m_depth]) )
-            break;
-    }
+// with m_stale, the path is found again from the root: the deepest node
+// on it with a later sibling leads to the next entry
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::next(radix_tree_node<K, T, Compare> *node) const
+{
+    if (! m_stale)
+        return iterator().increment(node);
 
-    assert(count != 0);
+    const K &key = node->m_value->first;
+    int len   = radix_length(key);
+    int depth = 0;
+    radix_tree_node<K, T, Compare> *after = NULL;
 
-    node->m_parent->m_children.erase(node->m_key);
+    node = m_root;
 
-    radix_tree_node<K, T, Compare> *node_a = new radix_tree_node<K, T, Compare>(m_predicate);
+    while (depth < len) {
+        radix_tree_node<K, T, Compare> *child = find_child(node, key, depth);
+        assert(child != NULL);
 
-    node_a->m_parent = node->m_parent;
-    node_a->m_key    = radix_substr(node->m_key, 0, count);
-    node_a->m_depth  = node->m_depth;
-    node_a->m_parent->m_children[node_a->m_key] = node_a;
+        typename radix_tree_node<K, T, Compare>::it_child it = node->m_children.find(child);
 
+        if (++it != node->m_children.end())
+            after = it->second;
 
-    node->m_depth  += count;
-    node->m_parent  = node_a;
-    node->m_key     = radix_substr(node->m_key, count, len1 - count);
-    node->m_parent->m_children[node->m_key] = node;
+        depth = end_depth(child);
+        node  = child;
+    }
 
-    K nul = radix_substr(val.first, 0, 0);
-    if (count == len2) {
-        radix_tree_node<K, T, Compare> *node_b;
+    if (! node->m_children.empty())
+        return begin(node->m_children.begin()->second);
 
-        node_b = new radix_tree_node<K, T, Compare>(val, m_predicate);
+    return after != NULL ? begin(after) : NULL;
+}
 
-        node_b->m_parent  = node_a;
-        node_b->m_key     = nul;
-        node_b->m_depth   = node_a->m_depth + count;
-        node_b->m_is_leaf = true;
-        node_b->m_parent->m_children[nul] = node_b;
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::set_memory_resource(radix_tree_memory_resource *res)
+{
+    if (res == m_resource)
+        return;
 
-        return node_b;
-    } else {
-        radix_tree_node<K, T, Compare> *node_b, *node_c;
+    radix_tree_memory_resource *old = m_resource;
 
-        node_b = new radix_tree_node<K, T, Compare>(m_predicate);
+    m_resource = res;
 
-        node_b->m_parent = node_a;
-        node_b->m_depth  = node->m_depth;
-        node_b->m_key    = radix_substr(val.first, node_b->m_depth, len2 - count);
-        node_b->m_parent->m_children[node_b->m_key] = node_b;
+    if (m_root == NULL)
+        return;
 
-        node_c = new radix_tree_node<K, T, Compare>(val, m_predicate);
+    radix_tree_node<K, T, Compare> *root = copy_nodes();
 
-        node_c->m_parent  = node_b;
-        node_c->m_depth   = radix_length(val.first);
-        node_c->m_key     = nul;
-        node_c->m_is_leaf = true;
-        node_c->m_parent->m_children[nul] = node_c;
+    // the old nodes go back to where they came from
+    m_resource = old;
+    release();
+    m_resource = res;
 
-        return node_c;
-    }
+    m_root = root;
+    m_refs = new radix_tree_refcount(1);
 }
 
-template <typename K, typename T, typename Compare>
-std::pair<typename radix_tree<K, T, Compare>::iterator, bool> radix_tree<K, T, Compare>::insert(const value_type &val)
+// copies every node of the tree into m_resource and returns the new root
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::copy_nodes()
 {
-    if (m_root == NULL) {
-        K nul = radix_substr(val.first, 0, 0);
+    // copy the nodes top-down; the source is only read, so other
+    // trees sharing it may keep reading concurrently
+    typedef std::pair<radix_tree_node<K, T, Compare>*, radix_tree_node<K, T, Compare>*> copy_t;
 
-        m_root = new radix_tree_node<K, T, Compare>(m_predicate);
-        m_root->m_key = nul;
-    }
+    radix_tree_node<K, T, Compare> *root;
+
+    if (m_root->m_value != NULL)
+        root = new_node(*m_root->m_value);
+    else
+        root = new_node();
 
+    root->m_key = m_root->m_key;
 
-    radix_tree_node<K, T, Compare> *node = find_node(val.first, m_root, 0);
+    std::vector<copy_t> work(1, copy_t(m_root, root));
 
-    if (node->m_is_leaf) {
-        return std::pair<iterator, bool>(node, false);
-    } else if (node == m_root) {
-        m_size++;
-        return std::pair<iterator, bool>(append(m_root, val), true);
-    } else {
-        m_size++;
-        int len     = radix_length(node->m_key);
-        K   key_sub = radix_substr(val.first, node->m_depth, len);
+    while (! work.empty()) {
+        radix_tree_node<K, T, Compare> *src = work.back().first;
+        radix_tree_node<K, T, Compare> *dst = work.back().second;
+        work.pop_back();
 
-        if (key_sub == node->m_key) {
-            return std::pair<iterator, bool>(append(node, val), true);
-        } else {
-            return std::pair<iterator, bool>(prepend(node, val), true);
+        typename radix_tree_node<K, T, Compare>::it_child it;
+        for (it = src->m_children.begin(); it != src->m_children.end(); ++it) {
+            radix_tree_node<K, T, Compare> *child = it->second;
+            radix_tree_node<K, T, Compare> *copy;
+
+            if (child->m_value != NULL)
+                copy = new_node(*child->m_value);
+            else
+                copy = new_node();
+
+            copy->m_parent = dst;
+            copy->m_depth  = child->m_depth;
+            copy->m_key    = child->m_key;
+            dst->m_children.insert(copy, predicate(), m_resource);
+
+            work.push_back(copy_t(child, copy));
         }
     }
+
+    return root;
 }
 
-template <typename K, typename T, typename Compare>
-typename radix_tree<K, T, Compare>::iterator radix_tree<K, T, Compare>::find(const K &key)
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::new_node()
 {
-    if (m_root == NULL)
-        return iterator(NULL);
+    m_stats.on_alloc();
 
-    radix_tree_node<K, T, Compare> *node = find_node(key, m_root, 0);
+    if (m_resource == NULL)
+        return new radix_tree_node<K, T, Compare>();
 
-    // if the node is a internal node, return NULL
-    if (! node->m_is_leaf)
-        return iterator(NULL);
+    void *p = m_resource->allocate(sizeof(radix_tree_node<K, T, Compare>));
 
-    return iterator(node);
+    return new (p) radix_tree_node<K, T, Compare>();
 }
 
-template <typename K, typename T, typename Compare>
-radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare>::find_node(const K &key, radix_tree_node<K, T, Compare> *node, int depth)
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::new_node(const value_type &val)
 {
-    if (node->m_children.empty())
-        return node;
+    radix_tree_node<K, T, Compare> *node = new_node();
 
-    typename radix_tree_node<K, T, Compare>::it_child it;
-    int len_key = radix_length(key) - depth;
+    node->m_value = new_value(val);
 
-    for (it = node->m_children.begin(); it != node->m_children.end(); ++it) {
-        if (len_key == 0) {
-            if (it->second->m_is_leaf)
-                return it->second;
-            else
-                continue;
-        }
+    return node;
+}
 
-        if (! it->second->m_is_leaf && key[depth] == it->first[0] ) {
-            int len_node = radix_length(it->first);
-            K   key_sub  = radix_substr(key, depth, len_node);
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::delete_node(radix_tree_node<K, T, Compare> *node)
+{
+    m_stats.on_free();
 
-            if (key_sub == it->first) {
-                return find_node(key, it->second, depth+len_node);
-            } else {
-                return it->second;
-            }
-        }
+    node->m_children.clear(m_resource);
+    delete_value(node->m_value);
+
+    if (m_resource == NULL) {
+        delete node;
+        return;
     }
 
-    return node;
+    node->~radix_tree_node();
+    m_resource->deallocate(node, sizeof(radix_tree_node<K, T, Compare>));
 }
 
-/*
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::value_type* radix_tree<K, T, Compare, Stats>::new_value(const value_type &val)
+{
+    if (m_resource == NULL)
+        return new value_type(val);
 
-(root)
-|
-|---------------
-|       |      |
-abcde   bcdef  c
-|   |   |      |------
-|   |   $3     |  |  |
-f   ge         d  e  $6
-|   |          |  |
-$1  $2         $4 $5
+    void *p = m_resource->allocate(sizeof(value_type));
 
-find_node():
-  bcdef  -> $3
-  bcdefa -> bcdef
-  c      -> $6
-  cf     -> c
-  abch   -> abcde
-  abc    -> abcde
-  abcde  -> abcde
-  abcdef -> $1
-  abcdeh -> abcde
-  de     -> (root)
+    try {
+        return new (p) value_type(val);
+    } catch (...) {
+        m_resource->deallocate(p, sizeof(value_type));
+        throw;
+    }
+}
 
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::delete_value(value_type *val)
+{
+    if (val == NULL)
+        return;
 
-(root)
-|
-abcd
-|
-$
+    if (m_resource == NULL) {
+        delete val;
+        return;
+    }
 
-(root)
-|
-$
+    val->~value_type();
+    m_resource->deallocate(val, sizeof(value_type));
+}
+
+// lets go of node, freeing it and whatever of its subtree no other
+// parent or tree holds
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::destroy(radix_tree_node<K, T, Compare> *node)
+{
+    if (node == NULL)
+        return;
+
+    // explicit worklist, so that teardown of a deep tree does not
+    // depend on the size of the thread stack
+    std::vector<radix_tree_node<K, T, Compare>*> work(1, node);
+
+    while (! work.empty()) {
+        node = work.back();
+        work.pop_back();
+
+        if (--node->m_refs > 0)
+            continue;
+
+        typename radix_tree_node<K, T, Compare>::it_child it;
+        for (it = node->m_children.begin(); it != node->m_children.end(); ++it)
+            work.push_back(it->second);
+
+        node->m_children.clear(m_resource);
+        delete_node(node);
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::prefix_match(const K &key, std::vector<iterator> &vec)
+{
+    vec.clear();
+
+    radix_tree_node<K, T, Compare> *node = find_prefix_node(key);
+
+    if (node == NULL)
+        return;
+
+    greedy_match(node, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::prefix_match(const K &key, std::vector<const_iterator> &vec) const
+{
+    vec.clear();
+
+    radix_tree_node<K, T, Compare> *node = find_prefix_node(key);
+
+    if (node == NULL)
+        return;
+
+    greedy_match(node, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::find_prefix_node(const K &key) const
+{
+    if (m_root == NULL)
+        return NULL;
+
+    radix_tree_node<K, T, Compare> *node = find_node(key, m_root, 0);
+    int depth = end_depth(node);
+    int len   = radix_length(key);
+
+    if (depth == len)
+        return node;
+
+    // the rest of key must be a prefix of the label of the next edge
+    radix_tree_node<K, T, Compare> *child = find_child(node, key, depth);
+
+    if (child == NULL || radix_length(child->m_key) < len - depth)
+        return NULL;
+
+    for (int i = 1; i < len - depth; i++) {
+        if (! (key[depth + i] == child->m_key[i]))
+            return NULL;
+    }
+
+    return child;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::size_type radix_tree<K, T, Compare, Stats>::erase_prefix(const K &key)
+{
+    radix_tree_node<K, T, Compare> *node = find_prefix_node(key);
+
+    if (node == NULL)
+        return 0;
+
+    if (shared() || m_stale) {
+        unshare_path(key);
+        node = find_prefix_node(key);
+    }
+
+    size_type count;
+
+    if (node == m_root) {
+        count = m_size;
+        clear();
+        return count;
+    }
+
+    radix_tree_node<K, T, Compare> *parent = node->m_parent;
+
+    parent->m_children.erase(node, m_resource);
+
+    count = count_entries(node);
+    cache_flush();
+    filter_update(node, -1);
+    destroy(node);
+    m_size -= count;
+
+    while (parent != NULL)
+        parent = compress(parent);
+
+    return count;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::iterator radix_tree<K, T, Compare, Stats>::longest_match(const K &key)
+{
+    return iterator(longest_match_node(key), owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::const_iterator radix_tree<K, T, Compare, Stats>::longest_match(const K &key) const
+{
+    return const_iterator(longest_match_node(key), owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::longest_match_node(const K &key) const
+{
+    if (m_root == NULL)
+        return NULL;
+
+    radix_tree_node<K, T, Compare> *last = NULL;
+
+    find_node(key, m_root, 0, &last);
+
+    return last;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::all_prefixes_of(const K &key, std::vector<iterator> &vec)
+{
+    collect_prefixes(key, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::all_prefixes_of(const K &key, std::vector<const_iterator> &vec) const
+{
+    collect_prefixes(key, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+template <class _It>
+void radix_tree<K, T, Compare, Stats>::collect_prefixes(const K &key, std::vector<_It> &vec, radix_tree_owner<K, T, Compare> *owner) const
+{
+    vec.clear();
+
+    if (m_root == NULL)
+        return;
+
+    m_stats.on_lookup();
+
+    radix_tree_node<K, T, Compare> *node = m_root;
+    int len = radix_length(key);
+    int depth = 0;
+
+    for (;;) {
+        m_stats.on_node_visit();
+
+        if (node->m_value != NULL)
+            vec.push_back(_It(node, owner));
+
+        if (depth == len)
+            return;
+
+        radix_tree_node<K, T, Compare> *next = find_child(node, key, depth);
+
+        if (next == NULL)
+            return;
+
+        int len_node = radix_length(next->m_key);
+
+        if (len - depth < len_node)
+            return;
+
+        m_stats.on_label_compare(len_node);
+
+        for (int i = 1; i < len_node; i++) {
+            if (! (key[depth + i] == next->m_key[i]))
+                return;
+        }
+
+        depth += len_node;
+        node   = next;
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::iterator radix_tree<K, T, Compare, Stats>::end()
+{
+    return iterator(NULL);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::const_iterator radix_tree<K, T, Compare, Stats>::end() const
+{
+    return const_iterator(NULL);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::split(size_type n, std::vector<const_range> &ranges) const
+{
+    ranges.clear();
+
+    if (m_size == 0 || n == 0)
+        return;
+
+    // pieces of the tree in key order: the whole subtree of a node, or
+    // only the entry of a node whose subtrees follow as pieces of their own
+    typedef std::pair<radix_tree_node<K, T, Compare>*, bool> piece_t;
+
+    std::vector<piece_t> pieces(1, piece_t(m_root, true));
+    std::vector<piece_t> next;
+    bool cut = true;
+
+    // a few pieces per range, so that consecutive ones even out
+    while (cut && pieces.size() < n * 8) {
+        cut = false;
+        next.clear();
+
+        for (size_type i = 0; i < pieces.size(); i++) {
+            radix_tree_node<K, T, Compare> *node = pieces[i].first;
+
+            if (! pieces[i].second || node->m_children.empty()) {
+                next.push_back(pieces[i]);
+                continue;
+            }
+
+            if (node->m_value != NULL)
+                next.push_back(piece_t(node, false));
+
+            typename radix_tree_node<K, T, Compare>::it_child it;
+            for (it = node->m_children.begin(); it != node->m_children.end(); ++it)
+                next.push_back(piece_t(it->second, true));
+
+            cut = true;
+        }
+
+        pieces.swap(next);
+    }
+
+    size_type count = std::min(n, pieces.size());
+    const_iterator first(begin(pieces[0].first), owner());
+
+    for (size_type i = 1; i <= count; i++) {
+        size_type j = pieces.size() * i / count;
+        const_iterator last = j < pieces.size() ? const_iterator(begin(pieces[j].first), owner()) : end();
+
+        ranges.push_back(const_range(first, last));
+        first = last;
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::iterator radix_tree<K, T, Compare, Stats>::begin()
+{
+    // once the copies are gone, a walk is as long as relinking the nodes
+    if (m_stale && ! shared())
+        unshare_all();
+
+    return iterator(first_entry(), owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::const_iterator radix_tree<K, T, Compare, Stats>::begin() const
+{
+    return const_iterator(first_entry(), owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::first_entry() const
+{
+    if (m_root == NULL || m_size == 0)
+        return NULL;
+    else
+        return begin(m_root);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::begin(radix_tree_node<K, T, Compare> *node) const
+{
+    while (node->m_value == NULL) {
+        assert(!node->m_children.empty());
+
+        node = node->m_children.begin()->second;
+    }
+
+    return node;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+T& radix_tree<K, T, Compare, Stats>::operator[] (const K &lhs)
+{
+    iterator it = find(lhs);
+
+    if (it == end()) {
+        std::pair<K, T> val;
+        val.first = lhs;
+
+        std::pair<iterator, bool> ret;
+        ret = insert(val);
+
+        assert(ret.second == true);
+
+        it = ret.first;
+    }
+
+    return it->second;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::greedy_match(const K &key, std::vector<iterator> &vec)
+{
+    vec.clear();
+
+    if (m_root == NULL)
+        return;
+
+    greedy_match(find_greedy_node(key), vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::greedy_match(const K &key, std::vector<const_iterator> &vec) const
+{
+    vec.clear();
+
+    if (m_root == NULL)
+        return;
+
+    greedy_match(find_greedy_node(key), vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::find_greedy_node(const K &key) const
+{
+    radix_tree_node<K, T, Compare> *node = find_node(key, m_root, 0);
+    int depth = end_depth(node);
+
+    if (depth == radix_length(key))
+        return node;
+
+    // the edge where key diverges, if any
+    radix_tree_node<K, T, Compare> *child = find_child(node, key, depth);
+
+    return child != NULL ? child : node;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+template <class _It>
+void radix_tree<K, T, Compare, Stats>::greedy_match(radix_tree_node<K, T, Compare> *node, std::vector<_It> &vec, radix_tree_owner<K, T, Compare> *owner) const
+{
+    // children are pushed in reverse so that entries come out in order
+    std::vector<radix_tree_node<K, T, Compare>*> work(1, node);
+
+    while (! work.empty()) {
+        node = work.back();
+        work.pop_back();
+
+        if (node->m_value != NULL)
+            vec.push_back(_It(node, owner));
+
+        typename radix_tree_node<K, T, Compare>::rit_child it;
+
+        for (it = node->m_children.rbegin(); it != node->m_children.rend(); ++it)
+            work.push_back(it->second);
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::fuzzy_match(const K &key, int max_edits, std::vector<iterator> &vec)
+{
+    fuzzy_match(key, max_edits, false, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::fuzzy_prefix_match(const K &key, int max_edits, std::vector<iterator> &vec)
+{
+    fuzzy_match(key, max_edits, true, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::fuzzy_match(const K &key, int max_edits, std::vector<const_iterator> &vec) const
+{
+    fuzzy_match(key, max_edits, false, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::fuzzy_prefix_match(const K &key, int max_edits, std::vector<const_iterator> &vec) const
+{
+    fuzzy_match(key, max_edits, true, vec, owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+template <class _It>
+void radix_tree<K, T, Compare, Stats>::fuzzy_match(const K &key, int max_edits, bool prefix, std::vector<_It> &vec, radix_tree_owner<K, T, Compare> *owner) const
+{
+    vec.clear();
+
+    if (m_root == NULL || max_edits < 0)
+        return;
+
+    m_stats.on_lookup();
+
+    // rows[off .. off + n] is the Levenshtein row between key and the path
+    // down to the end of a node's label. Rows are pushed and popped along
+    // with the work stack, so an item's row is always the last one.
+    typedef std::pair<radix_tree_node<K, T, Compare>*, std::size_t> work_t;
+
+    int n = radix_length(key);
+    std::vector<int> rows, row(n + 1), next(n + 1);
+    std::vector<work_t> work(1, work_t(m_root, 0));
+
+    for (int i = 0; i <= n; i++)
+        rows.push_back(i);
+
+    while (! work.empty()) {
+        radix_tree_node<K, T, Compare> *node = work.back().first;
+        std::size_t off = work.back().second;
+        work.pop_back();
+
+        std::copy(rows.begin() + off, rows.begin() + off + n + 1, row.begin());
+        rows.resize(off);
+
+        m_stats.on_node_visit();
+
+        // every key from here on starts with a close enough string
+        if (prefix && row[n] <= max_edits) {
+            greedy_match(node, vec, owner);
+            continue;
+        }
+
+        if (node->m_value != NULL && row[n] <= max_edits)
+            vec.push_back(_It(node, owner));
+
+        typename radix_tree_node<K, T, Compare>::rit_child it;
+
+        for (it = node->m_children.rbegin(); it != node->m_children.rend(); ++it) {
+            radix_tree_node<K, T, Compare> *child = it->second;
+            int len = radix_length(child->m_key);
+            bool alive = true;
+
+            m_stats.on_child_scan();
+
+            next = row;
+
+            for (int j = 0; j < len; j++) {
+                int prev_diag = next[0];
+                int best = ++next[0];
+
+                for (int i = 1; i <= n; i++) {
+                    int cost = prev_diag + (key[i - 1] == child->m_key[j] ? 0 : 1);
+
+                    prev_diag = next[i];
+                    next[i] = std::min(std::min(next[i] + 1, next[i - 1] + 1), cost);
+                    best = std::min(best, next[i]);
+                }
+
+                m_stats.on_label_compare(1);
+
+                if (best > max_edits) {
+                    alive = false;
+                    break;
+                }
+                if (prefix && next[n] <= max_edits)
+                    break;
+            }
+
+            if (! alive)
+                continue;
+
+            work.push_back(work_t(child, rows.size()));
+            rows.insert(rows.end(), next.begin(), next.end());
+        }
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::pattern_match(const K &pattern, std::vector<iterator> &vec)
+{
+    vec.clear();
+
+    pattern_collect<iterator> sink;
+    sink.m_vec   = &vec;
+    sink.m_owner = owner();
+
+    pattern_walk(pattern, sink);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::pattern_match(const K &pattern, std::vector<const_iterator> &vec) const
+{
+    vec.clear();
+
+    pattern_collect<const_iterator> sink;
+    sink.m_vec   = &vec;
+    sink.m_owner = owner();
+
+    pattern_walk(pattern, sink);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+template <class _Function>
+void radix_tree<K, T, Compare, Stats>::pattern_for_each(const K &pattern, _Function fn) const
+{
+    pattern_call<_Function> sink = { fn };
+
+    pattern_walk(pattern, sink);
+}
+
+// a '*' may match nothing, so the position after it is live as well
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::pattern_closure(const K &pattern, std::vector<char> &states) const
+{
+    int m = radix_length(pattern);
+
+    for (int p = 0; p < m; p++) {
+        if (states[p] && pattern[p] == '*')
+            states[p + 1] = 1;
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+template <class _Sink>
+void radix_tree<K, T, Compare, Stats>::pattern_walk(const K &pattern, _Sink &sink) const
+{
+    if (m_root == NULL)
+        return;
+
+    m_stats.on_lookup();
+
+    int m = radix_length(pattern);
+
+    // a live position in the all-'*' tail of the pattern matches everything
+    int tail = m;
+    while (tail > 0 && pattern[tail - 1] == '*')
+        tail--;
+
+    // states[off .. off + m] are the live pattern positions at the end of
+    // a node's label, kept on a stack that mirrors the work stack
+    typedef std::pair<radix_tree_node<K, T, Compare>*, std::size_t> work_t;
+
+    std::vector<char> states(m + 1, 0), live(m + 1), next(m + 1), step(m + 1);
+    std::vector<work_t> work(1, work_t(m_root, 0));
+
+    states[0] = 1;
+    pattern_closure(pattern, states);
+
+    while (! work.empty()) {
+        radix_tree_node<K, T, Compare> *node = work.back().first;
+        std::size_t off = work.back().second;
+        work.pop_back();
+
+        std::copy(states.begin() + off, states.begin() + off + m + 1, live.begin());
+        states.resize(off);
+
+        m_stats.on_node_visit();
+
+        if (node->m_value != NULL && live[m] && ! sink(node))
+            return;
+
+        bool all = false;
+        for (int p = tail; p < m && ! all; p++)
+            all = live[p] != 0;
+
+        typename radix_tree_node<K, T, Compare>::rit_child it;
+
+        for (it = node->m_children.rbegin(); it != node->m_children.rend(); ++it) {
+            radix_tree_node<K, T, Compare> *child = it->second;
+            int len = radix_length(child->m_key);
+            bool alive = true;
+
+            m_stats.on_child_scan();
+
+            next = live;
+
+            for (int j = 0; j < len && ! all; j++) {
+                std::fill(step.begin(), step.end(), 0);
+
+                alive = false;
+                for (int p = 0; p < m; p++) {
+                    if (! next[p])
+                        continue;
+
+                    if (pattern[p] == '*')
+                        step[p] = 1;
+                    else if (pattern[p] == '?' || pattern[p] == child->m_key[j])
+                        step[p + 1] = 1;
+                    else
+                        continue;
+
+                    alive = true;
+                }
+
+                m_stats.on_label_compare(1);
+
+                if (! alive)
+                    break;
+
+                pattern_closure(pattern, step);
+                next.swap(step);
+            }
+
+            if (! alive)
+                continue;
+
+            work.push_back(work_t(child, states.size()));
+            states.insert(states.end(), next.begin(), next.end());
+        }
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::erase(iterator it)
+{
+    erase(it->first);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+bool radix_tree<K, T, Compare, Stats>::erase(const K &key)
+{
+    radix_tree_node<K, T, Compare> *node = find_entry(key);
+
+    if (node == NULL)
+        return 0;
+
+    if (shared() || m_stale) {
+        unshare_path(key);
+        node = find_entry(key);
+    }
+
+    erase_node(node);
+
+    return 1;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::erase_node(radix_tree_node<K, T, Compare> *node)
+{
+    cache_erase(node);
+    filter_add(node->m_value->first, -1);
+
+    delete_value(node->m_value);
+    node->m_value = NULL;
+
+    m_size--;
+
+    while (node != NULL)
+        node = compress(node);
+}
+
+// restores the invariant that every node but the root holds an entry or
+// branches; returns the parent if node was removed, as it may now need
+// compressing in turn
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::compress(radix_tree_node<K, T, Compare> *node)
+{
+    if (node == m_root || node->m_value != NULL)
+        return NULL;
+
+    if (node->m_children.empty()) {
+        radix_tree_node<K, T, Compare> *parent = node->m_parent;
+
+        parent->m_children.erase(node, m_resource);
+        delete_node(node);
+
+        return parent;
+    }
+
+    if (node->m_children.size() == 1) {
+        // merge node with its only child
+        radix_tree_node<K, T, Compare> *child = node->m_children.begin()->second;
+
+        if (shared() || m_stale)
+            child = own_child(node, child);
+
+        child->m_depth  = node->m_depth;
+        child->m_key    = radix_join(node->m_key, child->m_key);
+        child->m_parent = node->m_parent;
+
+        node->m_children.clear(m_resource);
+
+        node->m_parent->m_children.erase(node, m_resource);
+        node->m_parent->m_children.insert(child, predicate(), m_resource);
+
+        delete_node(node);
+        m_stats.on_merge();
+    }
+
+    return NULL;
+}
+
+// compresses node and its ancestors up to the first whose path ends at
+// or above depth, which it returns
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::settle(radix_tree_node<K, T, Compare> *node, int depth)
+{
+    while (end_depth(node) > depth) {
+        radix_tree_node<K, T, Compare> *parent = node->m_parent;
+
+        compress(node);
+        node = parent;
+    }
+
+    return node;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::size_type radix_tree<K, T, Compare, Stats>::apply_batch(const std::vector<mutation_type> &batch)
+{
+    if (batch.empty())
+        return 0;
+
+    // the finger walks up by m_parent, so with shared nodes each key
+    // copies its own path instead
+    if (shared() || m_stale) {
+        size_type changed = 0;
+
+        for (size_type i = 0; i < batch.size(); i++) {
+            const mutation_type &mut = batch[i];
+
+            if (mut.kind == mutation_erase) {
+                changed += erase(mut.key);
+                continue;
+            }
+
+            std::pair<iterator, bool> ret = insert(value_type(mut.key, mut.value));
+
+            if (ret.second) {
+                changed++;
+            } else if (mut.kind == mutation_assign) {
+                ret.first->second = mut.value;
+                changed++;
+            }
+        }
+
+        return changed;
+    }
+
+    if (m_root == NULL) {
+        K nul = radix_substr(batch[0].key, 0, 0);
+
+        m_root = new_node();
+        m_root->m_key = nul;
+        m_refs = new radix_tree_refcount(1);
+    }
+
+    // the node the previous key ended at, or the deepest one on its path;
+    // nodes between it and the root may lack an entry and a sibling until
+    // settle() passes them, but none below it does
+    radix_tree_node<K, T, Compare> *finger = m_root;
+    size_type changed = 0;
+
+    try {
+        for (size_type i = 0; i < batch.size(); i++) {
+            const mutation_type &mut = batch[i];
+            int len = radix_length(mut.key);
+
+            if (i > 0) {
+                const K &prev = batch[i - 1].key;
+                int common = 0;
+                int prev_len = radix_length(prev);
+
+                while (common < len && common < prev_len && prev[common] == mut.key[common])
+                    common++;
+
+                finger = settle(finger, common);
+            }
+
+            radix_tree_node<K, T, Compare> *node = find_node(mut.key, finger, end_depth(finger));
+            int depth = end_depth(node);
+
+            if (depth == len && node->m_value != NULL) {
+                if (mut.kind == mutation_erase) {
+                    cache_erase(node);
+                    filter_add(mut.key, -1);
+                    delete_value(node->m_value);
+                    node->m_value = NULL;
+                    m_size--;
+                    changed++;
+                } else if (mut.kind == mutation_assign) {
+                    node->m_value->second = mut.value;
+                    changed++;
+                }
+            } else if (mut.kind != mutation_erase) {
+                radix_tree_node<K, T, Compare> *child = NULL;
+                value_type val(mut.key, mut.value);
+
+                if (depth < len)
+                    child = find_child(node, mut.key, depth);
+
+                node = child == NULL ? append(node, val) : prepend(child, val);
+
+                m_size++;
+                filter_add(mut.key, 1);
+                changed++;
+            }
+
+            finger = node;
+        }
+    } catch (...) {
+        settle(finger, 0);
+        throw;
+    }
+
+    settle(finger, 0);
+
+    return changed;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::size_type radix_tree<K, T, Compare, Stats>::compact(size_type max_nodes)
+{
+    unshare_all();
+
+    if (m_root == NULL) {
+        m_compacting = false;
+        return 0;
+    }
+
+    radix_tree_node<K, T, Compare> *node = m_compacting ? seek_node(m_compact_key) : m_root;
+    size_type freed = 0, taken = 0;
+    size_type done = 0;
+
+    // the old blocks are freed last, so that the resource cannot hand
+    // them out again as the new blocks of this call
+    std::vector<radix_tree_node<K, T, Compare>*> husks;
+
+    try {
+        while (node != NULL && (max_nodes == 0 || done < max_nodes)) {
+            done++;
+
+            if (node != m_root && node->m_value == NULL && node->m_children.size() < 2) {
+                radix_tree_node<K, T, Compare> *next;
+
+                if (node->m_children.empty())
+                    next = skip_subtree(node);
+                else
+                    next = node->m_children.begin()->second;
+
+                // merging into the only child keeps the child, and a
+                // removed leaf may leave its parent to merge in turn
+                while (node != NULL && node != m_root && node->m_value == NULL && node->m_children.size() < 2) {
+                    radix_tree_node<K, T, Compare> *parent = node->m_parent;
+                    radix_tree_node<K, T, Compare> *child = node->m_children.empty() ? NULL : node->m_children.begin()->second;
+                    size_type kept = node_bytes(parent) + (child == NULL ? 0 : node_bytes(child));
+
+                    freed += sizeof(radix_tree_node<K, T, Compare>) + node_bytes(node) + kept;
+                    node = compress(node);
+                    taken += node_bytes(parent) + (child == NULL ? 0 : node_bytes(child));
+                }
+
+                node = next;
+                continue;
+            }
+
+            freed += node->m_children.shrink_to_fit(m_resource);
+
+            if (m_resource != NULL) {
+                freed += radix_key_bytes(node->m_key);
+                husks.push_back(node);
+                node = relocate(node);
+                taken += radix_key_bytes(node->m_key);
+            }
+
+            if (node->m_children.empty())
+                node = skip_subtree(node);
+            else
+                node = node->m_children.begin()->second;
+        }
+    } catch (...) {
+        for (size_type i = 0; i < husks.size(); i++)
+            delete_node(husks[i]);
+        throw;
+    }
+
+    for (size_type i = 0; i < husks.size(); i++)
+        delete_node(husks[i]);
+
+    if (node == NULL) {
+        m_compacting = false;
+    } else {
+        m_compact_key = path_of(node);
+        m_compacting  = true;
+    }
+
+    return freed > taken ? freed - taken : 0;
+}
+
+// what node holds on the heap besides its own block and its entry
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::size_type radix_tree<K, T, Compare, Stats>::node_bytes(const radix_tree_node<K, T, Compare> *node) const
+{
+    return node->m_children.bytes() + radix_key_bytes(node->m_key);
+}
+
+// moves node into a new block and returns it; the old block is left
+// without children or entry, for the caller to free
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::relocate(radix_tree_node<K, T, Compare> *node)
+{
+    radix_tree_node<K, T, Compare> *copy = new_node();
+
+    try {
+        copy->m_key = node->m_key;
+    } catch (...) {
+        delete_node(copy);
+        throw;
+    }
+
+    copy->m_parent = node->m_parent;
+    copy->m_depth  = node->m_depth;
+    copy->m_children.swap(node->m_children);
+
+    typename radix_tree_node<K, T, Compare>::it_child it;
+    for (it = copy->m_children.begin(); it != copy->m_children.end(); ++it)
+        it->second->m_parent = copy;
+
+    if (node->m_value != NULL) {
+        cache_slot *slot = cache_slot_of(node->m_value->first);
+
+        if (slot != NULL && cache_load(*slot) == node)
+            cache_store(*slot, copy);
+
+        copy->m_value = node->m_value;
+        node->m_value = NULL;
+    }
+
+    if (node == m_root)
+        m_root = copy;
+    else
+        copy->m_parent->m_children.replace(node, copy);
+
+    return copy;
+}
+
+// the node after node's subtree in depth-first order, or NULL
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::skip_subtree(radix_tree_node<K, T, Compare> *node) const
+{
+    while (node != m_root) {
+        radix_tree_node<K, T, Compare> *parent = node->m_parent;
+        typename radix_tree_node<K, T, Compare>::it_child it = parent->m_children.find(node);
+
+        if (++it != parent->m_children.end())
+            return it->second;
+
+        node = parent;
+    }
+
+    return NULL;
+}
+
+// the first node in depth-first order whose path does not sort before
+// path, or NULL; with a Compare that does not order keys as the tree does,
+// compact() may only skip or redo some nodes
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::seek_node(const K &path) const
+{
+    radix_tree_node<K, T, Compare> *node = m_root;
+    int len = radix_length(path);
+    int depth = 0;
+
+    while (depth < len) {
+        radix_tree_node<K, T, Compare> *next = find_child(node, path, depth);
+
+        if (next != NULL) {
+            int len_node = radix_length(next->m_key);
+            bool match = len_node <= len - depth;
+
+            for (int i = 1; match && i < len_node; i++)
+                match = path[depth + i] == next->m_key[i];
+
+            if (match) {
+                depth += len_node;
+                node   = next;
+                continue;
+            }
+        }
+
+        K rest = radix_substr(path, depth, len - depth);
+
+        typename radix_tree_node<K, T, Compare>::it_child it;
+        for (it = node->m_children.begin(); it != node->m_children.end(); ++it) {
+            if (predicate()(rest, it->first))
+                return it->second;
+        }
+
+        return skip_subtree(node);
+    }
+
+    return node;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+K radix_tree<K, T, Compare, Stats>::path_of(const radix_tree_node<K, T, Compare> *node) const
+{
+    if (node->m_value != NULL)
+        return node->m_value->first;
+
+    K path = node->m_key;
+
+    for (node = node->m_parent; node != NULL; node = node->m_parent)
+        path = radix_join(node->m_key, path);
+
+    return path;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::split_node(radix_tree_node<K, T, Compare> *node, int count)
+{
+    int len = radix_length(node->m_key);
+
+    m_stats.on_split();
+
+    node->m_parent->m_children.erase(node, m_resource);
+
+    radix_tree_node<K, T, Compare> *node_a = new_node();
+
+    node_a->m_parent = node->m_parent;
+    node_a->m_key    = radix_substr(node->m_key, 0, count);
+    node_a->m_depth  = node->m_depth;
+    node_a->m_parent->m_children.insert(node_a, predicate(), m_resource);
+
+
+    node->m_depth  += count;
+    node->m_parent  = node_a;
+    node->m_key     = radix_substr(node->m_key, count, len - count);
+    node->m_parent->m_children.insert(node, predicate(), m_resource);
+
+    return node_a;
+}
+
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::size_type radix_tree<K, T, Compare, Stats>::count_entries(radix_tree_node<K, T, Compare> *node) const
+{
+    size_type count = 0;
+    std::vector<radix_tree_node<K, T, Compare>*> work(1, node);
+
+    while (! work.empty()) {
+        node = work.back();
+        work.pop_back();
+
+        if (node->m_value != NULL)
+            count++;
+
+        typename radix_tree_node<K, T, Compare>::it_child it;
+        for (it = node->m_children.begin(); it != node->m_children.end(); ++it)
+            work.push_back(it->second);
+    }
+
+    return count;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+template <class _Visitor>
+void radix_tree<K, T, Compare, Stats>::co_walk(radix_tree_node<K, T, Compare> *lhs, radix_tree_node<K, T, Compare> *rhs, _Visitor &visitor)
+{
+    std::vector<walk_type>   work(1, walk_type(lhs, 0, rhs, 0));
+    std::vector<walk_type>   next;
+    std::vector<branch_type> lhs_branches, rhs_branches;
+    K lhs_rest, rhs_rest;
+
+    while (! work.empty()) {
+        walk_type w = work.back();
+        work.pop_back();
+
+        if (w.m_rhs == NULL) {
+            visitor.lhs(w.m_lhs);
+            continue;
+        }
+        if (w.m_lhs == NULL) {
+            visitor.rhs(w.m_rhs);
+            continue;
+        }
+
+        radix_tree_node<K, T, Compare> *a = w.m_lhs, *b = w.m_rhs;
+        int off_a = w.m_lhs_off, off_b = w.m_rhs_off;
+        int len_a = radix_length(a->m_key), len_b = radix_length(b->m_key);
+
+        while (off_a < len_a && off_b < len_b && a->m_key[off_a] == b->m_key[off_b]) {
+            off_a++;
+            off_b++;
+        }
+
+        // an entry ending here, before the branches, as its key is a
+        // prefix of theirs
+        if (off_a == len_a && off_b == len_b) {
+            if (a->m_value != NULL && b->m_value != NULL)
+                visitor.both(a, b);
+            else if (a->m_value != NULL)
+                visitor.lhs_entry(a);
+            else if (b->m_value != NULL)
+                visitor.rhs_entry(b);
+        } else if (off_a == len_a && a->m_value != NULL) {
+            visitor.lhs_entry(a);
+        } else if (off_b == len_b && b->m_value != NULL) {
+            visitor.rhs_entry(b);
+        }
+
+        // the branches leaving this point on each side: the children of a
+        // node whose label is used up, or the rest of the label otherwise
+        typename radix_tree_node<K, T, Compare>::it_child it;
+
+        lhs_branches.clear();
+        if (off_a == len_a) {
+            for (it = a->m_children.begin(); it != a->m_children.end(); ++it)
+                lhs_branches.push_back(branch_type(it->second, 0, &it->first));
+        } else {
+            lhs_rest = radix_substr(a->m_key, off_a, len_a - off_a);
+            lhs_branches.push_back(branch_type(a, off_a, &lhs_rest));
+        }
+
+        rhs_branches.clear();
+        if (off_b == len_b) {
+            for (it = b->m_children.begin(); it != b->m_children.end(); ++it)
+                rhs_branches.push_back(branch_type(it->second, 0, &it->first));
+        } else {
+            rhs_rest = radix_substr(b->m_key, off_b, len_b - off_b);
+            rhs_branches.push_back(branch_type(b, off_b, &rhs_rest));
+        }
+
+        // join both sorted lists; branches continue together when their
+        // labels start with the same unit
+        next.clear();
+
+        size_t i = 0, j = 0;
+        while (i < lhs_branches.size() || j < rhs_branches.size()) {
+            if (i < lhs_branches.size() && j < rhs_branches.size()) {
+                const branch_type &l = lhs_branches[i];
+                const branch_type &r = rhs_branches[j];
+
+                if ((*l.m_label)[0] == (*r.m_label)[0]) {
+                    next.push_back(walk_type(l.m_node, l.m_off, r.m_node, r.m_off));
+                    i++;
+                    j++;
+                    continue;
+                }
+            }
+
+            if (j == rhs_branches.size() ||
+                (i < lhs_branches.size() && predicate()(*lhs_branches[i].m_label, *rhs_branches[j].m_label))) {
+                next.push_back(walk_type(lhs_branches[i].m_node, 0, NULL, 0));
+                i++;
+            } else {
+                next.push_back(walk_type(NULL, 0, rhs_branches[j].m_node, 0));
+                j++;
+            }
+        }
+
+        typename std::vector<walk_type>::reverse_iterator rit;
+        for (rit = next.rbegin(); rit != next.rend(); ++rit)
+            work.push_back(*rit);
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+struct radix_tree<K, T, Compare, Stats>::diff_visitor {
+    radix_tree *m_tree;
+    std::vector<diff_type> *m_vec;
+    std::vector<iterator> m_leaves;
+    radix_tree_owner<K, T, Compare> *m_lhs_owner, *m_rhs_owner;
+
+    void lhs(radix_tree_node<K, T, Compare> *node) {
+        add(node, diff_removed);
+    }
+    void rhs(radix_tree_node<K, T, Compare> *node) {
+        add(node, diff_added);
+    }
+    void lhs_entry(radix_tree_node<K, T, Compare> *node) {
+        diff_type d;
+        d.kind = diff_removed;
+        d.lhs  = iterator(node, m_lhs_owner);
+        m_vec->push_back(d);
+    }
+    void rhs_entry(radix_tree_node<K, T, Compare> *node) {
+        diff_type d;
+        d.kind = diff_added;
+        d.rhs  = iterator(node, m_rhs_owner);
+        m_vec->push_back(d);
+    }
+    void both(radix_tree_node<K, T, Compare> *lhs, radix_tree_node<K, T, Compare> *rhs) {
+        if (lhs->m_value->second == rhs->m_value->second)
+            return;
+
+        diff_type d;
+        d.kind = diff_changed;
+        d.lhs  = iterator(lhs, m_lhs_owner);
+        d.rhs  = iterator(rhs, m_rhs_owner);
+        m_vec->push_back(d);
+    }
+
+    void add(radix_tree_node<K, T, Compare> *node, diff_kind kind) {
+        m_leaves.clear();
+        m_tree->greedy_match(node, m_leaves, kind == diff_removed ? m_lhs_owner : m_rhs_owner);
+
+        for (size_t i = 0; i < m_leaves.size(); i++) {
+            diff_type d;
+            d.kind = kind;
+            if (kind == diff_removed)
+                d.lhs = m_leaves[i];
+            else
+                d.rhs = m_leaves[i];
+            m_vec->push_back(d);
+        }
+    }
+};
+
+// collects the entries of the lhs tree that are (m_common) or are not
+// (! m_common) in the rhs tree; subtrees only in rhs are never entered
+template <typename K, typename T, typename Compare, typename Stats>
+struct radix_tree<K, T, Compare, Stats>::collect_visitor {
+    radix_tree *m_tree;
+    bool m_common;
+    std::vector<iterator> m_found;
+
+    void lhs(radix_tree_node<K, T, Compare> *node) {
+        if (! m_common)
+            m_tree->greedy_match(node, m_found, NULL);
+    }
+    void rhs(radix_tree_node<K, T, Compare> *) { }
+    void lhs_entry(radix_tree_node<K, T, Compare> *node) {
+        if (! m_common)
+            m_found.push_back(iterator(node));
+    }
+    void rhs_entry(radix_tree_node<K, T, Compare> *) { }
+    void both(radix_tree_node<K, T, Compare> *lhs, radix_tree_node<K, T, Compare> *) {
+        if (m_common)
+            m_found.push_back(iterator(lhs));
+    }
+};
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::merge(radix_tree &other)
+{
+    if (this == &other || other.m_size == 0)
+        return;
+
+    if (other.m_resource != m_resource) {
+        // nodes cannot change hands between resources, so splice copies
+        // and give what is left back to other; other keeps every entry
+        // until the last step, which does not throw
+        radix_tree rest(other);
+
+        rest.set_memory_resource(m_resource);
+        merge(rest);
+        rest.set_memory_resource(other.m_resource);
+        other = rest;
+
+        return;
+    }
+
+    unshare_all();
+    other.unshare_all();
+
+    // entries of other move over node and all
+    other.cache_flush();
+
+    if (m_size == 0) {
+        std::swap(m_root, other.m_root);
+        std::swap(m_refs, other.m_refs);
+        std::swap(m_size, other.m_size);
+
+        filter_update(m_root, 1);
+        other.filter_clear();
+        return;
+    }
+
+    typedef std::pair<radix_tree_node<K, T, Compare>*, radix_tree_node<K, T, Compare>*> pair_t;
+
+    std::vector<pair_t> work(1, pair_t(m_root, other.m_root));
+    std::vector<radix_tree_node<K, T, Compare>*> touched;
+    std::vector<radix_tree_node<K, T, Compare>*> children;
+
+    // a and b stand for the same key prefix in each tree
+    while (! work.empty()) {
+        radix_tree_node<K, T, Compare> *a = work.back().first;
+        radix_tree_node<K, T, Compare> *b = work.back().second;
+        work.pop_back();
+
+        touched.push_back(b);
+
+        // an entry in both trees stays in other
+        if (b->m_value != NULL && a->m_value == NULL) {
+            filter_add(b->m_value->first, 1);
+            other.filter_add(b->m_value->first, -1);
+
+            a->m_value = b->m_value;
+            b->m_value = NULL;
+
+            m_size++;
+            other.m_size--;
+        }
+
+        typename radix_tree_node<K, T, Compare>::it_child it;
+
+        children.clear();
+        for (it = b->m_children.begin(); it != b->m_children.end(); ++it)
+            children.push_back(it->second);
+
+        for (size_t i = 0; i < children.size(); i++) {
+            radix_tree_node<K, T, Compare> *child_b = children[i];
+            radix_tree_node<K, T, Compare> *child_a = a->m_children.find_unit(child_b->m_key[0]);
+
+            if (child_a == NULL) {
+                // nothing below this prefix in *this: splice the subtree
+                size_type count = count_entries(child_b);
+
+                filter_update(child_b, 1);
+                other.filter_update(child_b, -1);
+
+                b->m_children.erase(child_b, m_resource);
+                child_b->m_parent = a;
+                a->m_children.insert(child_b, predicate(), m_resource);
+
+                m_size       += count;
+                other.m_size -= count;
+                continue;
+            }
+
+            // split the edges at their common prefix, then merge below it
+            int len_a = radix_length(child_a->m_key);
+            int len_b = radix_length(child_b->m_key);
+            int count;
+
+            for (count = 0; count < len_a && count < len_b; count++) {
+                if (! (child_a->m_key[count] == child_b->m_key[count]))
+                    break;
+            }
+
+            if (count < len_a)
+                child_a = split_node(child_a, count);
+            if (count < len_b)
+                child_b = other.split_node(child_b, count);
+
+            work.push_back(pair_t(child_a, child_b));
+        }
+    }
+
+    // children before parents, so that every node of other is recompressed
+    // once after all of its subtrees were moved
+    typename std::vector<radix_tree_node<K, T, Compare>*>::reverse_iterator rit;
+    for (rit = touched.rbegin(); rit != touched.rend(); ++rit)
+        other.compress(*rit);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::intersect(const radix_tree &other)
+{
+    if (m_root == other.m_root || m_size == 0)
+        return;
+
+    if (other.m_size == 0) {
+        clear();
+        return;
+    }
+
+    unshare_all();
+
+    collect_visitor visitor;
+    visitor.m_tree   = this;
+    visitor.m_common = false;
+
+    co_walk(m_root, other.m_root, visitor);
+
+    for (size_t i = 0; i < visitor.m_found.size(); i++)
+        erase_node(visitor.m_found[i].m_pointee);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::subtract(const radix_tree &other)
+{
+    if (m_root == other.m_root) {
+        clear();
+        return;
+    }
+
+    if (m_size == 0 || other.m_size == 0)
+        return;
+
+    unshare_all();
+
+    collect_visitor visitor;
+    visitor.m_tree   = this;
+    visitor.m_common = true;
+
+    co_walk(m_root, other.m_root, visitor);
+
+    for (size_t i = 0; i < visitor.m_found.size(); i++)
+        erase_node(visitor.m_found[i].m_pointee);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+void radix_tree<K, T, Compare, Stats>::diff(radix_tree &other, std::vector<diff_type> &vec)
+{
+    vec.clear();
+
+    if (m_root == other.m_root)
+        return;
+
+    diff_visitor visitor;
+    visitor.m_tree      = this;
+    visitor.m_vec       = &vec;
+    visitor.m_lhs_owner = owner();
+    visitor.m_rhs_owner = other.owner();
+
+    if (m_root == NULL)
+        visitor.rhs(other.m_root);
+    else if (other.m_root == NULL)
+        visitor.lhs(m_root);
+    else
+        co_walk(m_root, other.m_root, visitor);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::append(radix_tree_node<K, T, Compare> *parent, const value_type &val)
+{
+    int depth = end_depth(parent);
+    int len   = radix_length(val.first) - depth;
+
+    if (len == 0) {
+        parent->m_value = new_value(val);
+
+        return parent;
+    }
+
+    radix_tree_node<K, T, Compare> *node = new_node(val);
+
+    node->m_depth  = depth;
+    node->m_parent = parent;
+    node->m_key    = radix_substr(val.first, depth, len);
+
+    parent->m_children.insert(node, predicate(), m_resource);
+
+    return node;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::prepend(radix_tree_node<K, T, Compare> *node, const value_type &val)
+{
+    int count;
+    int len1, len2;
+
+    len1 = radix_length(node->m_key);
+    len2 = radix_length(val.first) - node->m_depth;
+
+    for (count = 0; count < len1 && count < len2; count++) {
+        if (! (node->m_key[count] == val.first[count + node->m_depth]) )
+            break;
+    }
+
+    assert(count != 0 && count < len1);
+
+    radix_tree_node<K, T, Compare> *node_a = split_node(node, count);
+
+    return append(node_a, val);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+std::pair<typename radix_tree<K, T, Compare, Stats>::iterator, bool> radix_tree<K, T, Compare, Stats>::insert(const value_type &val)
+{
+    if (m_root == NULL) {
+        K nul = radix_substr(val.first, 0, 0);
+
+        m_root = new_node();
+        m_root->m_key = nul;
+        m_refs = new radix_tree_refcount(1);
+    }
+
+    radix_tree_node<K, T, Compare> *node = find_node(val.first, m_root, 0);
+    int depth = end_depth(node);
+
+    if (depth == radix_length(val.first) && node->m_value != NULL)
+        return std::pair<iterator, bool>(iterator(node, owner()), false);
+
+    if (shared() || m_stale)
+        node = unshare_path(val.first);
+
+    m_size++;
+    filter_add(val.first, 1);
+
+    // the edge the rest of the key diverges from, if any
+    radix_tree_node<K, T, Compare> *child = NULL;
+
+    if (depth < radix_length(val.first))
+        child = find_child(node, val.first, depth);
+
+    node = child == NULL ? append(node, val) : prepend(child, val);
+
+    return std::pair<iterator, bool>(iterator(node, owner()), true);
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::iterator radix_tree<K, T, Compare, Stats>::find(const K &key)
+{
+    return iterator(find_entry(key), owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+typename radix_tree<K, T, Compare, Stats>::const_iterator radix_tree<K, T, Compare, Stats>::find(const K &key) const
+{
+    return const_iterator(find_entry(key), owner());
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::find_entry(const K &key) const
+{
+    if (m_root == NULL)
+        return NULL;
+
+    if (m_filter != NULL && ! filter_test(key)) {
+        m_stats.on_filter_reject();
+        return NULL;
+    }
+
+    cache_slot *slot = cache_slot_of(key);
+    radix_tree_node<K, T, Compare> *node;
+
+    if (slot != NULL) {
+        node = cache_load(*slot);
+
+        if (node != NULL && node->m_value->first == key) {
+            m_stats.on_cache_hit();
+            return node;
+        }
+
+        m_stats.on_cache_miss();
+    }
+
+    node = find_node(key, m_root, 0);
+
+    // the path may end short of key, or hold no entry
+    if (end_depth(node) != radix_length(key) || node->m_value == NULL) {
+        if (m_filter != NULL)
+            m_stats.on_filter_false_positive();
+
+        return NULL;
+    }
+
+    if (slot != NULL)
+        cache_store(*slot, node);
+
+    return node;
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::find_node(const K &key, radix_tree_node<K, T, Compare> *node, int depth, radix_tree_node<K, T, Compare> **last_entry) const
+{
+    m_stats.on_lookup();
+
+    int len = radix_length(key);
+
+    for (;;) {
+        m_stats.on_node_visit();
+
+        if (last_entry != NULL && node->m_value != NULL)
+            *last_entry = node;
+
+        if (depth == len)
+            return node;
+
+        radix_tree_node<K, T, Compare> *next = find_child(node, key, depth);
+
+        if (next == NULL)
+            return node;
+
+        int len_node = radix_length(next->m_key);
+
+        if (len - depth < len_node)
+            return node;
+
+        m_stats.on_label_compare(len_node);
+
+        // a leaf holds the whole key, so a key ending with it is checked
+        // with one compare instead of unit by unit
+        if (next->m_children.empty() && len - depth == len_node) {
+            if (! (next->m_value->first == key))
+                return node;
+
+            if (last_entry != NULL)
+                *last_entry = next;
+            m_stats.on_node_visit();
+
+            return next;
+        }
+
+        for (int i = 1; i < len_node; i++) {
+            if (! (key[depth + i] == next->m_key[i]))
+                return node;
+        }
+
+        depth += len_node;
+        node   = next;
+    }
+}
+
+// the child whose label starts with the unit of key at depth
+template <typename K, typename T, typename Compare, typename Stats>
+radix_tree_node<K, T, Compare>* radix_tree<K, T, Compare, Stats>::find_child(radix_tree_node<K, T, Compare> *node, const K &key, int depth) const
+{
+    m_stats.on_child_scan();
+
+    return node->m_children.find_unit(key[depth]);
+}
+
+/*
+
+(root)
+|
+|---------------
+|       |      |
+abcde   bcdef  c
+|   |   $3     $6
+|   |          |---
+f   ge         |  |
+$1  $2         d  e
+               $4 $5
+
+An entry is held by the node its key ends at ($n above). Every node but
+the root holds an entry or has at least two children.
+
+find_node():
+  bcdef  -> bcdef
+  bcdefa -> bcdef
+  c      -> c
+  cf     -> c
+  abch   -> (root)
+  abc    -> (root)
+  abcde  -> abcde
+  abcdef -> f
+  abcdeh -> abcde
+  de     -> (root)
 
 */
 
@@ -0,0 +1,346 @@
+#ifndef RADIX_TREE_ARENA_HPP
+#define RADIX_TREE_ARENA_HPP
+
+// radix_tree_arena packs the nodes and entries of a radix_tree into 2 MB
+// regions backed by huge pages, so that a descent through a large tree
+// touches few TLB entries. Requires POSIX; huge pages and NUMA binding are
+// used on Linux when available and silently skipped otherwise.
+//
+//     radix_tree_arena arena(0);            // regions bound to NUMA node 0
+//     tree.set_memory_resource(&arena);
+//
+// A region is mapped with MAP_HUGETLB if the system has huge pages
+// reserved, and otherwise as ordinary 2 MB aligned memory marked for
+// transparent huge pages. The arena hands out blocks by bumping through
+// its current region and keeps one free list per block size; memory goes
+// back to the system only when the arena is destroyed. It is not
+// synchronized: every tree using it must be written by one thread at a
+// time, as with a tree on its own. Copies and snapshots of a tree share
+// its nodes, and whichever of them lets go of a node last gives it back
+// to the arena, so they count as writers too: destroy, assign and write
+// them on the thread that writes the tree, or under the same lock. To
+// hand a copy to another thread, move it off the arena first with
+// set_memory_resource() on the writer's thread.
+//
+// The child arrays of the nodes come from the arena too; what does not is
+// memory the key and value types allocate for themselves, such as the
+// buffer of a std::string label longer than its inline capacity, which
+// goes through std::allocator.
+//
+// radix_tree_replicas keeps one copy of a read-mostly tree per NUMA node,
+// each in an arena bound to its node, and hands readers the copy local to
+// the CPU they run on.
+
+#include <cstddef>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "radix_tree.hpp"
+
+class radix_tree_arena : public radix_tree_memory_resource {
+public:
+    static const std::size_t region_size = 2 * 1024 * 1024;
+
+    // numa_node < 0 leaves placement to the kernel's first-touch policy
+    explicit radix_tree_arena(int numa_node = -1) :
+        m_numa_node(numa_node), m_next(NULL), m_end(NULL),
+        m_huge_regions(0), m_bound_regions(0), m_bytes_in_use(0) { }
+    ~radix_tree_arena();
+
+    void* allocate(std::size_t size);
+    void deallocate(void *p, std::size_t size);
+
+    int numa_node() const {
+        return m_numa_node;
+    }
+    // regions mapped so far, how many of them are explicit huge pages and
+    // how many are bound to numa_node
+    std::size_t regions() const {
+        return m_regions.size();
+    }
+    std::size_t huge_regions() const {
+        return m_huge_regions;
+    }
+    std::size_t bound_regions() const {
+        return m_bound_regions;
+    }
+    // bytes handed out and not given back, rounded up to the block size
+    std::size_t bytes_in_use() const {
+        return m_bytes_in_use;
+    }
+
+private:
+    static const std::size_t align = 16;
+    // larger blocks come from the global heap
+    static const std::size_t max_block = region_size / 16;
+
+    int m_numa_node;
+    std::vector<void*> m_regions;
+    std::vector<void*> m_free; // free list per block size, linked through the blocks
+    char *m_next;
+    char *m_end;
+    std::size_t m_huge_regions;
+    std::size_t m_bound_regions;
+    std::size_t m_bytes_in_use;
+
+    static std::size_t block_size(std::size_t size) {
+        return size == 0 ? align : (size + align - 1) / align * align;
+    }
+    void map_region();
+    bool bind_region(void *region);
+
+    radix_tree_arena(const radix_tree_arena&); // delete
+    radix_tree_arena& operator=(const radix_tree_arena&); // delete
+};
+
+inline radix_tree_arena::~radix_tree_arena()
+{
+    for (std::size_t i = 0; i < m_regions.size(); i++)
+        munmap(m_regions[i], region_size);
+}
+
+inline void* radix_tree_arena::allocate(std::size_t size)
+{
+    size = block_size(size);
+
+    if (size > max_block)
+        return ::operator new(size);
+
+    std::size_t cls = size / align;
+
+    if (cls < m_free.size() && m_free[cls] != NULL) {
+        void *p = m_free[cls];
+        m_free[cls] = *static_cast<void**>(p);
+        m_bytes_in_use += size;
+
+        return p;
+    }
+
+    if (m_next == NULL || static_cast<std::size_t>(m_end - m_next) < size)
+        map_region();
+
+    void *p = m_next;
+    m_next += size;
+    m_bytes_in_use += size;
+
+    return p;
+}
+
+inline void radix_tree_arena::deallocate(void *p, std::size_t size)
+{
+    size = block_size(size);
+
+    if (size > max_block) {
+        ::operator delete(p);
+        return;
+    }
+
+    std::size_t cls = size / align;
+
+    if (cls >= m_free.size())
+        m_free.resize(cls + 1, NULL);
+
+    *static_cast<void**>(p) = m_free[cls];
+    m_free[cls] = p;
+    m_bytes_in_use -= size;
+}
+
+// the tail of the current region is dropped, it is smaller than a block
+inline void radix_tree_arena::map_region()
+{
+    void *region = MAP_FAILED;
+
+    m_regions.reserve(m_regions.size() + 1);
+
+#ifdef MAP_HUGETLB
+    region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED)
+        m_huge_regions++;
+#endif
+
+    if (region == MAP_FAILED) {
+        // map twice the size and trim it to a 2 MB boundary, so that the
+        // kernel can back the region with a single huge page
+        char *p = static_cast<char*>(mmap(NULL, 2 * region_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+        if (p == MAP_FAILED)
+            throw std::bad_alloc();
+
+        std::size_t head = (region_size - reinterpret_cast<std::size_t>(p) % region_size) % region_size;
+
+        if (head != 0)
+            munmap(p, head);
+        munmap(p + head + region_size, region_size - head);
+
+        region = p + head;
+
+#ifdef MADV_HUGEPAGE
+        madvise(region, region_size, MADV_HUGEPAGE);
+#endif
+    }
+
+    // before the first touch, which is what places the pages
+    if (m_numa_node >= 0 && bind_region(region))
+        m_bound_regions++;
+
+    m_regions.push_back(region);
+    m_next = static_cast<char*>(region);
+    m_end  = m_next + region_size;
+}
+
+inline bool radix_tree_arena::bind_region(void *region)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    const int mpol_bind = 2;
+    const std::size_t bits = 8 * sizeof(unsigned long);
+    unsigned long mask[1024 / bits] = { 0 };
+
+    if (static_cast<std::size_t>(m_numa_node) >= 1024)
+        return false;
+
+    mask[m_numa_node / bits] |= 1UL << (m_numa_node % bits);
+
+    // the kernel reads maxnode - 1 bits
+    return syscall(SYS_mbind, region, region_size, mpol_bind, mask, 1024 + 1, 0) == 0;
+#else
+    (void)region;
+    return false;
+#endif
+}
+
+// NUMA node of the CPU the calling thread runs on, 0 if unknown
+inline int radix_tree_current_numa_node()
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return static_cast<int>(node);
+#endif
+    return 0;
+}
+
+// number of NUMA nodes, from the highest online node id; 1 if unknown
+inline int radix_tree_numa_nodes()
+{
+    std::ifstream in("/sys/devices/system/node/online");
+    std::string online;
+    int nodes = 1;
+
+    if (! (in >> online))
+        return nodes;
+
+    // a list of ids and ranges such as "0-3,8"
+    int id = 0;
+    for (std::size_t i = 0; i <= online.size(); i++) {
+        if (i < online.size() && online[i] >= '0' && online[i] <= '9') {
+            id = id * 10 + (online[i] - '0');
+            continue;
+        }
+        if (id + 1 > nodes)
+            nodes = id + 1;
+        id = 0;
+    }
+
+    return nodes;
+}
+
+template <class Tree>
+class radix_tree_replicas {
+public:
+    explicit radix_tree_replicas(const Tree &tree, int nodes = radix_tree_numa_nodes());
+    ~radix_tree_replicas();
+
+    // copies tree into every replica; readers must not be using them
+    void assign(const Tree &tree);
+
+    // the replica for the calling thread's NUMA node; it is only read, so
+    // any number of threads may use it at once. A copy of it shares its
+    // arena, see above.
+    const Tree& local() const {
+        return replica(radix_tree_current_numa_node());
+    }
+    const Tree& replica(int node) const {
+        return *m_trees[static_cast<std::size_t>(node) % m_trees.size()];
+    }
+    const radix_tree_arena& arena(int node) const {
+        return *m_arenas[static_cast<std::size_t>(node) % m_arenas.size()];
+    }
+    int size() const {
+        return static_cast<int>(m_trees.size());
+    }
+
+private:
+    std::vector<radix_tree_arena*> m_arenas;
+    std::vector<Tree*> m_trees;
+
+    void destroy();
+
+    radix_tree_replicas(const radix_tree_replicas&); // delete
+    radix_tree_replicas& operator=(const radix_tree_replicas&); // delete
+};
+
+template <class Tree>
+radix_tree_replicas<Tree>::radix_tree_replicas(const Tree &tree, int nodes)
+{
+    if (nodes < 1)
+        nodes = 1;
+
+    // with room reserved only new and the copies can throw, and whatever
+    // was made by then is in the vectors for destroy()
+    try {
+        m_arenas.reserve(nodes);
+        m_trees.reserve(nodes);
+
+        for (int i = 0; i < nodes; i++) {
+            m_arenas.push_back(new radix_tree_arena(nodes > 1 ? i : -1));
+            m_trees.push_back(new Tree());
+            m_trees.back()->set_memory_resource(m_arenas.back());
+        }
+
+        assign(tree);
+    } catch (...) {
+        destroy();
+        throw;
+    }
+}
+
+template <class Tree>
+radix_tree_replicas<Tree>::~radix_tree_replicas()
+{
+    destroy();
+}
+
+template <class Tree>
+void radix_tree_replicas<Tree>::destroy()
+{
+    // the trees give their nodes back to the arenas first
+    for (std::size_t i = 0; i < m_trees.size(); i++)
+        delete m_trees[i];
+    for (std::size_t i = 0; i < m_arenas.size(); i++)
+        delete m_arenas[i];
+
+    m_trees.clear();
+    m_arenas.clear();
+}
+
+template <class Tree>
+void radix_tree_replicas<Tree>::assign(const Tree &tree)
+{
+    for (std::size_t i = 0; i < m_trees.size(); i++) {
+        Tree copy(tree);
+
+        copy.set_memory_resource(m_arenas[i]);
+        *m_trees[i] = copy;
+    }
+}
+
+#endif // RADIX_TREE_ARENA_HPP
@@ -0,0 +1,884 @@
+#ifndef RADIX_TREE_HAT_HPP
+#define RADIX_TREE_HAT_HPP
+
+// hat_radix_tree is an ordered map from std::string keys for large, dense
+// key sets, laid out as a HAT-trie. The upper levels are trie nodes with
+// one slot per byte value, and everything below a slot lives in a single
+// bucket: the key suffixes packed back to back in key order, next to an
+// array of their values. A bucket that grows past burst_size entries
+// bursts into a trie node, whose slots each get a bucket for the
+// suffixes starting with that byte.
+//
+//     hat_radix_tree<int> words;
+//     words["apple"] = 1;
+//     words.prefix_match("app", vec);
+//
+// A lookup indexes a few trie nodes, one byte per level, and ends in a
+// binary search of a bucket held in three contiguous blocks, instead of
+// chasing a pointer at every branch. Buckets stay sorted, so iteration is
+// in key order, the order of radix_tree and std::map, without sorting.
+//
+// An iterator holds its position as a path of trie nodes and an index
+// into a bucket, so unlike those of radix_tree it is invalidated by any
+// insert or erase. So is every reference or pointer to a value, however
+// it was obtained, from operator[], find(), insert() or an iterator: a
+// bucket keeps its values in one array, which an insert or erase shifts
+// or reallocates and a burst moves into new buckets. Unlike std::map,
+//
+//     words["pear"] = words["apple"];    // may read a moved value
+//
+// is wrong; copy the value out first. erase frees trie nodes left empty
+// but does not fold small subtrees back into buckets.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class hat_radix_tree {
+    struct child_type;
+    struct node_type;
+    struct bucket_type;
+    struct frame_type;
+
+public:
+    typedef std::string key_type;
+    typedef T mapped_type;
+    typedef std::pair<const std::string, T> value_type;
+    typedef std::size_t size_type;
+
+    // what an iterator points at; the key is rebuilt from the trie path
+    template <class V>
+    struct basic_entry {
+        const std::string &first;
+        V &second;
+
+        basic_entry(const std::string &key, V &val) : first(key), second(val) { }
+        const basic_entry* operator-> () const {
+            return this;
+        }
+    };
+
+    template <class V>
+    class basic_iterator {
+        friend class hat_radix_tree;
+        template <class> friend class basic_iterator;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef basic_entry<V> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef basic_entry<V> reference;
+        typedef basic_entry<V> pointer;
+
+        basic_iterator() : m_tree(NULL), m_bucket(NULL), m_index(0), m_value(NULL), m_located(true) { }
+        // iterator to const_iterator
+        template <class W>
+        basic_iterator(const basic_iterator<W> &other) :
+            m_tree(other.m_tree), m_stack(other.m_stack), m_path(other.m_path),
+            m_bucket(other.m_bucket), m_index(other.m_index), m_key(other.m_key),
+            m_value(other.m_value), m_located(other.m_located) { }
+
+        reference operator* () const {
+            return reference(m_key, *m_value);
+        }
+        pointer operator-> () const {
+            return pointer(m_key, *m_value);
+        }
+        basic_iterator& operator++ () {
+            increment();
+            return *this;
+        }
+        basic_iterator operator++ (int) {
+            basic_iterator tmp(*this);
+            increment();
+            return tmp;
+        }
+        bool operator== (const basic_iterator &rhs) const {
+            return m_value == rhs.m_value;
+        }
+        bool operator!= (const basic_iterator &rhs) const {
+            return m_value != rhs.m_value;
+        }
+
+    private:
+        const hat_radix_tree *m_tree;
+        std::vector<frame_type> m_stack;
+        std::string m_path;    // the slot bytes taken from the root down
+        bucket_type *m_bucket; // NULL at a trie node's own entry
+        size_type m_index;
+        std::string m_key;
+        V *m_value;            // NULL at end()
+        bool m_located;        // false until m_stack is built, see find()
+
+        explicit basic_iterator(const hat_radix_tree *tree) :
+            m_tree(tree), m_bucket(NULL), m_index(0), m_value(NULL), m_located(true) { }
+        basic_iterator(const hat_radix_tree *tree, const std::string &key, V *value) :
+            m_tree(tree), m_bucket(NULL), m_index(0), m_key(key), m_value(value), m_located(false) { }
+
+        void seek(const std::string &key);
+        void first(child_type *child);
+        void next_slot();
+        void increment();
+        void load();
+    };
+
+    typedef basic_iterator<T> iterator;
+    typedef basic_iterator<const T> const_iterator;
+
+    // buckets burst once they hold more than burst_size entries
+    explicit hat_radix_tree(size_type burst_size = 512) :
+        m_root(NULL), m_size(0), m_burst_size(burst_size < 1 ? 1 : burst_size),
+        m_nodes(0), m_buckets(0) { }
+    hat_radix_tree(const hat_radix_tree &other);
+    hat_radix_tree& operator =(const hat_radix_tree &other);
+    ~hat_radix_tree() {
+        clear();
+    }
+
+    void swap(hat_radix_tree &other);
+    void clear();
+
+    size_type size() const {
+        return m_size;
+    }
+    bool empty() const {
+        return m_size == 0;
+    }
+    size_type burst_size() const {
+        return m_burst_size;
+    }
+    // trie nodes and buckets the keys are spread over
+    size_type trie_nodes() const {
+        return m_nodes;
+    }
+    size_type buckets() const {
+        return m_buckets;
+    }
+
+    // valid until the next insert or erase, see above
+    T& operator[] (const std::string &key) {
+        return insert(value_type(key, T())).first->second;
+    }
+
+    iterator begin();
+    iterator end() {
+        return iterator(this);
+    }
+    const_iterator begin() const;
+    const_iterator end() const {
+        return const_iterator(this);
+    }
+
+    iterator find(const std::string &key) {
+        T *val = lookup(key);
+        return val == NULL ? end() : iterator(this, key, val);
+    }
+    const_iterator find(const std::string &key) const {
+        const T *val = lookup(key);
+        return val == NULL ? end() : const_iterator(this, key, val);
+    }
+
+    std::pair<iterator, bool> insert(const value_type &val);
+    bool erase(const std::string &key);
+
+    // every entry whose key starts with key, in key order
+    void prefix_match(const std::string &key, std::vector<iterator> &vec);
+    void prefix_match(const std::string &key, std::vector<const_iterator> &vec) const;
+
+private:
+    struct child_type {
+        bool m_is_node;
+
+        explicit child_type(bool is_node) : m_is_node(is_node) { }
+    };
+
+    struct node_type : child_type {
+        child_type *m_slot[256];
+        unsigned m_children; // slots in use
+        T *m_value;          // entry whose key ends at this node, or NULL
+
+        node_type() : child_type(true), m_children(0), m_value(NULL) {
+            std::fill(m_slot, m_slot + 256, static_cast<child_type*>(NULL));
+        }
+    };
+
+    struct bucket_type : child_type {
+        std::vector<char> m_keys;     // the suffixes back to back, in key order
+        std::vector<unsigned> m_ends; // where each suffix ends in m_keys
+        std::vector<T> m_values;
+
+        bucket_type() : child_type(false) { }
+
+        size_type size() const {
+            return m_ends.size();
+        }
+        size_type begin_of(size_type i) const {
+            return i == 0 ? 0 : m_ends[i - 1];
+        }
+        const char* key_of(size_type i) const {
+            return m_keys.empty() ? NULL : &m_keys[0] + begin_of(i);
+        }
+        size_type length_of(size_type i) const {
+            return m_ends[i] - begin_of(i);
+        }
+
+        int compare(size_type i, const char *key, size_type len) const;
+        // first entry not below key, and whether it is key
+        size_type lower_bound(const char *key, size_type len, bool &found) const;
+        void insert(size_type i, const char *key, size_type len, const T &val);
+        void append(const char *key, size_type len, const T &val);
+        void erase(size_type i);
+    };
+
+    // a trie node on an iterator's path and the next of its slots to visit
+    struct frame_type {
+        node_type *m_node;
+        unsigned m_next;
+
+        frame_type(node_type *node, unsigned next) : m_node(node), m_next(next) { }
+    };
+
+    child_type *m_root;
+    size_type m_size;
+    size_type m_burst_size;
+    size_type m_nodes;
+    size_type m_buckets;
+
+    T* lookup(const std::string &key) const;
+    void burst(child_type **slot);
+    node_type* split(const bucket_type *bucket);
+    child_type* copy_child(const child_type *child);
+    void destroy(child_type *child);
+
+    node_type* new_node() {
+        node_type *node = new node_type;
+        m_nodes++;
+        return node;
+    }
+    bucket_type* new_bucket() {
+        bucket_type *bucket = new bucket_type;
+        m_buckets++;
+        return bucket;
+    }
+};
+
+template <typename T>
+int hat_radix_tree<T>::bucket_type::compare(size_type i, const char *key, size_type len) const
+{
+    size_type n = length_of(i);
+    size_type common = n < len ? n : len;
+
+    if (common != 0) {
+        int cmp = std::memcmp(key_of(i), key, common);
+        if (cmp != 0)
+            return cmp;
+    }
+
+    return n < len ? -1 : n > len ? 1 : 0;
+}
+
+template <typename T>
+typename hat_radix_tree<T>::size_type hat_radix_tree<T>::bucket_type::lower_bound(const char *key, size_type len, bool &found) const
+{
+    size_type lo = 0, hi = size();
+
+    while (lo < hi) {
+        size_type mid = lo + (hi - lo) / 2;
+
+        if (compare(mid, key, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    found = lo < size() && compare(lo, key, len) == 0;
+
+    return lo;
+}
+
+template <typename T>
+void hat_radix_tree<T>::bucket_type::insert(size_type i, const char *key, size_type len, const T &val)
+{
+    size_type at = begin_of(i);
+
+    // nothing below throws once there is room, save copying val
+    m_keys.reserve(m_keys.size() + len);
+    m_ends.reserve(m_ends.size() + 1);
+    m_values.insert(m_values.begin() + i, val);
+    m_keys.insert(m_keys.begin() + at, key, key + len);
+    m_ends.insert(m_ends.begin() + i, static_cast<unsigned>(at + len));
+
+    for (size_type j = i + 1; j < m_ends.size(); j++)
+        m_ends[j] += static_cast<unsigned>(len);
+}
+
+template <typename T>
+void hat_radix_tree<T>::bucket_type::append(const char *key, size_type len, const T &val)
+{
+    m_values.push_back(val);
+    m_keys.insert(m_keys.end(), key, key + len);
+    m_ends.push_back(static_cast<unsigned>(m_keys.size()));
+}
+
+template <typename T>
+void hat_radix_tree<T>::bucket_type::erase(size_type i)
+{
+    size_type at = begin_of(i), len = length_of(i);
+
+    m_keys.erase(m_keys.begin() + at, m_keys.begin() + at + len);
+    m_ends.erase(m_ends.begin() + i);
+    m_values.erase(m_values.begin() + i);
+
+    for (size_type j = i; j < m_ends.size(); j++)
+        m_ends[j] -= static_cast<unsigned>(len);
+}
+
+template <typename T>
+hat_radix_tree<T>::hat_radix_tree(const hat_radix_tree &other) :
+    m_root(NULL), m_size(0), m_burst_size(other.m_burst_size), m_nodes(0), m_buckets(0)
+{
+    if (other.m_root != NULL)
+        m_root = copy_child(other.m_root);
+
+    m_size = other.m_size;
+}
+
+template <typename T>
+hat_radix_tree<T>& hat_radix_tree<T>::operator =(const hat_radix_tree &other)
+{
+    if (this != &other) {
+        hat_radix_tree tmp(other);
+        swap(tmp);
+    }
+
+    return *this;
+}
+
+template <typename T>
+void hat_radix_tree<T>::swap(hat_radix_tree &other)
+{
+    std::swap(m_root, other.m_root);
+    std::swap(m_size, other.m_size);
+    std::swap(m_burst_size, other.m_burst_size);
+    std::swap(m_nodes, other.m_nodes);
+    std::swap(m_buckets, other.m_buckets);
+}
+
+template <typename T>
+void hat_radix_tree<T>::clear()
+{
+    if (m_root != NULL)
+        destroy(m_root);
+
+    m_root = NULL;
+    m_size = 0;
+}
+
+// frees child and everything under it; explicit worklist, as a trie
+// over long keys can be deeper than the thread stack allows to recurse
+template <typename T>
+void hat_radix_tree<T>::destroy(child_type *child)
+{
+    std::vector<child_type*> work(1, child);
+
+    while (! work.empty()) {
+        child = work.back();
+        work.pop_back();
+
+        if (! child->m_is_node) {
+            delete static_cast<bucket_type*>(child);
+            m_buckets--;
+            continue;
+        }
+
+        node_type *node = static_cast<node_type*>(child);
+
+        for (unsigned i = 0; i < 256 && node->m_children != 0; i++) {
+            if (node->m_slot[i] != NULL) {
+                work.push_back(node->m_slot[i]);
+                node->m_children--;
+            }
+        }
+
+        delete node->m_value;
+        delete node;
+        m_nodes--;
+    }
+}
+
+template <typename T>
+typename hat_radix_tree<T>::child_type* hat_radix_tree<T>::copy_child(const child_type *child)
+{
+    if (! child->m_is_node) {
+        bucket_type *bucket = new bucket_type(*static_cast<const bucket_type*>(child));
+        m_buckets++;
+        return bucket;
+    }
+
+    // copy the trie nodes top-down; each copy is linked in as soon as it
+    // exists, so that a throw leaves one tree for destroy() to free
+    typedef std::pair<const node_type*, node_type*> copy_t;
+
+    node_type *root = new_node();
+    std::vector<copy_t> work(1, copy_t(static_cast<const node_type*>(child), root));
+
+    try {
+        while (! work.empty()) {
+            const node_type *src = work.back().first;
+            node_type *dst = work.back().second;
+            work.pop_back();
+
+            if (src->m_value != NULL)
+                dst->m_value = new T(*src->m_value);
+
+            for (unsigned i = 0; i < 256; i++) {
+                const child_type *from = src->m_slot[i];
+
+                if (from == NULL)
+                    continue;
+
+                if (! from->m_is_node) {
+                    dst->m_slot[i] = new bucket_type(*static_cast<const bucket_type*>(from));
+                    dst->m_children++;
+                    m_buckets++;
+                    continue;
+                }
+
+                node_type *to = new_node();
+                dst->m_slot[i] = to;
+                dst->m_children++;
+
+                work.push_back(copy_t(static_cast<const node_type*>(from), to));
+            }
+        }
+    } catch (...) {
+        destroy(root);
+        throw;
+    }
+
+    return root;
+}
+
+template <typename T>
+T* hat_radix_tree<T>::lookup(const std::string &key) const
+{
+    const child_type *child = m_root;
+    size_type pos = 0;
+
+    while (child != NULL && child->m_is_node) {
+        const node_type *node = static_cast<const node_type*>(child);
+
+        if (pos == key.size())
+            return node->m_value;
+
+        child = node->m_slot[static_cast<unsigned char>(key[pos++])];
+    }
+
+    if (child == NULL)
+        return NULL;
+
+    bucket_type *bucket = const_cast<bucket_type*>(static_cast<const bucket_type*>(child));
+    bool found;
+    size_type i = bucket->lower_bound(key.data() + pos, key.size() - pos, found);
+
+    return found ? &bucket->m_values[i] : NULL;
+}
+
+template <typename T>
+std::pair<typename hat_radix_tree<T>::iterator, bool> hat_radix_tree<T>::insert(const value_type &val)
+{
+    const std::string &key = val.first;
+    child_type **slot = &m_root;
+    node_type *parent = NULL;
+    size_type pos = 0;
+
+    while (*slot != NULL && (*slot)->m_is_node) {
+        node_type *node = static_cast<node_type*>(*slot);
+
+        if (pos == key.size()) {
+            if (node->m_value != NULL)
+                return std::make_pair(iterator(this, key, node->m_value), false);
+
+            node->m_value = new T(val.second);
+            m_size++;
+
+            return std::make_pair(iterator(this, key, node->m_value), true);
+        }
+
+        parent = node;
+        slot = &node->m_slot[static_cast<unsigned char>(key[pos++])];
+    }
+
+    if (*slot == NULL) {
+        *slot = new_bucket();
+        if (parent != NULL)
+            parent->m_children++;
+    }
+
+    bucket_type *bucket = static_cast<bucket_type*>(*slot);
+    bool found;
+    size_type i = bucket->lower_bound(key.data() + pos, key.size() - pos, found);
+
+    if (found)
+        return std::make_pair(iterator(this, key, &bucket->m_values[i]), false);
+
+    try {
+        bucket->insert(i, key.data() + pos, key.size() - pos, val.second);
+    } catch (...) {
+        if (bucket->size() == 0) {
+            destroy(bucket);
+            *slot = NULL;
+            if (parent != NULL)
+                parent->m_children--;
+        }
+        throw;
+    }
+    m_size++;
+
+    if (bucket->size() <= m_burst_size)
+        return std::make_pair(iterator(this, key, &bucket->m_values[i]), true);
+
+    burst(slot);
+
+    return std::make_pair(iterator(this, key, lookup(key)), true);
+}
+
+// replaces the bucket at slot by a trie node over buckets of its suffixes
+// split on their first byte, bursting those in turn if they are still
+// too large; the bucket stays in place if this throws
+template <typename T>
+void hat_radix_tree<T>::burst(child_type **slot)
+{
+    bucket_type *bucket = static_cast<bucket_type*>(*slot);
+    node_type *node = split(bucket);
+
+    // keys sharing a long prefix burst once per byte of it, so the
+    // buckets still too large wait on a worklist rather than recursing
+    try {
+        std::vector<node_type*> work(1, node);
+
+        while (! work.empty()) {
+            node_type *parent = work.back();
+            work.pop_back();
+
+            for (unsigned i = 0; i < 256; i++) {
+                bucket_type *child = static_cast<bucket_type*>(parent->m_slot[i]);
+
+                if (child == NULL || child->size() <= m_burst_size)
+                    continue;
+
+                node_type *inner = split(child);
+                parent->m_slot[i] = inner;
+                destroy(child);
+
+                work.push_back(inner);
+            }
+        }
+    } catch (...) {
+        destroy(node);
+        throw;
+    }
+
+    *slot = node;
+    destroy(bucket);
+}
+
+// a new trie node over buckets of bucket's suffixes, split on their
+// first byte; bucket is left as it is
+template <typename T>
+typename hat_radix_tree<T>::node_type* hat_radix_tree<T>::split(const bucket_type *bucket)
+{
+    node_type *node = new_node();
+
+    try {
+        for (size_type i = 0; i < bucket->size(); i++) {
+            const char *key = bucket->key_of(i);
+            size_type len = bucket->length_of(i);
+
+            // only the first suffix can be empty
+            if (len == 0) {
+                node->m_value = new T(bucket->m_values[i]);
+                continue;
+            }
+
+            child_type *&child = node->m_slot[static_cast<unsigned char>(key[0])];
+
+            if (child == NULL) {
+                child = new_bucket();
+                node->m_children++;
+            }
+
+            // the suffixes arrive in order, so each new bucket stays sorted
+            static_cast<bucket_type*>(child)->append(key + 1, len - 1, bucket->m_values[i]);
+        }
+    } catch (...) {
+        destroy(node);
+        throw;
+    }
+
+    return node;
+}
+
+template <typename T>
+bool hat_radix_tree<T>::erase(const std::string &key)
+{
+    std::vector<child_type**> path; // slots of the trie nodes passed
+    child_type **slot = &m_root;
+    size_type pos = 0;
+
+    while (*slot != NULL && (*slot)->m_is_node) {
+        node_type *node = static_cast<node_type*>(*slot);
+
+        path.push_back(slot);
+
+        if (pos == key.size())
+            break;
+
+        slot = &node->m_slot[static_cast<unsigned char>(key[pos++])];
+    }
+
+    if (*slot == NULL)
+        return false;
+
+    if ((*slot)->m_is_node) {
+        node_type *node = static_cast<node_type*>(*slot);
+
+        if (node->m_value == NULL)
+            return false;
+
+        delete node->m_value;
+        node->m_value = NULL;
+    } else {
+        bucket_type *bucket = static_cast<bucket_type*>(*slot);
+        bool found;
+        size_type i = bucket->lower_bound(key.data() + pos, key.size() - pos, found);
+
+        if (! found)
+            return false;
+
+        bucket->erase(i);
+
+        if (bucket->size() != 0) {
+            m_size--;
+            return true;
+        }
+
+        destroy(bucket);
+        *slot = NULL;
+        if (! path.empty())
+            static_cast<node_type*>(*path.back())->m_children--;
+    }
+
+    m_size--;
+
+    // free the trie nodes left without entries, bottom up
+    while (! path.empty()) {
+        node_type *node = static_cast<node_type*>(*path.back());
+
+        if (node->m_value != NULL || node->m_children != 0)
+            break;
+
+        *path.back() = NULL;
+        path.pop_back();
+        destroy(node);
+
+        if (! path.empty())
+            static_cast<node_type*>(*path.back())->m_children--;
+    }
+
+    return true;
+}
+
+template <typename T>
+typename hat_radix_tree<T>::iterator hat_radix_tree<T>::begin()
+{
+    iterator it(this);
+
+    if (m_root != NULL)
+        it.first(m_root);
+
+    return it;
+}
+
+template <typename T>
+typename hat_radix_tree<T>::const_iterator hat_radix_tree<T>::begin() const
+{
+    const_iterator it(this);
+
+    if (m_root != NULL)
+        it.first(m_root);
+
+    return it;
+}
+
+template <typename T>
+void hat_radix_tree<T>::prefix_match(const std::string &key, std::vector<iterator> &vec)
+{
+    vec.clear();
+
+    iterator it(this);
+    for (it.seek(key); it != end() && it->first.compare(0, key.size(), key) == 0; ++it)
+        vec.push_back(it);
+}
+
+template <typename T>
+void hat_radix_tree<T>::prefix_match(const std::string &key, std::vector<const_iterator> &vec) const
+{
+    vec.clear();
+
+    const_iterator it(this);
+    for (it.seek(key); it != end() && it->first.compare(0, key.size(), key) == 0; ++it)
+        vec.push_back(it);
+}
+
+// positions the iterator at the first entry not below key
+template <typename T>
+template <class V>
+void hat_radix_tree<T>::basic_iterator<V>::seek(const std::string &key)
+{
+    child_type *child = m_tree->m_root;
+    size_type pos = 0;
+
+    m_stack.clear();
+    m_path.clear();
+    m_bucket = NULL;
+    m_value = NULL;
+    m_located = true;
+
+    if (child == NULL)
+        return;
+
+    while (child->m_is_node) {
+        node_type *node = static_cast<node_type*>(child);
+
+        if (pos == key.size()) {
+            m_stack.push_back(frame_type(node, 0));
+
+            if (node->m_value != NULL) {
+                m_key = m_path;
+                m_value = node->m_value;
+            } else {
+                next_slot();
+            }
+            return;
+        }
+
+        unsigned char unit = static_cast<unsigned char>(key[pos++]);
+
+        m_stack.push_back(frame_type(node, unit + 1));
+        child = node->m_slot[unit];
+
+        if (child == NULL) {
+            next_slot();
+            return;
+        }
+        m_path += static_cast<char>(unit);
+    }
+
+    bucket_type *bucket = static_cast<bucket_type*>(child);
+    bool found;
+
+    m_index = bucket->lower_bound(key.data() + pos, key.size() - pos, found);
+
+    if (m_index < bucket->size()) {
+        m_bucket = bucket;
+        load();
+    } else {
+        next_slot();
+    }
+}
+
+// the first entry under child, whose path is m_path
+template <typename T>
+template <class V>
+void hat_radix_tree<T>::basic_iterator<V>::first(child_type *child)
+{
+    while (child->m_is_node) {
+        node_type *node = static_cast<node_type*>(child);
+
+        m_stack.push_back(frame_type(node, 0));
+
+        if (node->m_value != NULL) {
+            m_bucket = NULL;
+            m_key = m_path;
+            m_value = node->m_value;
+            return;
+        }
+
+        // a trie node without an entry of its own has a child
+        unsigned unit = 0;
+        while (node->m_slot[unit] == NULL)
+            unit++;
+
+        m_stack.back().m_next = unit + 1;
+        m_path += static_cast<char>(unit);
+        child = node->m_slot[unit];
+    }
+
+    m_bucket = static_cast<bucket_type*>(child);
+    m_index = 0;
+    load();
+}
+
+// the first entry under the next slot in use of the deepest trie node on
+// the path that has one, or end()
+template <typename T>
+template <class V>
+void hat_radix_tree<T>::basic_iterator<V>::next_slot()
+{
+    while (! m_stack.empty()) {
+        frame_type &frame = m_stack.back();
+
+        while (frame.m_next < 256 && frame.m_node->m_slot[frame.m_next] == NULL)
+            frame.m_next++;
+
+        if (frame.m_next < 256) {
+            unsigned unit = frame.m_next++;
+            child_type *child = frame.m_node->m_slot[unit];
+
+            m_path.resize(m_stack.size() - 1);
+            m_path += static_cast<char>(unit);
+            first(child);
+            return;
+        }
+
+        m_stack.pop_back();
+    }
+
+    m_bucket = NULL;
+    m_value = NULL;
+}
+
+template <typename T>
+template <class V>
+void hat_radix_tree<T>::basic_iterator<V>::increment()
+{
+    // an iterator from find() knows only its key so far
+    if (! m_located)
+        seek(std::string(m_key));
+
+    if (m_bucket != NULL && ++m_index < m_bucket->size()) {
+        load();
+        return;
+    }
+
+    m_bucket = NULL;
+    next_slot();
+}
+
+template <typename T>
+template <class V>
+void hat_radix_tree<T>::basic_iterator<V>::load()
+{
+    m_key.assign(m_path);
+    if (m_bucket->length_of(m_index) != 0)
+        m_key.append(m_bucket->key_of(m_index), m_bucket->length_of(m_index));
+    m_value = &m_bucket->m_values[m_index];
+}
+
+#endif // RADIX_TREE_HAT_HPP
@@ -1,21 +1,51 @@
 #ifndef RADIX_TREE_IT
 #define RADIX_TREE_IT
 
+#include <cstddef>
 #include <iterator>
 #include <functional>
+#include <utility>
+
+#include "radix_tree_stats.hpp"
 
 // forward declaration
-template <typename K, typename T, class Compare = std::less<K> > class radix_tree;
+template <typename K, typename T, class Compare = std::less<K>, class Stats = radix_tree_null_stats> class radix_tree;
 template <typename K, typename T, class Compare = std::less<K> > class radix_tree_node;
+template <typename K, typename T, class Compare = std::less<K> > class radix_tree_const_it;
 
+// The tree behind the iterators of a tree that shares nodes with its
+// copies (see radix_tree's copy constructor): there a node's m_parent
+// may lead into another tree, and a node reached for writing may first
+// have to be copied.
 template <typename K, typename T, class Compare = std::less<K> >
-class radix_tree_it : public std::iterator<std::forward_iterator_tag, std::pair<K, T> > {
-    friend class radix_tree<K, T, Compare>;
+class radix_tree_owner {
+public:
+    virtual ~radix_tree_owner() { }
+
+    // the tree's own node for the entry of node, with every node on the
+    // path to it copied first if the tree shares it
+    virtual radix_tree_node<K, T, Compare>* own(radix_tree_node<K, T, Compare> *node) = 0;
+    // the entry after that of node, in the tree's order
+    virtual radix_tree_node<K, T, Compare>* next(radix_tree_node<K, T, Compare> *node) const = 0;
+};
+
+template <typename K, typename T, class Compare = std::less<K> >
+class radix_tree_it {
+    template <typename, typename, typename, typename> friend class radix_tree;
+    friend class radix_tree_const_it<K, T, Compare>;
 
 public:
-    radix_tree_it() : m_pointee(0) { }
-    radix_tree_it(const radix_tree_it& r) : m_pointee(r.m_pointee) { }
-    radix_tree_it& operator=(const radix_tree_it& r) { m_pointee = r.m_pointee; return *this; }
+    // spelled out rather than inherited from std::iterator, which C++17
+    // deprecates
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<const K, T>     value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef value_type*               pointer;
+    typedef value_type&               reference;
+
+    radix_tree_it() : m_pointee(0), m_owner(0) { }
+    radix_tree_it(const radix_tree_it& r) : m_pointee(r.m_pointee), m_owner(r.m_owner) { }
+    radix_tree_it& operator=(const radix_tree_it& r) { m_pointee = r.m_pointee; m_owner = r.m_owner; return *this; }
     ~radix_tree_it() { }
 
     std::pair<const K, T>& operator*  () const;
@@ -27,66 +57,89 @@ public:
     bool operator== (const radix_tree_it<K, T, Compare> &lhs) const;
 
 private:
-    radix_tree_node<K, T, Compare> *m_pointee;
-    radix_tree_it(radix_tree_node<K, T, Compare> *p) : m_pointee(p) { }
+    mutable radix_tree_node<K, T, Compare> *m_pointee;
+    radix_tree_owner<K, T, Compare> *m_owner; // NULL unless the tree shares nodes
+    radix_tree_it(radix_tree_node<K, T, Compare> *p, radix_tree_owner<K, T, Compare> *owner = 0) : m_pointee(p), m_owner(owner) { }
 
     radix_tree_node<K, T, Compare>* increment(radix_tree_node<K, T, Compare>* node) const;
     radix_tree_node<K, T, Compare>* descend(radix_tree_node<K, T, Compare>* node) const;
 };
 
+// entries are visited in pre-order: a node's own entry comes before the
+// entries of its children, as its key is a prefix of theirs
 template <typename K, typename T, typename Compare>
 radix_tree_node<K, T, Compare>* radix_tree_it<K, T, Compare>::increment(radix_tree_node<K, T, Compare>* node) const
 {
-	radix_tree_node<K, T, Compare>* parent = node->m_parent;
+    if (m_owner != NULL)
+        return m_owner->next(node);
+
+    if (! node->m_children.empty())
+        return descend(node->m_children.begin()->second);
+
+    for (;;) {
+        radix_tree_node<K, T, Compare>* parent = node->m_parent;
+
+        if (parent == NULL)
+            return NULL;
 
-    if (parent == NULL)
-        return NULL;
+        typename radix_tree_node<K, T, Compare>::it_child it = parent->m_children.find(node);
+        assert(it != parent->m_children.end());
+        ++it;
 
-    typename radix_tree_node<K, T, Compare>::it_child it = parent->m_children.find(node->m_key);
-    assert(it != parent->m_children.end());
-    ++it;
+        if (it != parent->m_children.end())
+            return descend(it->second);
 
-    if (it == parent->m_children.end())
-        return increment(parent);
-    else
-        return descend(it->second);
+        node = parent;
+    }
 }
 
 template <typename K, typename T, typename Compare>
 radix_tree_node<K, T, Compare>* radix_tree_it<K, T, Compare>::descend(radix_tree_node<K, T, Compare>* node) const
 {
-    if (node->m_is_leaf)
-        return node;
+    while (node->m_value == NULL) {
+        typename radix_tree_node<K, T, Compare>::it_child it = node->m_children.begin();
 
-    typename radix_tree_node<K, T, Compare>::it_child it = node->m_children.begin();
+        assert(it != node->m_children.end());
 
-    assert(it != node->m_children.end());
+        node = it->second;
+    }
 
-    return descend(it->second);
+    return node;
 }
 
 template <typename K, typename T, typename Compare>
 std::pair<const K, T>& radix_tree_it<K, T, Compare>::operator* () const
 {
+    if (m_owner != NULL)
+        m_pointee = m_owner->own(m_pointee);
+
     return *m_pointee->m_value;
 }
 
 template <typename K, typename T, typename Compare>
 std::pair<const K, T>* radix_tree_it<K, T, Compare>::operator-> () const
 {
-    return m_pointee->m_value;
+    return &**this;
 }
 
 template <typename K, typename T, typename Compare>
 bool radix_tree_it<K, T, Compare>::operator!= (const radix_tree_it<K, T, Compare> &lhs) const
 {
-    return m_pointee != lhs.m_pointee;
+    return ! (*this == lhs);
 }
 
+// writing through one iterator may move the entry another one points at
+// to a copy, so with an owner the keys decide
 template <typename K, typename T, typename Compare>
 bool radix_tree_it<K, T, Compare>::operator== (const radix_tree_it<K, T, Compare> &lhs) const
 {
-    return m_pointee == lhs.m_pointee;
+    if (m_pointee == lhs.m_pointee)
+        return true;
+
+    if ((m_owner == NULL && lhs.m_owner == NULL) || m_pointee == NULL || lhs.m_pointee == NULL)
+        return false;
+
+    return m_pointee->m_value->first == lhs.m_pointee->m_value->first;
 }
 
 template <typename K, typename T, typename Compare>
@@ -105,6 +158,43 @@ radix_tree_it<K, T, Compare> radix_tree_it<K, T, Compare>::operator++ (int)
     return copy;
 }
 
+// read-only view of a radix_tree_it; every iterator converts to it
+template <typename K, typename T, class Compare>
+class radix_tree_const_it {
+    template <typename, typename, typename, typename> friend class radix_tree;
+
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<const K, T>     value_type;
+    typedef std::ptrdiff_t            difference_type;
+    typedef const value_type*         pointer;
+    typedef const value_type&         reference;
+
+    radix_tree_const_it() : m_it() { }
+    radix_tree_const_it(const radix_tree_it<K, T, Compare>& it) : m_it(it) { }
+
+    // reads the node as it is, as nothing is written through it
+    const std::pair<const K, T>& operator*  () const { return *m_it.m_pointee->m_value; }
+    const std::pair<const K, T>* operator-> () const { return m_it.m_pointee->m_value; }
+    const radix_tree_const_it<K, T, Compare>& operator++ () { ++m_it; return *this; }
+    radix_tree_const_it<K, T, Compare> operator++ (int) {
+        radix_tree_const_it<K, T, Compare> copy(*this);
+        ++m_it;
+        return copy;
+    }
+
+    friend bool operator!= (const radix_tree_const_it<K, T, Compare> &lhs, const radix_tree_const_it<K, T, Compare> &rhs) {
+        return lhs.m_it != rhs.m_it;
+    }
+    friend bool operator== (const radix_tree_const_it<K, T, Compare> &lhs, const radix_tree_const_it<K, T, Compare> &rhs) {
+        return lhs.m_it == rhs.m_it;
+    }
+
+private:
+    radix_tree_it<K, T, Compare> m_it;
+    radix_tree_const_it(radix_tree_node<K, T, Compare> *p, radix_tree_owner<K, T, Compare> *owner = 0) : m_it(p, owner) { }
+};
+
 /*
 template <typename K, typename T>
 const radix_tree_it<K, T, Compare>& radix_tree_it<K, T, Compare>::operator-- ()
@@ -0,0 +1,615 @@
+#ifndef RADIX_TREE_LSM_HPP
+#define RADIX_TREE_LSM_HPP
+
+// lsm_radix_tree puts a small mutable radix_tree, the delta, in front of
+// a large one, the base, which is never written in place. Requires C++11
+// and, for the arena the base lives in, POSIX.
+//
+//     lsm_radix_tree<std::string, int> routes(4096);
+//     routes.insert_or_assign("10.0.0.0/8", 1);
+//     routes.longest_match("10.1.2.3", entry);
+//
+// Writes go to the delta; erasing a key the base holds leaves a tombstone
+// there. Lookups try the delta before the base, and iteration merges the
+// two in key order. Once the delta is full it is frozen, and a background
+// thread merges it with the base into a new base: one pass over both in
+// key order feeds apply_batch() on a fresh tree whose nodes come from an
+// arena of its own, so that they lie packed in the order a walk visits
+// them. Meanwhile writes start a fresh delta, and reads consult the frozen
+// one between the two. A writer that finds the fresh delta full as well
+// waits for the merge, which bounds the delta at delta_limit() entries.
+// compact() does the same merge in the calling thread. No merge holds the
+// lock while it builds, so readers and writers go on meanwhile.
+//
+// A merge copies the whole base, so the delta is full at threshold entries
+// or an eighth of the base, whichever is more: each merge then copies at
+// most nine entries per entry of the delta, and the work of all merges
+// stays linear in the writes instead of growing with the square of them.
+//
+// Any number of threads may call the members at once: writers take a
+// lock and readers share it, as in sharded_radix_tree, and lookups copy
+// their results out. The merged view orders whole keys by Compare, which
+// must agree with the order of the tree, as std::less does for strings.
+// Tombstones need T to be default constructible. Should a background
+// merge throw, the frozen delta stays where it is, still read, and the
+// next compact(), or the next writer held off by a full delta, merges it
+// again in its own thread; a writer gets the exception before it writes.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <shared_mutex>
+#endif
+
+#include "radix_tree.hpp"
+#include "radix_tree_arena.hpp"
+
+template <typename K, typename T, class Compare = std::less<K>, class Stats = radix_tree_null_stats>
+class lsm_radix_tree {
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<K, T> entry_type;
+    typedef radix_tree<K, T, Compare, Stats> tree_type;
+    typedef std::size_t size_type;
+
+    // the delta is frozen and merged once it holds threshold entries, or
+    // more as the base grows, see above
+    explicit lsm_radix_tree(size_type threshold = 4096) :
+        m_base(std::make_shared<tree_type>()), m_size(0),
+        m_threshold(threshold == 0 ? 1 : threshold), m_limit(m_threshold),
+        m_compacting(false) { }
+    ~lsm_radix_tree();
+
+    size_type size() const;
+    bool empty() const {
+        return size() == 0;
+    }
+    void clear();
+
+    // true if the key was not present; an existing value is kept
+    bool insert(const K &key, const T &value);
+    // true if the key was not present; an existing value is overwritten
+    bool insert_or_assign(const K &key, const T &value);
+    bool erase(const K &key);
+
+    bool find(const K &key, T &value) const;
+    bool longest_match(const K &key, entry_type &entry) const;
+    void prefix_match(const K &key, std::vector<entry_type> &vec) const;
+
+    // visits every entry in key order, with writers held off meanwhile
+    template<class _Function> void for_each(_Function fn) const;
+
+    // merges every write so far into the base and waits for it
+    void compact();
+
+    size_type threshold() const {
+        return m_threshold;
+    }
+    // entries the current delta may hold before it is frozen
+    size_type delta_limit() const;
+    // entries in the base, and in the delta with tombstones; those of a
+    // delta being merged count toward neither
+    size_type base_size() const;
+    size_type delta_size() const;
+    // true while a merge builds a base
+    bool compacting() const;
+
+private:
+#if __cplusplus >= 201703L
+    typedef std::shared_mutex mutex_type;
+    typedef std::shared_lock<std::shared_mutex> read_lock;
+#else
+    typedef std::mutex mutex_type;
+    typedef std::unique_lock<std::mutex> read_lock;
+#endif
+    typedef std::unique_lock<mutex_type> write_lock;
+
+    struct delta_value {
+        T m_value;
+        bool m_erased; // a tombstone hiding the key in the levels below
+
+        delta_value(const T &value, bool erased) : m_value(value), m_erased(erased) { }
+    };
+    typedef radix_tree<K, delta_value, Compare, Stats> delta_type;
+    typedef typename delta_type::const_iterator delta_it;
+    typedef typename tree_type::const_iterator base_it;
+
+    // entries a merge hands to apply_batch() at a time
+    static const size_type merge_batch = 1024;
+    // a full delta holds at least this share of the base: 1/base_ratio
+    static const size_type base_ratio = 8;
+
+    mutable mutex_type m_mutex;
+    std::condition_variable_any m_merged; // a merge has ended
+    std::shared_ptr<const tree_type> m_base;
+    std::shared_ptr<const delta_type> m_frozen; // being merged, or NULL
+    delta_type m_delta;
+    size_type m_size;
+    size_type m_threshold;
+    size_type m_limit; // of the current delta, set as it starts
+    bool m_compacting; // a merge is building a base
+    std::thread m_compactor;
+
+    const T* lookup(const K &key) const;
+    const T* lookup_below(const K &key) const;
+    void put(const K &key, const delta_value &value);
+    void make_room(write_lock &lock);
+    void maybe_compact();
+    void freeze();
+    std::exception_ptr merge_frozen(write_lock &lock);
+    write_lock wait();
+
+    static std::shared_ptr<const tree_type> build(const tree_type &base, const delta_type &delta);
+
+    static const typename delta_type::value_type& entry(const delta_it &it) {
+        return *it;
+    }
+    static const typename delta_type::value_type& entry(typename std::vector<delta_it>::const_iterator it) {
+        return **it;
+    }
+    static const typename tree_type::value_type& entry(const base_it &it) {
+        return *it;
+    }
+    static const typename tree_type::value_type& entry(typename std::vector<base_it>::const_iterator it) {
+        return **it;
+    }
+
+    template <class _DIt, class _BIt, class _Function>
+    static void merge(_DIt delta, _DIt delta_end, _DIt frozen, _DIt frozen_end, _BIt base, _BIt base_end, _Function fn);
+
+    lsm_radix_tree(const lsm_radix_tree &other); // delete
+    lsm_radix_tree& operator =(const lsm_radix_tree &other); // delete
+};
+
+template <typename K, typename T, class Compare, class Stats>
+lsm_radix_tree<K, T, Compare, Stats>::~lsm_radix_tree()
+{
+    if (m_compactor.joinable())
+        m_compactor.join();
+}
+
+// calls fn(key, value) in key order for the entries of the three levels,
+// which must each be in key order, the newest level winning on equal keys
+// and tombstones hiding the key
+template <typename K, typename T, class Compare, class Stats>
+template <class _DIt, class _BIt, class _Function>
+void lsm_radix_tree<K, T, Compare, Stats>::merge(_DIt delta, _DIt delta_end, _DIt frozen, _DIt frozen_end, _BIt base, _BIt base_end, _Function fn)
+{
+    Compare less;
+
+    for (;;) {
+        const K *key = NULL;
+
+        if (delta != delta_end)
+            key = &entry(delta).first;
+        if (frozen != frozen_end && (key == NULL || less(entry(frozen).first, *key)))
+            key = &entry(frozen).first;
+        if (base != base_end && (key == NULL || less(entry(base).first, *key)))
+            key = &entry(base).first;
+
+        if (key == NULL)
+            return;
+
+        bool in_delta  = delta  != delta_end  && ! less(*key, entry(delta).first);
+        bool in_frozen = frozen != frozen_end && ! less(*key, entry(frozen).first);
+        bool in_base   = base   != base_end   && ! less(*key, entry(base).first);
+
+        if (in_delta) {
+            if (! entry(delta).second.m_erased)
+                fn(*key, entry(delta).second.m_value);
+        } else if (in_frozen) {
+            if (! entry(frozen).second.m_erased)
+                fn(*key, entry(frozen).second.m_value);
+        } else {
+            fn(*key, entry(base).second);
+        }
+
+        if (in_delta)
+            ++delta;
+        if (in_frozen)
+            ++frozen;
+        if (in_base)
+            ++base;
+    }
+}
+
+template <typename K, typename T, class Compare, class Stats>
+std::shared_ptr<const typename lsm_radix_tree<K, T, Compare, Stats>::tree_type> lsm_radix_tree<K, T, Compare, Stats>::build(const tree_type &base, const delta_type &delta)
+{
+    // the tree goes before the arena holding its nodes
+    struct level_type {
+        radix_tree_arena m_arena;
+        tree_type m_tree;
+    };
+    typedef typename tree_type::mutation_type mutation_type;
+
+    std::shared_ptr<level_type> next = std::make_shared<level_type>();
+    std::vector<mutation_type> batch;
+
+    next->m_tree.set_memory_resource(&next->m_arena);
+    batch.reserve(merge_batch);
+
+    // the entries come in key order, so each batch carries on where the
+    // one before left off
+    merge(delta.begin(), delta.end(), delta.end(), delta.end(), base.begin(), base.end(),
+          [&next, &batch](const K &key, const T &value) {
+              mutation_type mut = { tree_type::mutation_insert, key, value };
+
+              batch.push_back(mut);
+              if (batch.size() == merge_batch) {
+                  next->m_tree.apply_batch(batch);
+                  batch.clear();
+              }
+          });
+    next->m_tree.apply_batch(batch);
+
+    return std::shared_ptr<const tree_type>(next, &next->m_tree);
+}
+
+// the value visible for key, with the lock held
+template <typename K, typename T, class Compare, class Stats>
+const T* lsm_radix_tree<K, T, Compare, Stats>::lookup(const K &key) const
+{
+    delta_it it = m_delta.find(key);
+
+    if (it != m_delta.end())
+        return it->second.m_erased ? NULL : &it->second.m_value;
+
+    return lookup_below(key);
+}
+
+// the same, leaving out the delta
+template <typename K, typename T, class Compare, class Stats>
+const T* lsm_radix_tree<K, T, Compare, Stats>::lookup_below(const K &key) const
+{
+    if (m_frozen) {
+        delta_it it = m_frozen->find(key);
+
+        if (it != m_frozen->end())
+            return it->second.m_erased ? NULL : &it->second.m_value;
+    }
+
+    base_it it = m_base->find(key);
+
+    return it == m_base->end() ? NULL : &it->second;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void lsm_radix_tree<K, T, Compare, Stats>::put(const K &key, const delta_value &value)
+{
+    std::pair<typename delta_type::iterator, bool> ret;
+    ret = m_delta.insert(typename delta_type::value_type(key, value));
+
+    if (! ret.second)
+        ret.first->second = value;
+}
+
+// holds a writer off while the delta is full and the one before it is
+// still being merged; if that merge failed, it is done again here
+template <typename K, typename T, class Compare, class Stats>
+void lsm_radix_tree<K, T, Compare, Stats>::make_room(write_lock &lock)
+{
+    if (m_delta.size() < m_limit || ! m_frozen)
+        return;
+
+    m_merged.wait(lock, [this] { return ! m_compacting; });
+
+    if (m_compactor.joinable())
+        m_compactor.join();
+
+    if (m_frozen) {
+        m_compacting = true;
+
+        std::exception_ptr error = merge_frozen(lock);
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+// freezes the delta and merges it in the background once it is full and
+// no other merge is in progress or has failed
+template <typename K, typename T, class Compare, class Stats>
+void lsm_radix_tree<K, T, Compare, Stats>::maybe_compact()
+{
+    if (m_delta.size() < m_limit || m_frozen)
+        return;
+
+    // the last merge has swapped its base in and is merely exiting
+    if (m_compactor.joinable())
+        m_compactor.join();
+
+    freeze();
+    m_compacting = true;
+
+    // the merge takes the lock once this writer lets go of it; without a
+    // thread the frozen delta waits for make_room() or compact()
+    try {
+        m_compactor = std::thread([this] {
+            write_lock lock(m_mutex);
+
+            merge_frozen(lock);
+        });
+    } catch (...) {
+        m_compacting = false;
+    }
+}
+
+// makes the delta the frozen one and starts a fresh delta, sized for the
+// base the merge will leave
+template <typename K, typename T, class Compare, class Stats>
+void lsm_radix_tree<K, T, Compare, Stats>::freeze()
+{
+    // an O(1) copy, sharing the nodes until the delta is cleared
+    m_frozen = std::make_shared<const delta_type>(m_delta);
+    m_delta.clear();
+
+    m_limit = std::max(m_threshold, (m_base->size() + m_frozen->size()) / base_ratio);
+}
+
+// merges the frozen delta into a new base, letting go of the lock while
+// it builds; m_compacting must be set, and keeps other merges out
+// meanwhile. A failed merge leaves the frozen delta in place and returns
+// its exception.
+template <typename K, typename T, class Compare, class Stats>
+std::exception_ptr lsm_radix_tree<K, T, Compare, Stats>::merge_frozen(write_lock &lock)
+{
+    std::shared_ptr<const tree_type> base = m_base, next;
+    std::shared_ptr<const delta_type> frozen = m_frozen;
+    std::exception_ptr error;
+
+    lock.unlock();
+
+    try {
+        next = build(*base, *frozen);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    lock.lock();
+
+    if (next) {
+        m_base = next;
+        m_frozen.reset();
+    }
+    m_compacting = false;
+    m_merged.notify_all();
+
+    return error;
+}
+
+// the write lock, once no background merge is running
+template <typename K, typename T, class Compare, class Stats>
+typename lsm_radix_tree<K, T, Compare, Stats>::write_lock lsm_radix_tree<K, T, Compare, Stats>::wait()
+{
+    write_lock lock(m_mutex);
+
+    // the merge has let go of the lock for good once it says it is done
+    m_merged.wait(lock, [this] { return ! m_compacting; });
+
+    if (m_compactor.joinable())
+        m_compactor.join();
+
+    return lock;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void lsm_radix_tree<K, T, Compare, Stats>::compact()
+{
+    write_lock lock = wait();
+
+    // no other merge starts while one is building, so each finds the
+    // levels as it left them
+    for (int pass = 0; pass < 2; pass++) {
+        if (! m_frozen) {
+            if (m_delta.empty())
+                break;
+            freeze();
+        }
+
+        m_compacting = true;
+
+        std::exception_ptr error = merge_frozen(lock);
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void lsm_radix_tree<K, T, Compare, Stats>::clear()
+{
+    write_lock lock = wait();
+
+    m_base = std::make_shared<tree_type>();
+    m_frozen.reset();
+    m_delta.clear();
+    m_size  = 0;
+    m_limit = m_threshold;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+typename lsm_radix_tree<K, T, Compare, Stats>::size_type lsm_radix_tree<K, T, Compare, Stats>::size() const
+{
+    read_lock lock(m_mutex);
+
+    return m_size;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+typename lsm_radix_tree<K, T, Compare, Stats>::size_type lsm_radix_tree<K, T, Compare, Stats>::base_size() const
+{
+    read_lock lock(m_mutex);
+
+    return m_base->size();
+}
+
+template <typename K, typename T, class Compare, class Stats>
+typename lsm_radix_tree<K, T, Compare, Stats>::size_type lsm_radix_tree<K, T, Compare, Stats>::delta_size() const
+{
+    read_lock lock(m_mutex);
+
+    return m_delta.size();
+}
+
+template <typename K, typename T, class Compare, class Stats>
+typename lsm_radix_tree<K, T, Compare, Stats>::size_type lsm_radix_tree<K, T, Compare, Stats>::delta_limit() const
+{
+    read_lock lock(m_mutex);
+
+    return m_limit;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool lsm_radix_tree<K, T, Compare, Stats>::compacting() const
+{
+    read_lock lock(m_mutex);
+
+    return m_compacting;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool lsm_radix_tree<K, T, Compare, Stats>::insert(const K &key, const T &value)
+{
+    write_lock lock(m_mutex);
+
+    if (lookup(key) != NULL)
+        return false;
+
+    make_room(lock);
+    put(key, delta_value(value, false));
+    m_size++;
+    maybe_compact();
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool lsm_radix_tree<K, T, Compare, Stats>::insert_or_assign(const K &key, const T &value)
+{
+    write_lock lock(m_mutex);
+
+    make_room(lock);
+
+    bool fresh = lookup(key) == NULL;
+
+    put(key, delta_value(value, false));
+    if (fresh)
+        m_size++;
+    maybe_compact();
+
+    return fresh;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool lsm_radix_tree<K, T, Compare, Stats>::erase(const K &key)
+{
+    write_lock lock(m_mutex);
+
+    if (lookup(key) == NULL)
+        return false;
+
+    make_room(lock);
+
+    // a tombstone only where a lower level would show the key again
+    if (lookup_below(key) != NULL)
+        put(key, delta_value(T(), true));
+    else
+        m_delta.erase(key);
+
+    m_size--;
+    maybe_compact();
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool lsm_radix_tree<K, T, Compare, Stats>::find(const K &key, T &value) const
+{
+    read_lock lock(m_mutex);
+
+    const T *found = lookup(key);
+
+    if (found == NULL)
+        return false;
+
+    value = *found;
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool lsm_radix_tree<K, T, Compare, Stats>::longest_match(const K &key, entry_type &entry) const
+{
+    std::vector<delta_it> delta, frozen;
+    std::vector<base_it> base;
+    bool found = false;
+
+    read_lock lock(m_mutex);
+
+    // every stored prefix of key, shortest first, of which the merge
+    // leaves the live ones
+    m_delta.all_prefixes_of(key, delta);
+    if (m_frozen)
+        m_frozen->all_prefixes_of(key, frozen);
+    m_base->all_prefixes_of(key, base);
+
+    merge(delta.begin(), delta.end(), frozen.begin(), frozen.end(), base.begin(), base.end(),
+          [&entry, &found](const K &k, const T &v) {
+              entry.first = k;
+              entry.second = v;
+              found = true;
+          });
+
+    return found;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void lsm_radix_tree<K, T, Compare, Stats>::prefix_match(const K &key, std::vector<entry_type> &vec) const
+{
+    std::vector<delta_it> delta, frozen;
+    std::vector<base_it> base;
+
+    vec.clear();
+
+    read_lock lock(m_mutex);
+
+    m_delta.prefix_match(key, delta);
+    if (m_frozen)
+        m_frozen->prefix_match(key, frozen);
+    m_base->prefix_match(key, base);
+
+    merge(delta.begin(), delta.end(), frozen.begin(), frozen.end(), base.begin(), base.end(),
+          [&vec](const K &k, const T &v) {
+              vec.push_back(entry_type(k, v));
+          });
+}
+
+template <typename K, typename T, class Compare, class Stats>
+template <class _Function>
+void lsm_radix_tree<K, T, Compare, Stats>::for_each(_Function fn) const
+{
+    read_lock lock(m_mutex);
+
+    delta_it none;
+    if (m_frozen)
+        none = m_frozen->end();
+
+    merge(m_delta.begin(), m_delta.end(),
+          m_frozen ? m_frozen->begin() : none, none,
+          m_base->begin(), m_base->end(),
+          [&fn](const K &k, const T &v) {
+              fn(typename tree_type::value_type(k, v));
+          });
+}
+
+#endif // RADIX_TREE_LSM_HPP
@@ -1,56 +1,370 @@
 #ifndef RADIX_TREE_NODE_HPP
 #define RADIX_TREE_NODE_HPP
 
-#include <map>
+#include <algorithm>
+#include <cstddef>
 #include <functional>
+#include <new>
+#include <utility>
 
+#if __cplusplus >= 201103L
+#include <atomic>
+typedef std::atomic<int> radix_tree_node_refcount;
+#else
+typedef int radix_tree_node_refcount;
+#endif
+
+template <typename K, typename T, typename Compare> class radix_tree_children;
+
+class radix_tree_memory_resource;
+
+// defined in radix_tree.hpp, next to radix_tree_memory_resource; res may
+// be NULL for the global heap
+inline void* radix_tree_allocate(radix_tree_memory_resource *res, std::size_t size);
+inline void radix_tree_deallocate(radix_tree_memory_resource *res, void *p, std::size_t size);
+
+// The children of a node, ordered by label under the tree's Compare,
+// which is passed in rather than kept per node. Siblings differ in their
+// first unit and are few, so a sorted array of pointers does: 16 bytes
+// per node and 9 per child, where a std::map took 48 and a tree node
+// holding a second copy of the label per child. Behind the pointers the
+// array keeps the first unit of each label, cut to a byte, so that a
+// lookup binary searches those bytes and loads no child but the one it
+// returns. That needs the bytes to ascend with Compare's order, as they
+// do under std::less for strings of char; for other orders, or units
+// wider than a byte, the bytes are scanned instead. The array comes from
+// the tree's memory resource, which is passed to every call that grows
+// or frees it; it must be clear()ed before the node is destroyed.
+// Iterators are shaped like those of the std::map it replaces: it->first
+// is the label and it->second the child.
 template <typename K, typename T, typename Compare>
-class radix_tree_node {
-    friend class radix_tree<K, T, Compare>;
-    friend class radix_tree_it<K, T, Compare>;
+class radix_tree_children {
+public:
+    typedef radix_tree_node<K, T, Compare> node_type;
 
-    typedef std::pair<const K, T> value_type;
-    typedef typename std::map<K, radix_tree_node<K, T, Compare>*, Compare >::iterator it_child;
+    struct entry_type {
+        const K &first;
+        node_type *second;
+
+        explicit entry_type(node_type *node) : first(node->m_key), second(node) { }
+        const entry_type* operator-> () const { return this; }
+    };
+
+    class iterator {
+    public:
+        iterator() : m_pos(NULL) { }
+        explicit iterator(node_type **pos) : m_pos(pos) { }
+
+        entry_type operator-> () const { return entry_type(*m_pos); }
+        iterator& operator++ () { ++m_pos; return *this; }
+        bool operator== (const iterator &rhs) const { return m_pos == rhs.m_pos; }
+        bool operator!= (const iterator &rhs) const { return m_pos != rhs.m_pos; }
+
+    private:
+        node_type **m_pos;
+    };
+
+    // points one past the entry it stands for, as std::reverse_iterator
+    class reverse_iterator {
+    public:
+        reverse_iterator() : m_pos(NULL) { }
+        explicit reverse_iterator(node_type **pos) : m_pos(pos) { }
+
+        entry_type operator-> () const { return entry_type(m_pos[-1]); }
+        reverse_iterator& operator++ () { --m_pos; return *this; }
+        bool operator== (const reverse_iterator &rhs) const { return m_pos == rhs.m_pos; }
+        bool operator!= (const reverse_iterator &rhs) const { return m_pos != rhs.m_pos; }
+
+    private:
+        node_type **m_pos;
+    };
+
+    radix_tree_children() : m_data(NULL), m_size(0), m_cap(0), m_ordered(1) { }
+
+    iterator begin() const { return iterator(m_data); }
+    iterator end() const { return iterator(m_data + m_size); }
+    reverse_iterator rbegin() const { return reverse_iterator(m_data + m_size); }
+    reverse_iterator rend() const { return reverse_iterator(m_data); }
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    // bytes of the array, capacity included
+    std::size_t bytes() const { return m_cap * slot_size; }
+    void clear(radix_tree_memory_resource *res);
+
+    // the child whose label starts with unit, or NULL
+    template <typename U> node_type* find_unit(const U &unit) const;
+    // the slot of child, found by its first unit and then its address
+    iterator find(const node_type *child) const;
+    // child must not share its first unit with a sibling
+    void insert(node_type *child, const Compare &pred, radix_tree_memory_resource *res);
+    void erase(const node_type *child, radix_tree_memory_resource *res);
+    // puts with in child's slot; with must have the same label
+    void replace(const node_type *child, node_type *with);
+    void swap(radix_tree_children &other);
+    // takes the same children as other, in the same slots; must be empty
+    void assign(const radix_tree_children &other, radix_tree_memory_resource *res);
+    // gives back the capacity beyond size(), returns the bytes freed
+    std::size_t shrink_to_fit(radix_tree_memory_resource *res);
 
 private:
-	radix_tree_node(Compare& pred) : m_children(std::map<K, radix_tree_node<K, T, Compare>*, Compare>(pred)), m_parent(NULL), m_value(NULL), m_depth(0), m_is_leaf(false), m_key(), m_pred(pred) { }
-    radix_tree_node(const value_type &val, Compare& pred);
-    radix_tree_node(const radix_tree_node&); // delete
-    radix_tree_node& operator=(const radix_tree_node&); // delete
+    node_type **m_data;     // m_cap pointers, then m_cap label bytes
+    unsigned m_size;
+    unsigned m_cap : 31;
+    unsigned m_ordered : 1; // the label bytes ascend with the slots
 
-    ~radix_tree_node();
+    static const std::size_t slot_size = sizeof(node_type*) + 1;
 
-    std::map<K, radix_tree_node<K, T, Compare>*, Compare> m_children;
-    radix_tree_node<K, T, Compare> *m_parent;
-    value_type *m_value;
-    int m_depth;
-    bool m_is_leaf;
-    K m_key;
-	Compare& m_pred;
+    unsigned char* units() const {
+        return reinterpret_cast<unsigned char*>(m_data + m_cap);
+    }
+    static unsigned char unit_of(const node_type *child) {
+        return static_cast<unsigned char>(child->m_key[0]);
+    }
+    // first slot whose label byte is not below unit
+    unsigned lower_bound(unsigned char unit) const;
+    // the index of child, or m_size
+    unsigned slot_of(const node_type *child) const;
+    void reserve(unsigned cap, radix_tree_memory_resource *res);
+
+    radix_tree_children(const radix_tree_children&); // delete
+    radix_tree_children& operator=(const radix_tree_children&); // delete
 };
 
 template <typename K, typename T, typename Compare>
-radix_tree_node<K, T, Compare>::radix_tree_node(const value_type &val, Compare& pred) :
-    m_children(std::map<K, radix_tree_node<K, T, Compare>*, Compare>(pred)),
-    m_parent(NULL),
-    m_value(NULL),
-    m_depth(0),
-    m_is_leaf(false),
-    m_key(), 
-	m_pred(pred)
+void radix_tree_children<K, T, Compare>::clear(radix_tree_memory_resource *res)
 {
-    m_value = new value_type(val);
+    radix_tree_deallocate(res, m_data, m_cap * slot_size);
+
+    m_data    = NULL;
+    m_size    = 0;
+    m_cap     = 0;
+    m_ordered = 1;
 }
 
 template <typename K, typename T, typename Compare>
-radix_tree_node<K, T, Compare>::~radix_tree_node()
+unsigned radix_tree_children<K, T, Compare>::lower_bound(unsigned char unit) const
 {
-    it_child it;
-    for (it = m_children.begin(); it != m_children.end(); ++it) {
-        delete it->second;
+    const unsigned char *bytes = units();
+    unsigned lo = 0, hi = m_size;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+
+        if (bytes[mid] < unit)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    delete m_value;
+
+    return lo;
 }
 
+template <typename K, typename T, typename Compare>
+template <typename U>
+typename radix_tree_children<K, T, Compare>::node_type* radix_tree_children<K, T, Compare>::find_unit(const U &unit) const
+{
+    const unsigned char *bytes = units();
+    unsigned char byte = static_cast<unsigned char>(unit);
+
+    for (unsigned i = m_ordered ? lower_bound(byte) : 0; i < m_size; i++) {
+        if (bytes[i] != byte) {
+            if (m_ordered)
+                break;
+            continue;
+        }
+
+        // a unit of one byte is its own label byte
+        if (sizeof(U) == 1 || m_data[i]->m_key[0] == unit)
+            return m_data[i];
+    }
+
+    return NULL;
+}
+
+template <typename K, typename T, typename Compare>
+unsigned radix_tree_children<K, T, Compare>::slot_of(const node_type *child) const
+{
+    if (! m_ordered) {
+        for (unsigned i = 0; i < m_size; i++) {
+            if (m_data[i] == child)
+                return i;
+        }
+        return m_size;
+    }
+
+    const unsigned char *bytes = units();
+    unsigned char byte = unit_of(child);
+
+    for (unsigned i = lower_bound(byte); i < m_size && bytes[i] == byte; i++) {
+        if (m_data[i] == child)
+            return i;
+    }
+
+    return m_size;
+}
+
+template <typename K, typename T, typename Compare>
+typename radix_tree_children<K, T, Compare>::iterator radix_tree_children<K, T, Compare>::find(const node_type *child) const
+{
+    return iterator(m_data + slot_of(child));
+}
+
+template <typename K, typename T, typename Compare>
+void radix_tree_children<K, T, Compare>::reserve(unsigned cap, radix_tree_memory_resource *res)
+{
+    node_type **data = static_cast<node_type**>(radix_tree_allocate(res, cap * slot_size));
+    unsigned char *bytes = reinterpret_cast<unsigned char*>(data + cap);
+
+    for (unsigned i = 0; i < m_size; i++) {
+        data[i]  = m_data[i];
+        bytes[i] = units()[i];
+    }
+
+    radix_tree_deallocate(res, m_data, m_cap * slot_size);
+    m_data = data;
+    m_cap  = cap;
+}
+
+template <typename K, typename T, typename Compare>
+void radix_tree_children<K, T, Compare>::insert(node_type *child, const Compare &pred, radix_tree_memory_resource *res)
+{
+    if (m_size == m_cap)
+        reserve(m_cap == 0 ? 2 : m_cap * 2, res);
+
+    unsigned lo = 0, hi = m_size;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+
+        if (pred(m_data[mid]->m_key, child->m_key))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    unsigned char *bytes = units();
+    unsigned char byte = unit_of(child);
+
+    if ((lo > 0 && bytes[lo - 1] > byte) || (lo < m_size && bytes[lo] < byte))
+        m_ordered = 0;
+
+    for (unsigned i = m_size; i > lo; i--) {
+        m_data[i] = m_data[i - 1];
+        bytes[i]  = bytes[i - 1];
+    }
+
+    m_data[lo] = child;
+    bytes[lo]  = byte;
+    m_size++;
+}
+
+template <typename K, typename T, typename Compare>
+void radix_tree_children<K, T, Compare>::erase(const node_type *child, radix_tree_memory_resource *res)
+{
+    unsigned i = slot_of(child);
+
+    if (i == m_size)
+        return;
+
+    unsigned char *bytes = units();
+
+    for (m_size--; i < m_size; i++) {
+        m_data[i] = m_data[i + 1];
+        bytes[i]  = bytes[i + 1];
+    }
+
+    if (m_size == 0)
+        clear(res);
+}
+
+template <typename K, typename T, typename Compare>
+void radix_tree_children<K, T, Compare>::replace(const node_type *child, node_type *with)
+{
+    unsigned i = slot_of(child);
+
+    if (i != m_size)
+        m_data[i] = with;
+}
+
+template <typename K, typename T, typename Compare>
+void radix_tree_children<K, T, Compare>::swap(radix_tree_children &other)
+{
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+
+    unsigned cap = m_cap, ordered = m_ordered;
+
+    m_cap           = other.m_cap;
+    m_ordered       = other.m_ordered;
+    other.m_cap     = cap;
+    other.m_ordered = ordered;
+}
+
+template <typename K, typename T, typename Compare>
+void radix_tree_children<K, T, Compare>::assign(const radix_tree_children &other, radix_tree_memory_resource *res)
+{
+    if (other.m_size == 0)
+        return;
+
+    reserve(other.m_size, res);
+
+    for (unsigned i = 0; i < other.m_size; i++) {
+        m_data[i]  = other.m_data[i];
+        units()[i] = other.units()[i];
+    }
+
+    m_size    = other.m_size;
+    m_ordered = other.m_ordered;
+}
+
+template <typename K, typename T, typename Compare>
+std::size_t radix_tree_children<K, T, Compare>::shrink_to_fit(radix_tree_memory_resource *res)
+{
+    if (m_size == m_cap)
+        return 0;
+
+    std::size_t freed = (m_cap - m_size) * slot_size;
+
+    if (m_size == 0)
+        clear(res);
+    else
+        reserve(m_size, res);
+
+    return freed;
+}
+
+template <typename K, typename T, typename Compare>
+class radix_tree_node {
+    template <typename, typename, typename, typename> friend class radix_tree;
+    template <typename, typename, typename, typename> friend struct radix_tree_parallel;
+    friend class radix_tree_it<K, T, Compare>;
+    friend class radix_tree_const_it<K, T, Compare>;
+    friend class radix_tree_children<K, T, Compare>;
+
+    typedef std::pair<const K, T> value_type;
+    typedef typename radix_tree_children<K, T, Compare>::iterator it_child;
+    typedef typename radix_tree_children<K, T, Compare>::reverse_iterator rit_child;
+
+private:
+    radix_tree_node() : m_parent(NULL), m_value(NULL), m_depth(0), m_refs(1), m_key() { }
+    radix_tree_node(const radix_tree_node&); // delete
+    radix_tree_node& operator=(const radix_tree_node&); // delete
+
+    // m_value and the children are freed by radix_tree, which knows where
+    // they were allocated; destroy() tears subtrees down with an explicit
+    // worklist and only ever deletes nodes no parent or tree holds
+    ~radix_tree_node() { }
+
+    radix_tree_children<K, T, Compare> m_children;
+    // A node held by several parents, once trees share nodes, keeps the
+    // one it was linked under; see radix_tree's copy constructor for when
+    // that is the parent in a given tree.
+    radix_tree_node<K, T, Compare> *m_parent;
+    value_type *m_value; // entry whose key ends at this node, or NULL
+    int m_depth;
+    radix_tree_node_refcount m_refs; // parents and trees holding the node
+    K m_key;
+};
 
 #endif // RADIX_TREE_NODE_HPP
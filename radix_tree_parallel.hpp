@@ -0,0 +1,335 @@
+#ifndef RADIX_TREE_PARALLEL_HPP
+#define RADIX_TREE_PARALLEL_HPP
+
+// parallel_for_each and parallel_reduce walk a radix_tree, or the entries
+// under a prefix, on the threads of a radix_tree_pool. Requires C++11.
+//
+//     radix_tree_pool pool;
+//     long total = parallel_reduce(pool, tree, 0L,
+//         [](const value_type &v) { return long(v.second); },
+//         [](long a, long b) { return a + b; });
+//
+// A walk starts as a single task for the subtree and is cut up as it
+// goes: a worker walks its subtree with an explicit stack, and whenever
+// another worker is out of work it hands the shallowest subtree left on
+// that stack to its own deque, from which idle workers steal. Large
+// subtrees are thus shared out without counting entries first.
+//
+// The tree is read through a const reference and must not be written
+// during the walk; walking a snapshot() lets writers carry on. fn and map
+// are called from several threads at once and in no particular order.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "radix_tree.hpp"
+
+class radix_tree_pool {
+public:
+    // gets the index of the worker running it, below size()
+    typedef std::function<void(unsigned)> task_type;
+
+    // threads == 0 starts one worker per hardware thread
+    explicit radix_tree_pool(unsigned threads = 0);
+    ~radix_tree_pool();
+
+    unsigned size() const {
+        return static_cast<unsigned>(m_threads.size());
+    }
+
+    // runs tasks, and everything they push, and returns once all of it
+    // is done; the first exception thrown by a task is rethrown here
+    void run(std::vector<task_type> &tasks);
+
+    // queues more work on worker's own deque, from a task running on it
+    void push(unsigned worker, task_type task);
+    // true while a worker waits for work that is not queued yet
+    bool hungry() const {
+        return m_idle.load(std::memory_order_relaxed) > m_queued.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<std::thread> m_threads;
+    std::vector<std::deque<task_type> > m_queues;
+
+    std::mutex m_run_mutex; // one run() at a time
+    std::mutex m_mutex;     // guards everything below
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::atomic<unsigned> m_idle;
+    std::atomic<unsigned> m_queued;
+    unsigned long m_pending; // tasks queued or running
+    std::exception_ptr m_error;
+    bool m_stop;
+
+    void work(unsigned worker);
+    bool take(unsigned worker, task_type &task);
+
+    radix_tree_pool(const radix_tree_pool&) = delete;
+    radix_tree_pool& operator=(const radix_tree_pool&) = delete;
+};
+
+inline radix_tree_pool::radix_tree_pool(unsigned threads) :
+    m_idle(0), m_queued(0), m_pending(0), m_stop(false)
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 1;
+
+    m_queues.resize(threads);
+
+    for (unsigned i = 0; i < threads; i++)
+        m_threads.push_back(std::thread(&radix_tree_pool::work, this, i));
+}
+
+inline radix_tree_pool::~radix_tree_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); i++)
+        m_threads[i].join();
+}
+
+inline void radix_tree_pool::run(std::vector<task_type> &tasks)
+{
+    std::lock_guard<std::mutex> run_lock(m_run_mutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (size_t i = 0; i < tasks.size(); i++)
+        m_queues[i % m_queues.size()].push_back(tasks[i]);
+
+    m_pending += tasks.size();
+    m_queued  += static_cast<unsigned>(tasks.size());
+    m_wake.notify_all();
+
+    m_done.wait(lock, [this] { return m_pending == 0; });
+
+    std::exception_ptr error = m_error;
+    m_error = nullptr;
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+inline void radix_tree_pool::push(unsigned worker, task_type task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_queues[worker].push_back(std::move(task));
+        m_pending++;
+        m_queued++;
+    }
+    m_wake.notify_one();
+}
+
+// the newest task of the worker's own deque, or else the oldest one of
+// another worker's, which is the largest piece it has handed out
+inline bool radix_tree_pool::take(unsigned worker, task_type &task)
+{
+    for (size_t i = 0; i < m_queues.size(); i++) {
+        std::deque<task_type> &queue = m_queues[(worker + i) % m_queues.size()];
+
+        if (queue.empty())
+            continue;
+
+        if (i == 0) {
+            task = std::move(queue.back());
+            queue.pop_back();
+        } else {
+            task = std::move(queue.front());
+            queue.pop_front();
+        }
+        m_queued--;
+
+        return true;
+    }
+
+    return false;
+}
+
+inline void radix_tree_pool::work(unsigned worker)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        task_type task;
+
+        if (take(worker, task)) {
+            lock.unlock();
+
+            std::exception_ptr error;
+            try {
+                task(worker);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+
+            if (error && ! m_error)
+                m_error = error;
+            if (--m_pending == 0)
+                m_done.notify_all();
+
+            continue;
+        }
+
+        if (m_stop)
+            return;
+
+        m_idle++;
+        m_wake.wait(lock);
+        m_idle--;
+    }
+}
+
+template <typename K, typename T, typename Compare, typename Stats>
+struct radix_tree_parallel {
+    typedef radix_tree<K, T, Compare, Stats> tree_type;
+    typedef radix_tree_node<K, T, Compare> node_type;
+    typedef typename tree_type::value_type value_type;
+
+    static node_type* root(const tree_type &tree) {
+        return tree.m_size == 0 ? NULL : tree.m_root;
+    }
+    static node_type* subtree(const tree_type &tree, const K &prefix) {
+        return tree.m_size == 0 ? NULL : tree.find_prefix_node(prefix);
+    }
+
+    // visit(worker, value) for every entry under node
+    template <class _Visitor>
+    static void walk(radix_tree_pool &pool, node_type *node, _Visitor &visit, unsigned worker) {
+        std::vector<node_type*> stack(1, node);
+
+        while (! stack.empty()) {
+            if (stack.size() > 1 && pool.hungry()) {
+                node_type *shared = stack.front();
+                stack.erase(stack.begin());
+
+                pool.push(worker, [&pool, shared, &visit](unsigned w) {
+                    walk(pool, shared, visit, w);
+                });
+                continue;
+            }
+
+            node = stack.back();
+            stack.pop_back();
+
+            if (node->m_value != NULL)
+                visit(worker, static_cast<const value_type&>(*node->m_value));
+
+            typename node_type::rit_child it;
+            for (it = node->m_children.rbegin(); it != node->m_children.rend(); ++it)
+                stack.push_back(it->second);
+        }
+    }
+
+    template <class _Visitor>
+    static void run(radix_tree_pool &pool, node_type *node, _Visitor &visit) {
+        if (node == NULL)
+            return;
+
+        std::vector<radix_tree_pool::task_type> tasks;
+        tasks.push_back([&pool, node, &visit](unsigned w) {
+            walk(pool, node, visit, w);
+        });
+
+        pool.run(tasks);
+    }
+
+    template <class _Function>
+    static void for_each(radix_tree_pool &pool, node_type *node, _Function &fn) {
+        auto visit = [&fn](unsigned, const value_type &val) {
+            fn(val);
+        };
+
+        run(pool, node, visit);
+    }
+
+    template <class R, class _Map, class _Combine>
+    static R reduce(radix_tree_pool &pool, node_type *node, R init, _Map &map, _Combine &combine) {
+        // one partial result per worker, padded so that workers do not
+        // write to the same cache line
+        struct partial_type {
+            bool m_set;
+            R m_value;
+            char m_pad[64];
+
+            partial_type(const R &value) : m_set(false), m_value(value) { }
+        };
+
+        std::vector<partial_type> partial(pool.size(), partial_type(init));
+
+        auto visit = [&partial, &map, &combine](unsigned worker, const value_type &val) {
+            partial_type &p = partial[worker];
+
+            if (p.m_set) {
+                p.m_value = combine(p.m_value, map(val));
+            } else {
+                p.m_value = map(val);
+                p.m_set = true;
+            }
+        };
+
+        run(pool, node, visit);
+
+        for (size_t i = 0; i < partial.size(); i++) {
+            if (partial[i].m_set)
+                init = combine(init, partial[i].m_value);
+        }
+
+        return init;
+    }
+};
+
+// calls fn(const value_type &) for every entry
+template <typename K, typename T, typename Compare, typename Stats, class _Function>
+void parallel_for_each(radix_tree_pool &pool, const radix_tree<K, T, Compare, Stats> &tree, _Function fn)
+{
+    typedef radix_tree_parallel<K, T, Compare, Stats> parallel;
+
+    parallel::for_each(pool, parallel::root(tree), fn);
+}
+
+// calls fn(const value_type &) for every entry whose key starts with prefix
+template <typename K, typename T, typename Compare, typename Stats, class _Function>
+void parallel_for_each(radix_tree_pool &pool, const radix_tree<K, T, Compare, Stats> &tree, const typename radix_tree<K, T, Compare, Stats>::key_type &prefix, _Function fn)
+{
+    typedef radix_tree_parallel<K, T, Compare, Stats> parallel;
+
+    parallel::for_each(pool, parallel::subtree(tree, prefix), fn);
+}
+
+// folds map(const value_type &) of every entry into init with combine,
+// which must be associative and commutative, as the entries are taken
+// in no particular order
+template <typename K, typename T, typename Compare, typename Stats, class R, class _Map, class _Combine>
+R parallel_reduce(radix_tree_pool &pool, const radix_tree<K, T, Compare, Stats> &tree, R init, _Map map, _Combine combine)
+{
+    typedef radix_tree_parallel<K, T, Compare, Stats> parallel;
+
+    return parallel::reduce(pool, parallel::root(tree), init, map, combine);
+}
+
+// the same over the entries whose key starts with prefix
+template <typename K, typename T, typename Compare, typename Stats, class R, class _Map, class _Combine>
+R parallel_reduce(radix_tree_pool &pool, const radix_tree<K, T, Compare, Stats> &tree, const typename radix_tree<K, T, Compare, Stats>::key_type &prefix, R init, _Map map, _Combine combine)
+{
+    typedef radix_tree_parallel<K, T, Compare, Stats> parallel;
+
+    return parallel::reduce(pool, parallel::subtree(tree, prefix), init, map, combine);
+}
+
+#endif // RADIX_TREE_PARALLEL_HPP
@@ -0,0 +1,164 @@
+#ifndef RADIX_TREE_REVERSE_HPP
+#define RADIX_TREE_REVERSE_HPP
+
+// radix_reverse_key<S> presents a string to radix_tree from its last unit
+// to its first, so that a tree keyed by it is a suffix index: longest_match
+// finds the longest stored suffix of a key and prefix_match every stored
+// key ending with a given suffix.
+//
+//     radix_tree<radix_reverse_key<>, int> zones;
+//     zones[radix_reverse_key<>(".example.com")] = 1;
+//     longest_suffix_match(zones, host);
+//
+// A key reverses nothing: it reads its string from the back. Keys built
+// from a string own a copy of it. A key built with radix_borrow borrows
+// its string instead, so that a lookup does not copy it; such a key must
+// not outlive the string, and is meant for the lookups below only. The
+// tree copies every key it keeps, and copies always own their data.
+
+#include <string>
+#include <vector>
+
+#include "radix_tree.hpp"
+
+// tag for the borrowing constructor of radix_reverse_key
+struct radix_borrow_t { };
+static const radix_borrow_t radix_borrow = radix_borrow_t();
+
+template <typename S = std::string>
+class radix_reverse_key {
+public:
+    typedef typename S::value_type unit_type;
+
+    radix_reverse_key() : m_ref(NULL) { }
+    explicit radix_reverse_key(const S &str) : m_own(str), m_ref(NULL) { }
+    explicit radix_reverse_key(const unit_type *str) : m_own(str), m_ref(NULL) { }
+    // borrows str, which must outlive the key
+    radix_reverse_key(const S &str, radix_borrow_t) : m_ref(&str) { }
+    radix_reverse_key(const radix_reverse_key &other) : m_own(other.str()), m_ref(NULL) { }
+
+    radix_reverse_key& operator =(const radix_reverse_key &other) {
+        if (this != &other) {
+            S tmp(other.str());
+            m_own.swap(tmp);
+            m_ref = NULL;
+        }
+        return *this;
+    }
+
+    // takes a private copy of str
+    void assign(const S &str) {
+        m_own = str;
+        m_ref = NULL;
+    }
+
+    // the key in its original order
+    const S& str() const {
+        return m_ref != NULL ? *m_ref : m_own;
+    }
+    int size() const {
+        return static_cast<int>(str().size());
+    }
+
+    // i-th unit from the end
+    unit_type operator[] (int i) const {
+        const S &s = str();
+        return s[s.size() - 1 - i];
+    }
+
+    bool operator ==(const radix_reverse_key &rhs) const {
+        return str() == rhs.str();
+    }
+    bool operator !=(const radix_reverse_key &rhs) const {
+        return ! (*this == rhs);
+    }
+    // lexicographic on the reversed units
+    bool operator <(const radix_reverse_key &rhs) const {
+        const S &l = str(), &r = rhs.str();
+        typename S::const_reverse_iterator li = l.rbegin(), ri = r.rbegin();
+
+        for (; li != l.rend() && ri != r.rend(); ++li, ++ri) {
+            if (*li != *ri)
+                return S::traits_type::lt(*li, *ri);
+        }
+
+        return li == l.rend() && ri != r.rend();
+    }
+
+private:
+    S m_own;
+    const S *m_ref;
+};
+
+template <typename S>
+radix_reverse_key<S> radix_substr(const radix_reverse_key<S> &key, int begin, int num)
+{
+    const S &s = key.str();
+    int len = static_cast<int>(s.size());
+
+    if (begin > len)
+        begin = len;
+    if (num > len - begin)
+        num = len - begin;
+
+    radix_reverse_key<S> sub;
+    sub.assign(s.substr(len - begin - num, num));
+
+    return sub;
+}
+
+template <typename S>
+radix_reverse_key<S> radix_join(const radix_reverse_key<S> &key1, const radix_reverse_key<S> &key2)
+{
+    S joined(key2.str());
+    joined += key1.str();
+
+    radix_reverse_key<S> key;
+    key.assign(joined);
+
+    return key;
+}
+
+template <typename S>
+int radix_length(const radix_reverse_key<S> &key)
+{
+    return key.size();
+}
+
+template <typename S>
+std::size_t radix_key_bytes(const radix_reverse_key<S> &key)
+{
+    return radix_key_bytes(key.str());
+}
+
+// the stored key that is the longest suffix of key
+template <typename S, typename T, class Compare, class Stats>
+typename radix_tree<radix_reverse_key<S>, T, Compare, Stats>::iterator
+longest_suffix_match(radix_tree<radix_reverse_key<S>, T, Compare, Stats> &tree, const S &key)
+{
+    return tree.longest_match(radix_reverse_key<S>(key, radix_borrow));
+}
+
+template <typename S, typename T, class Compare, class Stats>
+typename radix_tree<radix_reverse_key<S>, T, Compare, Stats>::const_iterator
+longest_suffix_match(const radix_tree<radix_reverse_key<S>, T, Compare, Stats> &tree, const S &key)
+{
+    return tree.longest_match(radix_reverse_key<S>(key, radix_borrow));
+}
+
+// every stored key ending with suffix
+template <typename S, typename T, class Compare, class Stats>
+void suffix_match(radix_tree<radix_reverse_key<S>, T, Compare, Stats> &tree, const S &suffix,
+                  std::vector<typename radix_tree<radix_reverse_key<S>, T, Compare, Stats>::iterator> &vec)
+{
+    tree.prefix_match(radix_reverse_key<S>(suffix, radix_borrow), vec);
+}
+
+template <typename S, typename T, class Compare, class Stats>
+void suffix_match(const radix_tree<radix_reverse_key<S>, T, Compare, Stats> &tree, const S &suffix,
+                  std::vector<typename radix_tree<radix_reverse_key<S>, T, Compare, Stats>::const_iterator> &vec)
+{
+    tree.prefix_match(radix_reverse_key<S>(suffix, radix_borrow), vec);
+}
+
+#endif // RADIX_TREE_REVERSE_HPP
@@ -0,0 +1,278 @@
+#ifndef RADIX_TREE_SHARDED_HPP
+#define RADIX_TREE_SHARDED_HPP
+
+// sharded_radix_tree splits the key space on the first key unit into
+// independently locked radix_tree shards, so that writers to different
+// parts of the key space do not contend. Requires C++11.
+//
+// Keys are routed by radix_tree_sharder<K>, which must map the first unit
+// monotonically onto the shards: every key and all of its prefixes but
+// the empty one then live in the same shard, and walking the shards in
+// order walks the keys in order.
+
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <shared_mutex>
+#endif
+
+#include "radix_tree.hpp"
+
+template <typename K>
+struct radix_tree_sharder;
+
+template <>
+struct radix_tree_sharder<std::string> {
+    std::size_t operator() (const std::string &key, std::size_t shards) const {
+        if (key.empty())
+            return 0;
+
+        return static_cast<unsigned char>(key[0]) * shards / 256;
+    }
+};
+
+template <typename K, typename T, class Compare = std::less<K>, class Stats = radix_tree_null_stats, class Sharder = radix_tree_sharder<K> >
+class sharded_radix_tree {
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<K, T> entry_type;
+    typedef radix_tree<K, T, Compare, Stats> tree_type;
+    typedef std::size_t size_type;
+
+    explicit sharded_radix_tree(size_type shards = 16, Sharder sharder = Sharder()) :
+        m_shards(shards == 0 ? 1 : shards), m_sharder(sharder) { }
+
+    size_type shard_count() const {
+        return m_shards.size();
+    }
+    size_type shard_of(const K &key) const {
+        return m_sharder(key, m_shards.size());
+    }
+
+    size_type size() const;
+    bool empty() const {
+        return size() == 0;
+    }
+    void clear();
+
+    // true if the key was not present; an existing value is kept
+    bool insert(const K &key, const T &value);
+    // true if the key was not present; an existing value is overwritten
+    bool insert_or_assign(const K &key, const T &value);
+    bool erase(const K &key);
+    size_type erase_prefix(const K &key);
+
+    // lookups copy the result out, as no reference may outlive the lock
+    bool find(const K &key, T &value) const;
+    bool longest_match(const K &key, entry_type &entry) const;
+    void prefix_match(const K &key, std::vector<entry_type> &vec) const;
+
+    // visits every entry in key order, one shard at a time; each shard is
+    // consistent, but writers may run between shards
+    template<class _Function> void for_each(_Function fn) const;
+
+    // O(1) copy-on-write snapshot of every shard
+    void snapshot(std::vector<tree_type> &trees) const;
+
+private:
+#if __cplusplus >= 201703L
+    typedef std::shared_mutex mutex_type;
+    typedef std::shared_lock<std::shared_mutex> read_lock;
+#else
+    typedef std::mutex mutex_type;
+    typedef std::unique_lock<std::mutex> read_lock;
+#endif
+    typedef std::unique_lock<mutex_type> write_lock;
+
+    struct shard_type {
+        mutable mutex_type m_mutex;
+        tree_type m_tree;
+    };
+
+    std::vector<shard_type> m_shards;
+    Sharder m_sharder;
+
+    sharded_radix_tree(const sharded_radix_tree &other); // delete
+    sharded_radix_tree& operator =(const sharded_radix_tree &other); // delete
+};
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+typename sharded_radix_tree<K, T, Compare, Stats, Sharder>::size_type sharded_radix_tree<K, T, Compare, Stats, Sharder>::size() const
+{
+    size_type size = 0;
+
+    for (size_type i = 0; i < m_shards.size(); i++) {
+        read_lock lock(m_shards[i].m_mutex);
+        size += m_shards[i].m_tree.size();
+    }
+
+    return size;
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+void sharded_radix_tree<K, T, Compare, Stats, Sharder>::clear()
+{
+    for (size_type i = 0; i < m_shards.size(); i++) {
+        write_lock lock(m_shards[i].m_mutex);
+        m_shards[i].m_tree.clear();
+    }
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+bool sharded_radix_tree<K, T, Compare, Stats, Sharder>::insert(const K &key, const T &value)
+{
+    shard_type &shard = m_shards[shard_of(key)];
+    write_lock lock(shard.m_mutex);
+
+    return shard.m_tree.insert(typename tree_type::value_type(key, value)).second;
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+bool sharded_radix_tree<K, T, Compare, Stats, Sharder>::insert_or_assign(const K &key, const T &value)
+{
+    shard_type &shard = m_shards[shard_of(key)];
+    write_lock lock(shard.m_mutex);
+
+    std::pair<typename tree_type::iterator, bool> ret;
+    ret = shard.m_tree.insert(typename tree_type::value_type(key, value));
+
+    if (! ret.second)
+        ret.first->second = value;
+
+    return ret.second;
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+bool sharded_radix_tree<K, T, Compare, Stats, Sharder>::erase(const K &key)
+{
+    shard_type &shard = m_shards[shard_of(key)];
+    write_lock lock(shard.m_mutex);
+
+    return shard.m_tree.erase(key);
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+typename sharded_radix_tree<K, T, Compare, Stats, Sharder>::size_type sharded_radix_tree<K, T, Compare, Stats, Sharder>::erase_prefix(const K &key)
+{
+    if (radix_length(key) != 0) {
+        shard_type &shard = m_shards[shard_of(key)];
+        write_lock lock(shard.m_mutex);
+
+        return shard.m_tree.erase_prefix(key);
+    }
+
+    size_type count = 0;
+
+    for (size_type i = 0; i < m_shards.size(); i++) {
+        write_lock lock(m_shards[i].m_mutex);
+        count += m_shards[i].m_tree.erase_prefix(key);
+    }
+
+    return count;
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+bool sharded_radix_tree<K, T, Compare, Stats, Sharder>::find(const K &key, T &value) const
+{
+    const shard_type &shard = m_shards[shard_of(key)];
+    read_lock lock(shard.m_mutex);
+
+    typename tree_type::const_iterator it = shard.m_tree.find(key);
+
+    if (it == shard.m_tree.end())
+        return false;
+
+    value = it->second;
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+bool sharded_radix_tree<K, T, Compare, Stats, Sharder>::longest_match(const K &key, entry_type &entry) const
+{
+    size_type index = shard_of(key);
+
+    {
+        const shard_type &shard = m_shards[index];
+        read_lock lock(shard.m_mutex);
+
+        typename tree_type::const_iterator it = shard.m_tree.longest_match(key);
+
+        if (it != shard.m_tree.end()) {
+            entry = entry_type(it->first, it->second);
+            return true;
+        }
+    }
+
+    // the empty key is a prefix of every key but lives in the first shard
+    K nul = radix_substr(key, 0, 0);
+    size_type nul_index = shard_of(nul);
+
+    if (nul_index == index)
+        return false;
+
+    const shard_type &shard = m_shards[nul_index];
+    read_lock lock(shard.m_mutex);
+
+    typename tree_type::const_iterator it = shard.m_tree.find(nul);
+
+    if (it == shard.m_tree.end())
+        return false;
+
+    entry = entry_type(it->first, it->second);
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+void sharded_radix_tree<K, T, Compare, Stats, Sharder>::prefix_match(const K &key, std::vector<entry_type> &vec) const
+{
+    std::vector<typename tree_type::const_iterator> found;
+
+    vec.clear();
+
+    for (size_type i = 0; i < m_shards.size(); i++) {
+        if (radix_length(key) != 0 && i != shard_of(key))
+            continue;
+
+        read_lock lock(m_shards[i].m_mutex);
+
+        m_shards[i].m_tree.prefix_match(key, found);
+
+        for (size_type j = 0; j < found.size(); j++)
+            vec.push_back(entry_type(found[j]->first, found[j]->second));
+    }
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+template <class _Function>
+void sharded_radix_tree<K, T, Compare, Stats, Sharder>::for_each(_Function fn) const
+{
+    for (size_type i = 0; i < m_shards.size(); i++) {
+        read_lock lock(m_shards[i].m_mutex);
+
+        const tree_type &tree = m_shards[i].m_tree;
+        typename tree_type::const_iterator it;
+
+        for (it = tree.begin(); it != tree.end(); ++it)
+            fn(*it);
+    }
+}
+
+template <typename K, typename T, class Compare, class Stats, class Sharder>
+void sharded_radix_tree<K, T, Compare, Stats, Sharder>::snapshot(std::vector<tree_type> &trees) const
+{
+    trees.clear();
+    trees.reserve(m_shards.size());
+
+    for (size_type i = 0; i < m_shards.size(); i++) {
+        read_lock lock(m_shards[i].m_mutex);
+        trees.push_back(m_shards[i].m_tree.snapshot());
+    }
+}
+
+#endif // RADIX_TREE_SHARDED_HPP
@@ -0,0 +1,791 @@
+#ifndef RADIX_TREE_SHM_HPP
+#define RADIX_TREE_SHM_HPP
+
+// shm_radix_tree keeps a radix tree from std::string keys to trivially
+// copyable values in a named POSIX shared-memory segment, so that any
+// number of processes can map and query the same physical copy. Requires
+// C++11 and POSIX; link with -lrt on glibc older than 2.34.
+//
+//     shm_radix_tree<int> table("/routes");
+//     table.create(1 << 30);          // writer
+//     table.insert("10.0.0.0/8", 1);
+//
+//     shm_radix_tree<int> table("/routes");
+//     table.open();                   // reader, in another process
+//     table.find("10.0.0.0/8", val);
+//
+// Nodes refer to each other by their offset in the segment, so every
+// process may map it at a different address. The segment has a fixed
+// capacity, set by create(); nodes are carved out of it with one free
+// list per block size, and an update that might not fit throws
+// std::bad_alloc and leaves the tree as it was.
+//
+// Updates happen in place under a sequence lock in the segment header:
+// a writer makes the sequence number odd for the duration of the update,
+// which also keeps other writers out, and readers retry a lookup whenever
+// the number changed while they ran. Readers never block writers and take
+// no lock themselves. They check every offset they follow against the
+// segment, so a lookup that raced with an update is merely retried. A
+// writer that dies in the middle of an update leaves the sequence number
+// odd, and readers then wait forever.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template <typename T>
+class shm_radix_tree {
+    static_assert(std::is_trivially_copyable<T>::value, "shm_radix_tree stores values by their bytes");
+    static_assert(alignof(T) <= 16, "shm_radix_tree aligns blocks to 16 bytes");
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the sequence lock must be lock-free to work across processes");
+
+public:
+    explicit shm_radix_tree(const std::string &name) :
+        m_name(name), m_base(NULL), m_capacity(0), m_writable(false) { }
+    ~shm_radix_tree() {
+        close();
+    }
+
+    // makes a new empty segment of capacity bytes and maps it for writing.
+    // A segment of that name is unlinked, not truncated, so processes that
+    // still map it keep reading it as it was.
+    bool create(std::size_t capacity);
+    // maps an existing segment, for reading only unless writable
+    bool open(bool writable = false);
+    void close();
+    // removes the name; segments stay valid for the processes mapping them
+    bool unlink();
+
+    // writers; same results as the radix_tree members. They throw
+    // std::logic_error unless the segment is mapped for writing, by
+    // create() or open(true).
+    bool insert(const std::string &key, const T &val) {
+        return put(key, val, false);
+    }
+    bool insert_or_assign(const std::string &key, const T &val) {
+        return put(key, val, true);
+    }
+    bool erase(const std::string &key);
+
+    // readers; the value is copied out
+    bool find(const std::string &key, T &val) const;
+    bool longest_match(const std::string &key, std::string &match, T &val) const;
+
+    std::size_t size() const;
+    std::size_t capacity() const {
+        return m_capacity;
+    }
+    // bytes in blocks handed out, the header included
+    std::size_t bytes_used() const;
+
+private:
+    typedef std::uint64_t offset_type; // from the start of the segment; 0 is NULL
+
+    static const std::uint64_t magic = 0x31454552544d4853ull; // "SHMTREE1"
+    static const unsigned size_classes = 64;
+
+    struct header_type {
+        std::uint64_t m_magic;
+        std::uint64_t m_capacity;
+        std::atomic<std::uint64_t> m_seq; // odd while a writer updates
+        offset_type   m_root;
+        std::uint64_t m_size;
+        offset_type   m_top;              // first byte never handed out
+        std::uint64_t m_used;
+        offset_type   m_free[size_classes];
+    };
+
+    // followed by m_label_cap bytes of label
+    struct node_type {
+        offset_type   m_children;    // array of m_child_cap offsets, sorted by first label byte
+        std::uint32_t m_child_count;
+        std::uint32_t m_child_cap;
+        std::uint32_t m_label_len;
+        std::uint32_t m_label_cap;   // what the block was sized for
+        std::uint32_t m_has_value;
+        T             m_value;
+    };
+
+    // makes the sequence number odd for as long as it lives
+    class write_guard {
+    public:
+        explicit write_guard(header_type *header);
+        ~write_guard();
+
+    private:
+        header_type *m_header;
+    };
+
+    std::string m_name;
+    char *m_base;
+    std::size_t m_capacity;
+    bool m_writable;
+
+    void check_writable() const {
+        if (! m_writable)
+            throw std::logic_error("shm_radix_tree: segment not mapped for writing");
+    }
+
+    template <class X> X* at(offset_type off) const {
+        return reinterpret_cast<X*>(m_base + off);
+    }
+    header_type* header() const {
+        return at<header_type>(0);
+    }
+    static offset_type header_bytes() {
+        return (sizeof(header_type) + 63) / 64 * 64;
+    }
+    static offset_type node_bytes(std::size_t label_len) {
+        return sizeof(node_type) + label_len;
+    }
+    static char* label(node_type *node) {
+        return reinterpret_cast<char*>(node) + sizeof(node_type);
+    }
+
+    static unsigned size_class(std::uint64_t bytes, std::uint64_t &block);
+    offset_type allocate(std::uint64_t bytes);
+    void deallocate(offset_type off, std::uint64_t bytes);
+    offset_type new_node(const char *label, std::size_t len, const T *val);
+    void delete_node(offset_type off);
+    offset_type child_at(node_type *node, unsigned i) const {
+        return at<offset_type>(node->m_children)[i];
+    }
+    unsigned find_child(node_type *node, unsigned char unit, bool &found) const;
+    bool insert_child(node_type *node, unsigned i, offset_type child);
+    void remove_child(node_type *node, unsigned i);
+
+    bool put(const std::string &key, const T &val, bool assign);
+    void compress(std::vector<offset_type> &path, std::vector<unsigned> &index);
+
+    bool valid(offset_type off, std::uint64_t bytes) const {
+        return off >= header_bytes() && off <= m_capacity && bytes <= m_capacity - off;
+    }
+    bool lookup(const std::string &key, bool longest, std::size_t &match_len, T &val) const;
+    bool read(const std::string &key, bool longest, std::size_t &match_len, T &val) const;
+
+    shm_radix_tree(const shm_radix_tree &other); // delete
+    shm_radix_tree& operator =(const shm_radix_tree &other); // delete
+};
+
+template <typename T>
+shm_radix_tree<T>::write_guard::write_guard(header_type *header) : m_header(header)
+{
+    for (;;) {
+        std::uint64_t seq = m_header->m_seq.load(std::memory_order_relaxed);
+
+        if ((seq & 1) == 0 && m_header->m_seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire))
+            break;
+
+        sched_yield();
+    }
+
+    // the odd number must be visible before any of the updates
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename T>
+shm_radix_tree<T>::write_guard::~write_guard()
+{
+    m_header->m_seq.fetch_add(1, std::memory_order_release);
+}
+
+template <typename T>
+bool shm_radix_tree<T>::create(std::size_t capacity)
+{
+    close();
+
+    if (capacity < header_bytes() + 4096)
+        return false;
+
+    if (shm_unlink(m_name.c_str()) != 0 && errno != ENOENT)
+        return false;
+
+    // another create() may have won the name since; its segment is left
+    // alone rather than truncated
+    int fd = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+    if (fd < 0)
+        return false;
+
+    void *base = MAP_FAILED;
+
+    if (ftruncate(fd, capacity) == 0)
+        base = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    if (base == MAP_FAILED) {
+        shm_unlink(m_name.c_str());
+        return false;
+    }
+
+    m_base     = static_cast<char*>(base);
+    m_capacity = capacity;
+    m_writable = true;
+
+    header_type *h = new (m_base) header_type();
+
+    h->m_capacity = capacity;
+    h->m_seq.store(0);
+    h->m_size = 0;
+    h->m_top  = header_bytes();
+    h->m_used = header_bytes();
+    for (unsigned i = 0; i < size_classes; i++)
+        h->m_free[i] = 0;
+
+    h->m_root = new_node(NULL, 0, NULL);
+
+    // readers check the magic number last
+    std::atomic_thread_fence(std::memory_order_release);
+    h->m_magic = magic;
+
+    return true;
+}
+
+template <typename T>
+bool shm_radix_tree<T>::open(bool writable)
+{
+    close();
+
+    int fd = shm_open(m_name.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    void *base = MAP_FAILED;
+
+    if (fstat(fd, &st) == 0 && static_cast<std::uint64_t>(st.st_size) >= header_bytes())
+        base = mmap(NULL, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+    ::close(fd);
+
+    if (base == MAP_FAILED)
+        return false;
+
+    m_base     = static_cast<char*>(base);
+    m_capacity = st.st_size;
+    m_writable = writable;
+
+    if (header()->m_magic != magic || header()->m_capacity != m_capacity) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+void shm_radix_tree<T>::close()
+{
+    if (m_base == NULL)
+        return;
+
+    munmap(m_base, m_capacity);
+
+    m_base     = NULL;
+    m_capacity = 0;
+    m_writable = false;
+}
+
+template <typename T>
+bool shm_radix_tree<T>::unlink()
+{
+    return shm_unlink(m_name.c_str()) == 0;
+}
+
+template <typename T>
+std::size_t shm_radix_tree<T>::size() const
+{
+    return m_base != NULL ? header()->m_size : 0;
+}
+
+template <typename T>
+std::size_t shm_radix_tree<T>::bytes_used() const
+{
+    return m_base != NULL ? header()->m_used : 0;
+}
+
+// blocks of 16 to 512 bytes in steps of 16, then powers of two
+template <typename T>
+unsigned shm_radix_tree<T>::size_class(std::uint64_t bytes, std::uint64_t &block)
+{
+    if (bytes <= 512) {
+        unsigned cls = bytes == 0 ? 0 : static_cast<unsigned>((bytes - 1) / 16);
+
+        block = (cls + 1) * 16;
+        return cls;
+    }
+
+    unsigned cls = 32;
+
+    for (block = 1024; block < bytes; block <<= 1)
+        cls++;
+
+    return cls;
+}
+
+// 0 if the segment is full
+template <typename T>
+typename shm_radix_tree<T>::offset_type shm_radix_tree<T>::allocate(std::uint64_t bytes)
+{
+    header_type *h = header();
+    std::uint64_t block;
+    unsigned cls = size_class(bytes, block);
+    offset_type off;
+
+    if (cls >= size_classes)
+        return 0;
+
+    if (h->m_free[cls] != 0) {
+        off = h->m_free[cls];
+        h->m_free[cls] = *at<offset_type>(off);
+    } else {
+        if (block > m_capacity - h->m_top)
+            return 0;
+
+        off = h->m_top;
+        h->m_top += block;
+    }
+
+    h->m_used += block;
+
+    return off;
+}
+
+template <typename T>
+void shm_radix_tree<T>::deallocate(offset_type off, std::uint64_t bytes)
+{
+    header_type *h = header();
+    std::uint64_t block;
+    unsigned cls = size_class(bytes, block);
+
+    *at<offset_type>(off) = h->m_free[cls];
+    h->m_free[cls] = off;
+    h->m_used -= block;
+}
+
+template <typename T>
+typename shm_radix_tree<T>::offset_type shm_radix_tree<T>::new_node(const char *data, std::size_t len, const T *val)
+{
+    offset_type off = allocate(node_bytes(len));
+
+    if (off == 0)
+        return 0;
+
+    node_type *node = at<node_type>(off);
+
+    node->m_children    = 0;
+    node->m_child_count = 0;
+    node->m_child_cap   = 0;
+    node->m_label_len   = static_cast<std::uint32_t>(len);
+    node->m_label_cap   = static_cast<std::uint32_t>(len);
+    node->m_has_value   = val != NULL;
+    if (val != NULL)
+        node->m_value = *val;
+    if (len != 0)
+        std::memcpy(label(node), data, len);
+
+    return off;
+}
+
+template <typename T>
+void shm_radix_tree<T>::delete_node(offset_type off)
+{
+    node_type *node = at<node_type>(off);
+
+    if (node->m_children != 0)
+        deallocate(node->m_children, node->m_child_cap * sizeof(offset_type));
+
+    deallocate(off, node_bytes(node->m_label_cap));
+}
+
+// where the child starting with unit is, or would go
+template <typename T>
+unsigned shm_radix_tree<T>::find_child(node_type *node, unsigned char unit, bool &found) const
+{
+    unsigned lo = 0, hi = node->m_child_count;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        unsigned char first = *label(at<node_type>(child_at(node, mid)));
+
+        if (first == unit) {
+            found = true;
+            return mid;
+        }
+
+        if (first < unit)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    found = false;
+
+    return lo;
+}
+
+// false if the array had to grow and the segment is full
+template <typename T>
+bool shm_radix_tree<T>::insert_child(node_type *node, unsigned i, offset_type child)
+{
+    if (node->m_child_count == node->m_child_cap) {
+        std::uint32_t cap = node->m_child_cap == 0 ? 2 : node->m_child_cap * 2;
+        offset_type children = allocate(cap * sizeof(offset_type));
+
+        if (children == 0)
+            return false;
+
+        if (node->m_children != 0) {
+            std::memcpy(at<offset_type>(children), at<offset_type>(node->m_children), node->m_child_count * sizeof(offset_type));
+            deallocate(node->m_children, node->m_child_cap * sizeof(offset_type));
+        }
+
+        node->m_children  = children;
+        node->m_child_cap = cap;
+    }
+
+    offset_type *children = at<offset_type>(node->m_children);
+
+    std::memmove(children + i + 1, children + i, (node->m_child_count - i) * sizeof(offset_type));
+    children[i] = child;
+    node->m_child_count++;
+
+    return true;
+}
+
+template <typename T>
+void shm_radix_tree<T>::remove_child(node_type *node, unsigned i)
+{
+    offset_type *children = at<offset_type>(node->m_children);
+
+    std::memmove(children + i, children + i + 1, (node->m_child_count - i - 1) * sizeof(offset_type));
+    node->m_child_count--;
+}
+
+template <typename T>
+bool shm_radix_tree<T>::put(const std::string &key, const T &val, bool assign)
+{
+    check_writable();
+
+    write_guard guard(header());
+
+    offset_type off = header()->m_root;
+    std::size_t depth = 0;
+
+    for (;;) {
+        node_type *node = at<node_type>(off);
+
+        if (depth == key.size()) {
+            if (node->m_has_value) {
+                if (assign)
+                    node->m_value = val;
+                return false;
+            }
+
+            node->m_value     = val;
+            node->m_has_value = 1;
+            header()->m_size++;
+
+            return true;
+        }
+
+        bool found;
+        unsigned i = find_child(node, key[depth], found);
+
+        if (! found) {
+            offset_type leaf = new_node(key.data() + depth, key.size() - depth, &val);
+
+            if (leaf == 0)
+                throw std::bad_alloc();
+
+            if (! insert_child(node, i, leaf)) {
+                delete_node(leaf);
+                throw std::bad_alloc();
+            }
+
+            header()->m_size++;
+
+            return true;
+        }
+
+        offset_type child_off = child_at(node, i);
+        node_type *child = at<node_type>(child_off);
+        std::size_t len = child->m_label_len;
+        std::size_t common = 1;
+
+        while (common < len && depth + common < key.size() && label(child)[common] == key[depth + common])
+            common++;
+
+        if (common == len) {
+            off    = child_off;
+            depth += len;
+            continue;
+        }
+
+        // split the edge to child after common units; everything the
+        // update needs is allocated before anything is changed
+        std::size_t rest = key.size() - depth - common;
+        offset_type mid  = new_node(label(child), common, rest == 0 ? &val : NULL);
+        offset_type children = allocate(2 * sizeof(offset_type));
+        offset_type leaf = rest == 0 ? 0 : new_node(key.data() + depth + common, rest, &val);
+
+        if (mid == 0 || children == 0 || (rest != 0 && leaf == 0)) {
+            if (mid != 0)
+                delete_node(mid);
+            if (children != 0)
+                deallocate(children, 2 * sizeof(offset_type));
+            if (leaf != 0)
+                delete_node(leaf);
+            throw std::bad_alloc();
+        }
+
+        std::memmove(label(child), label(child) + common, len - common);
+        child->m_label_len = static_cast<std::uint32_t>(len - common);
+
+        node_type *m = at<node_type>(mid);
+        offset_type *slots = at<offset_type>(children);
+
+        m->m_children  = children;
+        m->m_child_cap = 2;
+        slots[0] = child_off;
+        m->m_child_count = 1;
+
+        if (leaf != 0) {
+            unsigned char a = label(child)[0];
+            unsigned char b = key[depth + common];
+
+            slots[a < b ? 1 : 0] = leaf;
+            slots[a < b ? 0 : 1] = child_off;
+            m->m_child_count = 2;
+        }
+
+        at<offset_type>(node->m_children)[i] = mid;
+        header()->m_size++;
+
+        return true;
+    }
+}
+
+template <typename T>
+bool shm_radix_tree<T>::erase(const std::string &key)
+{
+    check_writable();
+
+    write_guard guard(header());
+
+    // the nodes from the root down, and where each sits in its parent
+    std::vector<offset_type> path(1, header()->m_root);
+    std::vector<unsigned> index(1, 0);
+    std::size_t depth = 0;
+
+    while (depth < key.size()) {
+        node_type *node = at<node_type>(path.back());
+        bool found;
+        unsigned i = find_child(node, key[depth], found);
+
+        if (! found)
+            return false;
+
+        node_type *child = at<node_type>(child_at(node, i));
+        std::size_t len = child->m_label_len;
+
+        if (key.size() - depth < len || std::memcmp(label(child), key.data() + depth, len) != 0)
+            return false;
+
+        path.push_back(child_at(node, i));
+        index.push_back(i);
+        depth += len;
+    }
+
+    node_type *node = at<node_type>(path.back());
+
+    if (! node->m_has_value)
+        return false;
+
+    node->m_has_value = 0;
+    header()->m_size--;
+
+    compress(path, index);
+
+    return true;
+}
+
+// drops nodes left without entry and children, and merges one left with
+// a single child into it; a merge needs a new node for the joined label,
+// and is skipped if the segment is full, which lookups do not mind
+template <typename T>
+void shm_radix_tree<T>::compress(std::vector<offset_type> &path, std::vector<unsigned> &index)
+{
+    while (path.size() > 1) {
+        offset_type off = path.back();
+        node_type *node = at<node_type>(off);
+        node_type *parent = at<node_type>(path[path.size() - 2]);
+
+        if (node->m_has_value)
+            return;
+
+        if (node->m_child_count == 0) {
+            remove_child(parent, index.back());
+            delete_node(off);
+
+            path.pop_back();
+            index.pop_back();
+            continue;
+        }
+
+        if (node->m_child_count > 1)
+            return;
+
+        offset_type child_off = child_at(node, 0);
+        node_type *child = at<node_type>(child_off);
+        std::size_t len = node->m_label_len + child->m_label_len;
+        offset_type merged = allocate(node_bytes(len));
+
+        if (merged == 0)
+            return;
+
+        node_type *m = at<node_type>(merged);
+
+        *m = *child;
+        m->m_label_len = static_cast<std::uint32_t>(len);
+        m->m_label_cap = static_cast<std::uint32_t>(len);
+        std::memcpy(label(m), label(node), node->m_label_len);
+        std::memcpy(label(m) + node->m_label_len, label(child), child->m_label_len);
+
+        at<offset_type>(parent->m_children)[index.back()] = merged;
+
+        delete_node(off);
+        deallocate(child_off, node_bytes(child->m_label_cap));
+
+        return;
+    }
+}
+
+// one attempt, which may see a torn state if a writer runs meanwhile;
+// match_len is the length of the key found
+template <typename T>
+bool shm_radix_tree<T>::lookup(const std::string &key, bool longest, std::size_t &match_len, T &val) const
+{
+    offset_type off = header()->m_root;
+    std::size_t depth = 0;
+    bool found = false;
+
+    for (;;) {
+        node_type node;
+
+        if (! valid(off, sizeof(node)))
+            return false;
+
+        std::memcpy(&node, at<node_type>(off), sizeof(node));
+
+        if (node.m_has_value && (longest || depth == key.size())) {
+            std::memcpy(&val, &at<node_type>(off)->m_value, sizeof(T));
+            match_len = depth;
+            found = true;
+        }
+
+        if (depth == key.size())
+            return found;
+
+        if (node.m_child_count > 256 || node.m_child_count > node.m_child_cap ||
+            ! valid(node.m_children, node.m_child_count * sizeof(offset_type)))
+            return found;
+
+        const offset_type *children = at<offset_type>(node.m_children);
+        unsigned char unit = key[depth];
+        offset_type next = 0;
+        std::uint32_t len = 0;
+
+        for (std::uint32_t i = 0; i < node.m_child_count; i++) {
+            offset_type child;
+
+            std::memcpy(&child, children + i, sizeof(child));
+
+            if (! valid(child, sizeof(node_type)))
+                return found;
+
+            std::memcpy(&len, &at<node_type>(child)->m_label_len, sizeof(len));
+
+            if (len == 0 || ! valid(child, node_bytes(len)))
+                return found;
+
+            if (static_cast<unsigned char>(*label(at<node_type>(child))) == unit) {
+                next = child;
+                break;
+            }
+        }
+
+        if (next == 0 || key.size() - depth < len ||
+            std::memcmp(label(at<node_type>(next)), key.data() + depth, len) != 0)
+            return found;
+
+        off    = next;
+        depth += len;
+    }
+}
+
+template <typename T>
+bool shm_radix_tree<T>::read(const std::string &key, bool longest, std::size_t &match_len, T &val) const
+{
+    if (m_base == NULL)
+        return false;
+
+    const std::atomic<std::uint64_t> &seq = header()->m_seq;
+
+    for (;;) {
+        std::uint64_t before = seq.load(std::memory_order_acquire);
+
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+
+        T copy;
+        bool found = lookup(key, longest, match_len, copy);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (seq.load(std::memory_order_relaxed) == before) {
+            if (found)
+                val = copy;
+            return found;
+        }
+    }
+}
+
+template <typename T>
+bool shm_radix_tree<T>::find(const std::string &key, T &val) const
+{
+    std::size_t match_len;
+
+    return read(key, false, match_len, val);
+}
+
+template <typename T>
+bool shm_radix_tree<T>::longest_match(const std::string &key, std::string &match, T &val) const
+{
+    std::size_t match_len;
+
+    if (! read(key, true, match_len, val))
+        return false;
+
+    match.assign(key, 0, match_len);
+
+    return true;
+}
+
+#endif // RADIX_TREE_SHM_HPP
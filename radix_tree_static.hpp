@@ -0,0 +1,276 @@
+#ifndef RADIX_TREE_STATIC_HPP
+#define RADIX_TREE_STATIC_HPP
+
+// static_radix_tree is a radix tree over a fixed set of keys, built by a
+// constexpr constructor, so that a table of method names or config keys
+// costs nothing at startup and lives in read-only data. Requires C++17.
+//
+//     constexpr auto methods = make_static_radix_tree<int>({
+//         { "GET", 1 }, { "HEAD", 2 }, { "POST", 3 }, { "PUT", 4 },
+//     });
+//     static_assert(methods.find("PUT")->second == 4);
+//
+// The entries are kept sorted by key, and every node of the tree covers
+// the run of entries that share its prefix, so prefix_match is a range of
+// them. The nodes hold no labels of their own: a node's label is read
+// from the key of the first entry it covers. Lookups are constexpr and
+// allocate nothing; with a constant key the compiler can fold them away,
+// and otherwise they walk a few nodes in one contiguous array.
+//
+// Keys are std::string_view and must outlive the tree; string literals
+// do. T must be default constructible. A duplicate key throws
+// std::invalid_argument, which makes a constexpr build fail to compile.
+
+#include <cstddef>
+#include <stdexcept>
+#include <string_view>
+
+template <typename T>
+struct static_radix_entry {
+    std::string_view first;
+    T second;
+};
+
+template <typename T, std::size_t N>
+class static_radix_tree {
+    static_assert(N > 0, "static_radix_tree needs at least one entry");
+
+public:
+    typedef std::string_view key_type;
+    typedef T mapped_type;
+    typedef static_radix_entry<T> value_type;
+    typedef std::size_t size_type;
+    typedef const value_type* const_iterator;
+
+    // a run of entries in key order
+    struct range_type {
+        const_iterator first;
+        const_iterator last;
+
+        constexpr const_iterator begin() const {
+            return first;
+        }
+        constexpr const_iterator end() const {
+            return last;
+        }
+        constexpr size_type size() const {
+            return static_cast<size_type>(last - first);
+        }
+        constexpr bool empty() const {
+            return first == last;
+        }
+    };
+
+    constexpr explicit static_radix_tree(const value_type (&entries)[N]);
+
+    constexpr size_type size() const {
+        return N;
+    }
+    constexpr const_iterator begin() const {
+        return m_entries;
+    }
+    constexpr const_iterator end() const {
+        return m_entries + N;
+    }
+    // nodes the tree was built with, the root included
+    constexpr size_type node_count() const {
+        return m_node_count;
+    }
+
+    // the entry for key, or nullptr
+    constexpr const_iterator find(std::string_view key) const;
+    // the entry with the longest key that is a prefix of key, or nullptr
+    constexpr const_iterator longest_match(std::string_view key) const;
+    // every entry whose key starts with prefix
+    constexpr range_type prefix_match(std::string_view prefix) const;
+
+private:
+    struct node_type {
+        unsigned m_depth;    // length of the prefix the node stands for
+        unsigned m_first;    // entries [m_first, m_last) share the prefix
+        unsigned m_last;
+        unsigned m_child;    // children are m_nodes[m_child, m_child + m_children)
+        unsigned m_children;
+        bool m_value;        // m_entries[m_first] is the prefix itself
+    };
+
+    // a tree of N keys has at most N - 1 branching nodes besides the
+    // nodes holding the entries and the root
+    static constexpr size_type node_capacity = 2 * N;
+
+    value_type m_entries[N];
+    node_type m_nodes[node_capacity];
+    unsigned m_node_count;
+
+    constexpr std::string_view key_of(unsigned entry) const {
+        return m_entries[entry].first;
+    }
+    // the child of node whose label starts with unit, or 0 if none
+    constexpr unsigned child_of(const node_type &node, char unit) const;
+    // true if key matches the label of child below depth, as far as key goes
+    constexpr bool matches(const node_type &child, std::string_view key, unsigned depth) const;
+};
+
+template <typename T, std::size_t N>
+constexpr static_radix_tree<T, N>::static_radix_tree(const value_type (&entries)[N]) :
+    m_entries{}, m_nodes{}, m_node_count(1)
+{
+    for (size_type i = 0; i < N; i++)
+        m_entries[i] = entries[i];
+
+    // insertion sort, as std::sort is not constexpr before C++20
+    for (size_type i = 1; i < N; i++) {
+        for (size_type j = i; j > 0 && m_entries[j].first < m_entries[j - 1].first; j--) {
+            value_type tmp = m_entries[j];
+            m_entries[j] = m_entries[j - 1];
+            m_entries[j - 1] = tmp;
+        }
+    }
+
+    for (size_type i = 1; i < N; i++) {
+        if (m_entries[i].first == m_entries[i - 1].first)
+            throw std::invalid_argument("static_radix_tree: duplicate key");
+    }
+
+    m_nodes[0] = node_type{ 0, 0, static_cast<unsigned>(N), 0, 0, false };
+
+    // the node array doubles as the work queue: each node is split into
+    // its children, appended behind it, when the scan reaches it
+    for (unsigned i = 0; i < m_node_count; i++) {
+        node_type &node = m_nodes[i];
+        unsigned first = node.m_first;
+
+        if (first < node.m_last && key_of(first).size() == node.m_depth) {
+            node.m_value = true;
+            first++;
+        }
+
+        node.m_child = m_node_count;
+
+        while (first < node.m_last) {
+            char unit = key_of(first)[node.m_depth];
+            unsigned last = first + 1;
+
+            while (last < node.m_last && key_of(last)[node.m_depth] == unit)
+                last++;
+
+            // the run shares what its first and last keys share
+            std::string_view lo = key_of(first), hi = key_of(last - 1);
+            unsigned depth = node.m_depth + 1;
+
+            while (depth < lo.size() && depth < hi.size() && lo[depth] == hi[depth])
+                depth++;
+
+            m_nodes[m_node_count++] = node_type{ depth, first, last, 0, 0, false };
+            first = last;
+        }
+
+        node.m_children = m_node_count - node.m_child;
+    }
+}
+
+template <typename T, std::size_t N>
+constexpr unsigned static_radix_tree<T, N>::child_of(const node_type &node, char unit) const
+{
+    unsigned lo = node.m_child, hi = node.m_child + node.m_children;
+
+    // keys sort as unsigned bytes
+    while (lo < hi) {
+        unsigned mid = lo + (hi - lo) / 2;
+        unsigned char label = static_cast<unsigned char>(key_of(m_nodes[mid].m_first)[node.m_depth]);
+
+        if (label < static_cast<unsigned char>(unit))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < node.m_child + node.m_children && key_of(m_nodes[lo].m_first)[node.m_depth] == unit)
+        return lo;
+
+    return 0;
+}
+
+template <typename T, std::size_t N>
+constexpr bool static_radix_tree<T, N>::matches(const node_type &child, std::string_view key, unsigned depth) const
+{
+    size_type len = (key.size() < child.m_depth ? key.size() : child.m_depth) - depth;
+
+    return key.substr(depth, len) == key_of(child.m_first).substr(depth, len);
+}
+
+template <typename T, std::size_t N>
+constexpr typename static_radix_tree<T, N>::const_iterator static_radix_tree<T, N>::find(std::string_view key) const
+{
+    unsigned i = 0;
+
+    for (;;) {
+        const node_type &node = m_nodes[i];
+
+        if (key.size() == node.m_depth)
+            return node.m_value ? &m_entries[node.m_first] : nullptr;
+
+        unsigned next = child_of(node, key[node.m_depth]);
+
+        if (next == 0 || key.size() < m_nodes[next].m_depth || ! matches(m_nodes[next], key, node.m_depth))
+            return nullptr;
+
+        i = next;
+    }
+}
+
+template <typename T, std::size_t N>
+constexpr typename static_radix_tree<T, N>::const_iterator static_radix_tree<T, N>::longest_match(std::string_view key) const
+{
+    const_iterator found = nullptr;
+    unsigned i = 0;
+
+    for (;;) {
+        const node_type &node = m_nodes[i];
+
+        if (node.m_value)
+            found = &m_entries[node.m_first];
+
+        if (key.size() == node.m_depth)
+            return found;
+
+        unsigned next = child_of(node, key[node.m_depth]);
+
+        if (next == 0 || key.size() < m_nodes[next].m_depth || ! matches(m_nodes[next], key, node.m_depth))
+            return found;
+
+        i = next;
+    }
+}
+
+template <typename T, std::size_t N>
+constexpr typename static_radix_tree<T, N>::range_type static_radix_tree<T, N>::prefix_match(std::string_view prefix) const
+{
+    unsigned i = 0;
+
+    for (;;) {
+        const node_type &node = m_nodes[i];
+
+        if (prefix.size() == node.m_depth)
+            return range_type{ m_entries + node.m_first, m_entries + node.m_last };
+
+        unsigned next = child_of(node, prefix[node.m_depth]);
+
+        if (next == 0 || ! matches(m_nodes[next], prefix, node.m_depth))
+            return range_type{ end(), end() };
+
+        // the prefix may end inside the child's label
+        if (prefix.size() <= m_nodes[next].m_depth)
+            return range_type{ m_entries + m_nodes[next].m_first, m_entries + m_nodes[next].m_last };
+
+        i = next;
+    }
+}
+
+template <typename T, std::size_t N>
+constexpr static_radix_tree<T, N> make_static_radix_tree(const static_radix_entry<T> (&entries)[N])
+{
+    return static_radix_tree<T, N>(entries);
+}
+
+#endif // RADIX_TREE_STATIC_HPP
@@ -0,0 +1,188 @@
+#ifndef RADIX_TREE_STATS_HPP
+#define RADIX_TREE_STATS_HPP
+
+// Instrumentation policies for radix_tree.
+//
+// A policy is the 4th template parameter of radix_tree. The tree calls
+// its hooks on the hot paths; the default radix_tree_null_stats has
+// empty inline hooks, so an uninstrumented tree compiles to the same
+// code as before.
+//
+//     radix_tree<std::string, int, std::less<std::string>,
+//                radix_tree_counting_stats> tree;
+//     ...
+//     radix_tree_counters c = tree.stats().counters();
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
+
+struct radix_tree_null_stats {
+    void on_lookup() { }            // one descent from the root
+    void on_node_visit() { }        // one node entered during a descent
+    void on_child_scan() { }        // one child edge examined
+    void on_label_compare(int) { }  // key units compared against a label
+    void on_alloc() { }             // one node allocated
+    void on_free() { }              // one node freed
+    void on_split() { }             // an edge was split by prepend
+    void on_merge() { }             // a node was merged with its only child
+    void on_cache_hit() { }         // find() answered by the hot-key cache
+    void on_cache_miss() { }        // find() had to descend
+    void on_filter_reject() { }     // find() answered by the negative-lookup filter
+    void on_filter_false_positive() { } // the filter let a missing key through
+};
+
+struct radix_tree_counters {
+    unsigned long lookups;
+    unsigned long nodes_visited;
+    unsigned long children_scanned;
+    unsigned long label_units_compared;
+    unsigned long allocs;
+    unsigned long frees;
+    unsigned long splits;
+    unsigned long merges;
+    unsigned long cache_hits;
+    unsigned long cache_misses;
+    unsigned long filter_rejects;
+    unsigned long filter_false_positives;
+
+    radix_tree_counters() :
+        lookups(0), nodes_visited(0), children_scanned(0),
+        label_units_compared(0), allocs(0), frees(0), splits(0), merges(0),
+        cache_hits(0), cache_misses(0),
+        filter_rejects(0), filter_false_positives(0) { }
+
+    // share of the missing keys looked up that the filter failed to reject
+    double filter_false_positive_rate() const {
+        unsigned long misses = filter_rejects + filter_false_positives;
+
+        return misses == 0 ? 0.0 : static_cast<double>(filter_false_positives) / misses;
+    }
+};
+
+// counters kept per tree, read through radix_tree::stats(). In C++11
+// they are relaxed atomics, so that const lookups may run on several
+// threads at once, as they may on an uninstrumented tree; each count is
+// exact, but a snapshot taken during updates need not be consistent
+// across counters. In C++98 they are plain counters, and a tree read from
+// several threads at once should not use this policy.
+class radix_tree_counting_stats {
+public:
+    radix_tree_counting_stats() {
+        reset();
+    }
+    radix_tree_counting_stats(const radix_tree_counting_stats &other) {
+        copy(other);
+    }
+    radix_tree_counting_stats& operator =(const radix_tree_counting_stats &other) {
+        if (this != &other)
+            copy(other);
+        return *this;
+    }
+
+    void on_lookup()              { add(lookups); }
+    void on_node_visit()          { add(nodes_visited); }
+    void on_child_scan()          { add(children_scanned); }
+    void on_label_compare(int n)  { add(label_units_compared, n); }
+    void on_alloc()               { add(allocs); }
+    void on_free()                { add(frees); }
+    void on_split()               { add(splits); }
+    void on_merge()               { add(merges); }
+    void on_cache_hit()           { add(cache_hits); }
+    void on_cache_miss()          { add(cache_misses); }
+    void on_filter_reject()       { add(filter_rejects); }
+    void on_filter_false_positive() { add(filter_false_positives); }
+
+    // a copy of the counters as they are now
+    radix_tree_counters counters() const {
+        radix_tree_counters c;
+
+        c.lookups                = load(lookups);
+        c.nodes_visited          = load(nodes_visited);
+        c.children_scanned       = load(children_scanned);
+        c.label_units_compared   = load(label_units_compared);
+        c.allocs                 = load(allocs);
+        c.frees                  = load(frees);
+        c.splits                 = load(splits);
+        c.merges                 = load(merges);
+        c.cache_hits             = load(cache_hits);
+        c.cache_misses           = load(cache_misses);
+        c.filter_rejects         = load(filter_rejects);
+        c.filter_false_positives = load(filter_false_positives);
+
+        return c;
+    }
+    void reset() {
+        for (int i = 0; i < counter_count; i++)
+            store(static_cast<counter_id>(i), 0);
+    }
+
+private:
+    enum counter_id {
+        lookups, nodes_visited, children_scanned, label_units_compared,
+        allocs, frees, splits, merges, cache_hits, cache_misses,
+        filter_rejects, filter_false_positives, counter_count
+    };
+
+#if __cplusplus >= 201103L
+    std::atomic<unsigned long> m_counts[counter_count];
+
+    void add(counter_id id, unsigned long n = 1) {
+        m_counts[id].fetch_add(n, std::memory_order_relaxed);
+    }
+    unsigned long load(counter_id id) const {
+        return m_counts[id].load(std::memory_order_relaxed);
+    }
+    void store(counter_id id, unsigned long n) {
+        m_counts[id].store(n, std::memory_order_relaxed);
+    }
+#else
+    unsigned long m_counts[counter_count];
+
+    void add(counter_id id, unsigned long n = 1) {
+        m_counts[id] += n;
+    }
+    unsigned long load(counter_id id) const {
+        return m_counts[id];
+    }
+    void store(counter_id id, unsigned long n) {
+        m_counts[id] = n;
+    }
+#endif
+
+    void copy(const radix_tree_counting_stats &other) {
+        for (int i = 0; i < counter_count; i++)
+            store(static_cast<counter_id>(i), other.load(static_cast<counter_id>(i)));
+    }
+};
+
+#if __cplusplus >= 201103L
+// counters kept per thread and shared by every tree using this policy,
+// read through radix_tree_thread_stats::counters() on the thread itself
+class radix_tree_thread_stats {
+public:
+    void on_lookup()              { ++local().lookups; }
+    void on_node_visit()          { ++local().nodes_visited; }
+    void on_child_scan()          { ++local().children_scanned; }
+    void on_label_compare(int n)  { local().label_units_compared += n; }
+    void on_alloc()               { ++local().allocs; }
+    void on_free()                { ++local().frees; }
+    void on_split()               { ++local().splits; }
+    void on_merge()               { ++local().merges; }
+    void on_cache_hit()           { ++local().cache_hits; }
+    void on_cache_miss()          { ++local().cache_misses; }
+    void on_filter_reject()       { ++local().filter_rejects; }
+    void on_filter_false_positive() { ++local().filter_false_positives; }
+
+    static const radix_tree_counters& counters() { return local(); }
+    static void reset() { local() = radix_tree_counters(); }
+
+private:
+    static radix_tree_counters& local() {
+        static thread_local radix_tree_counters counters;
+        return counters;
+    }
+};
+#endif
+
+#endif // RADIX_TREE_STATS_HPP
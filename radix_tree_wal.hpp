@@ -0,0 +1,719 @@
+#ifndef RADIX_TREE_WAL_HPP
+#define RADIX_TREE_WAL_HPP
+
+// durable_radix_tree keeps a radix_tree in memory and makes it survive a
+// crash with a write-ahead log and periodic checkpoints. Requires C++11
+// and POSIX.
+//
+// Every mutation is applied to the tree and queued as a log record under
+// one mutex; a background thread appends the queued records to <path>.wal
+// in batches and fsyncs once per batch (group commit), so a mutation
+// never waits for the disk. sync() waits until everything queued so far is
+// durable. When the log grows past checkpoint_bytes, the background thread
+// takes an O(1) snapshot of the tree, writes it to <path>.ckpt and empties
+// the log. open() loads the checkpoint and replays the log records written
+// after it; a torn record at the end of the log is discarded, while one
+// that passes its checksum but cannot be read fails open().
+//
+// A failed write or fsync cuts the log back to the last batch that made it
+// to disk and stops it there, so that it never holds a hole or a torn
+// record followed by good ones. From then on mutations throw
+// std::runtime_error, leaving the tree as it was, and sync() and
+// checkpoint() return false; close() and open() again to go on from what
+// is on disk.
+//
+// Keys and values are serialized by radix_tree_codec<>, which handles
+// std::string and trivially copyable types. Files use native byte order.
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "radix_tree.hpp"
+
+template <typename V>
+struct radix_tree_codec {
+    static_assert(std::is_trivially_copyable<V>::value, "radix_tree_codec needs a specialization for this type");
+
+    static void encode(const V &val, std::string &out) {
+        out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+    }
+    static bool decode(const char *data, std::size_t len, V &val) {
+        if (len != sizeof(val))
+            return false;
+
+        std::memcpy(&val, data, len);
+        return true;
+    }
+};
+
+template <>
+struct radix_tree_codec<std::string> {
+    static void encode(const std::string &val, std::string &out) {
+        out.append(val);
+    }
+    static bool decode(const char *data, std::size_t len, std::string &val) {
+        val.assign(data, len);
+        return true;
+    }
+};
+
+template <typename K, typename T, class Compare = std::less<K>, class Stats = radix_tree_null_stats>
+class durable_radix_tree {
+public:
+    typedef radix_tree<K, T, Compare, Stats> tree_type;
+    typedef std::uint64_t lsn_type;
+
+    explicit durable_radix_tree(const std::string &path, std::size_t checkpoint_bytes = 64 << 20) :
+        m_path(path), m_checkpoint_bytes(checkpoint_bytes), m_wal_fd(-1),
+        m_last_lsn(0), m_durable_lsn(0), m_wal_bytes(0),
+        m_checkpoint_requested(false), m_stop(false), m_failed(false) { }
+    ~durable_radix_tree() {
+        close();
+    }
+
+    // recovers the tree from disk and starts the log writer
+    bool open();
+    // writes out everything queued and stops the log writer
+    void close();
+
+    // same results as the radix_tree members; the record is queued, not
+    // yet durable, when they return. Throw std::runtime_error once the log
+    // has failed.
+    bool insert(const K &key, const T &val);
+    bool insert_or_assign(const K &key, const T &val);
+    bool erase(const K &key);
+
+    // blocks until every mutation made so far is on disk
+    bool sync();
+    // writes a checkpoint now and empties the log
+    bool checkpoint();
+
+    bool find(const K &key, T &val) const;
+    std::size_t size() const;
+    // O(1) consistent view for long-running readers
+    tree_type snapshot() const;
+
+    lsn_type last_lsn() const;
+    lsn_type durable_lsn() const;
+
+private:
+    enum { op_put = 1, op_erase = 2 };
+    static const std::uint32_t checkpoint_magic = 0x4b435452; // "RTCK"
+
+    std::string m_path;
+    std::size_t m_checkpoint_bytes;
+    int m_wal_fd;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_work;    // signals the log writer
+    std::condition_variable m_durable; // signals sync() and checkpoint()
+    std::thread m_writer;
+
+    tree_type   m_tree;
+    std::string m_pending;   // encoded records not yet written
+    lsn_type    m_last_lsn;
+    lsn_type    m_durable_lsn;
+    std::size_t m_wal_bytes;
+    bool        m_checkpoint_requested;
+    bool        m_stop;
+    bool        m_failed;
+
+    void check_log() const;
+    void queue(int op, const K &key, const T *val);
+    void run();
+    bool write_checkpoint(const tree_type &tree, lsn_type lsn);
+    bool load_checkpoint(lsn_type &lsn);
+    bool replay(lsn_type from);
+
+    static std::uint32_t checksum(const char *data, std::size_t len);
+    static void put_u32(std::string &out, std::uint32_t val);
+    static void put_u64(std::string &out, std::uint64_t val);
+    static bool get_u32(const std::string &in, std::size_t &pos, std::uint32_t &val);
+    static bool get_u64(const std::string &in, std::size_t &pos, std::uint64_t &val);
+    static bool get_bytes(const std::string &in, std::size_t &pos, std::size_t len, const char *&data);
+    static bool read_file(const std::string &path, std::string &data);
+    static bool write_all(int fd, const char *data, std::size_t len);
+    bool sync_dir() const;
+
+    durable_radix_tree(const durable_radix_tree &other); // delete
+    durable_radix_tree& operator =(const durable_radix_tree &other); // delete
+};
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::open()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_wal_fd >= 0)
+        return true;
+
+    m_tree.clear();
+
+    lsn_type lsn = 0;
+    if (! load_checkpoint(lsn))
+        return false;
+
+    m_last_lsn = m_durable_lsn = lsn;
+
+    if (! replay(lsn))
+        return false;
+
+    m_wal_fd = ::open((m_path + ".wal").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (m_wal_fd < 0)
+        return false;
+
+    m_stop   = false;
+    m_failed = false;
+    m_writer = std::thread(&durable_radix_tree::run, this);
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void durable_radix_tree<K, T, Compare, Stats>::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_wal_fd < 0)
+            return;
+
+        m_stop = true;
+        m_work.notify_one();
+    }
+
+    m_writer.join();
+
+    ::close(m_wal_fd);
+    m_wal_fd = -1;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::insert(const K &key, const T &val)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    check_log();
+
+    if (! m_tree.insert(typename tree_type::value_type(key, val)).second)
+        return false;
+
+    queue(op_put, key, &val);
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::insert_or_assign(const K &key, const T &val)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    check_log();
+
+    std::pair<typename tree_type::iterator, bool> ret;
+    ret = m_tree.insert(typename tree_type::value_type(key, val));
+
+    if (! ret.second)
+        ret.first->second = val;
+
+    queue(op_put, key, &val);
+
+    return ret.second;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::erase(const K &key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    check_log();
+
+    if (! m_tree.erase(key))
+        return false;
+
+    queue(op_erase, key, NULL);
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::sync()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    lsn_type lsn = m_last_lsn;
+
+    m_durable.wait(lock, [this, lsn]() { return m_durable_lsn >= lsn || m_failed || m_wal_fd < 0; });
+
+    return ! m_failed && m_durable_lsn >= lsn;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::checkpoint()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (m_wal_fd < 0 || m_failed)
+        return false;
+
+    m_checkpoint_requested = true;
+    m_work.notify_one();
+
+    m_durable.wait(lock, [this]() { return ! m_checkpoint_requested || m_failed; });
+
+    return ! m_failed;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::find(const K &key, T &val) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const tree_type &tree = m_tree;
+    typename tree_type::const_iterator it = tree.find(key);
+
+    if (it == tree.end())
+        return false;
+
+    val = it->second;
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+std::size_t durable_radix_tree<K, T, Compare, Stats>::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_tree.size();
+}
+
+template <typename K, typename T, class Compare, class Stats>
+typename durable_radix_tree<K, T, Compare, Stats>::tree_type durable_radix_tree<K, T, Compare, Stats>::snapshot() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_tree.snapshot();
+}
+
+template <typename K, typename T, class Compare, class Stats>
+typename durable_radix_tree<K, T, Compare, Stats>::lsn_type durable_radix_tree<K, T, Compare, Stats>::last_lsn() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_last_lsn;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+typename durable_radix_tree<K, T, Compare, Stats>::lsn_type durable_radix_tree<K, T, Compare, Stats>::durable_lsn() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    return m_durable_lsn;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void durable_radix_tree<K, T, Compare, Stats>::check_log() const
+{
+    if (m_failed)
+        throw std::runtime_error("durable_radix_tree: the log failed, reopen to go on");
+}
+
+// record: u32 length of the rest, u32 checksum of the body, then the body:
+// u8 op, u64 lsn, u32 key length, key, [u32 value length, value]
+template <typename K, typename T, class Compare, class Stats>
+void durable_radix_tree<K, T, Compare, Stats>::queue(int op, const K &key, const T *val)
+{
+    std::string body;
+
+    body.push_back(static_cast<char>(op));
+    put_u64(body, ++m_last_lsn);
+
+    std::string data;
+    radix_tree_codec<K>::encode(key, data);
+    put_u32(body, static_cast<std::uint32_t>(data.size()));
+    body.append(data);
+
+    if (val != NULL) {
+        data.clear();
+        radix_tree_codec<T>::encode(*val, data);
+        put_u32(body, static_cast<std::uint32_t>(data.size()));
+        body.append(data);
+    }
+
+    put_u32(m_pending, static_cast<std::uint32_t>(body.size()));
+    put_u32(m_pending, checksum(body.data(), body.size()));
+    m_pending.append(body);
+
+    m_work.notify_one();
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void durable_radix_tree<K, T, Compare, Stats>::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_work.wait(lock, [this]() { return m_stop || m_checkpoint_requested || ! m_pending.empty(); });
+
+        // nothing more goes into a failed log
+        if (m_failed) {
+            m_pending.clear();
+            m_checkpoint_requested = false;
+            m_durable.notify_all();
+
+            if (m_stop)
+                return;
+            continue;
+        }
+
+        // everything queued so far goes out with a single fsync
+        std::string batch;
+        batch.swap(m_pending);
+
+        lsn_type    lsn   = m_last_lsn;
+        std::size_t bytes = m_wal_bytes;
+        bool        stop  = m_stop;
+        bool        ckpt  = m_checkpoint_requested || bytes + batch.size() >= m_checkpoint_bytes;
+        tree_type   snap;
+
+        // O(1), and the mutations made while it is written out copy
+        // only their own paths
+        if (ckpt)
+            snap = m_tree.snapshot();
+
+        lock.unlock();
+
+        bool wrote = true, ok;
+
+        if (! batch.empty())
+            wrote = write_all(m_wal_fd, batch.data(), batch.size()) && ::fdatasync(m_wal_fd) == 0;
+
+        // a batch that did not make it leaves no part of itself behind
+        if (! wrote && ::ftruncate(m_wal_fd, bytes) == 0)
+            ::fdatasync(m_wal_fd);
+
+        ok = wrote;
+
+        // the checkpoint covers every record up to lsn, all of which are in
+        // the log now, so the log can be emptied once the checkpoint is safe
+        if (ok && ckpt)
+            ok = write_checkpoint(snap, lsn) && ::ftruncate(m_wal_fd, 0) == 0 && ::fsync(m_wal_fd) == 0;
+
+        snap.clear();
+
+        lock.lock();
+
+        if (wrote) {
+            m_durable_lsn = lsn;
+            m_wal_bytes   = ckpt ? 0 : bytes + batch.size();
+        }
+        if (! ok)
+            m_failed = true;
+
+        if (ckpt)
+            m_checkpoint_requested = false;
+
+        m_durable.notify_all();
+
+        if (stop && m_pending.empty())
+            return;
+    }
+}
+
+// checkpoint: u32 magic, u64 lsn, u64 count, then per entry u32 key
+// length, key, u32 value length, value, and a u32 checksum of all of it
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::write_checkpoint(const tree_type &tree, lsn_type lsn)
+{
+    std::string tmp = m_path + ".ckpt.tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0)
+        return false;
+
+    std::string buf, data;
+    std::uint32_t sum = 0;
+    bool ok = true;
+
+    put_u32(buf, checkpoint_magic);
+    put_u64(buf, lsn);
+    put_u64(buf, tree.size());
+
+    typename tree_type::const_iterator it;
+    for (it = tree.begin(); ok && it != tree.end(); ++it) {
+        data.clear();
+        radix_tree_codec<K>::encode(it->first, data);
+        put_u32(buf, static_cast<std::uint32_t>(data.size()));
+        buf.append(data);
+
+        data.clear();
+        radix_tree_codec<T>::encode(it->second, data);
+        put_u32(buf, static_cast<std::uint32_t>(data.size()));
+        buf.append(data);
+
+        if (buf.size() >= (1 << 20)) {
+            sum ^= checksum(buf.data(), buf.size());
+            ok = write_all(fd, buf.data(), buf.size());
+            buf.clear();
+        }
+    }
+
+    sum ^= checksum(buf.data(), buf.size());
+    put_u32(buf, sum);
+
+    ok = ok && write_all(fd, buf.data(), buf.size()) && ::fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    ok = ok && ::rename(tmp.c_str(), (m_path + ".ckpt").c_str()) == 0 && sync_dir();
+
+    return ok;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::load_checkpoint(lsn_type &lsn)
+{
+    std::string in;
+
+    if (! read_file(m_path + ".ckpt", in))
+        return errno == ENOENT;
+
+    std::size_t pos = 0;
+    std::uint32_t magic;
+    std::uint64_t count;
+
+    if (! get_u32(in, pos, magic) || magic != checkpoint_magic)
+        return false;
+    if (! get_u64(in, pos, lsn) || ! get_u64(in, pos, count))
+        return false;
+
+    std::uint32_t sum = 0;
+    std::size_t chunk = 0;
+
+    for (std::uint64_t i = 0; i < count; i++) {
+        std::uint32_t len;
+        const char *data;
+        K key;
+        T val;
+
+        if (! get_u32(in, pos, len) || ! get_bytes(in, pos, len, data) || ! radix_tree_codec<K>::decode(data, len, key))
+            return false;
+        if (! get_u32(in, pos, len) || ! get_bytes(in, pos, len, data) || ! radix_tree_codec<T>::decode(data, len, val))
+            return false;
+
+        m_tree.insert(typename tree_type::value_type(key, val));
+
+        // the writer checksums in chunks of at least 1 MB
+        if (pos - chunk >= (1 << 20)) {
+            sum ^= checksum(in.data() + chunk, pos - chunk);
+            chunk = pos;
+        }
+    }
+
+    sum ^= checksum(in.data() + chunk, pos - chunk);
+
+    std::uint32_t stored;
+    if (! get_u32(in, pos, stored) || stored != sum)
+        return false;
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::replay(lsn_type from)
+{
+    std::string in;
+    std::string path = m_path + ".wal";
+
+    if (! read_file(path, in))
+        return errno == ENOENT;
+
+    std::size_t pos = 0, valid = 0;
+
+    for (;;) {
+        std::uint32_t len, sum;
+        const char *body;
+
+        if (! get_u32(in, pos, len) || ! get_u32(in, pos, sum) || ! get_bytes(in, pos, len, body))
+            break;
+        if (checksum(body, len) != sum)
+            break;
+
+        // the record is whole, so from here on what does not parse is
+        // not a torn write but a log this code cannot read
+        std::string rec(body, len);
+        std::size_t off = 1;
+        std::uint64_t lsn;
+        std::uint32_t key_len;
+        const char *data;
+        K key;
+
+        if (rec.empty() || (rec[0] != op_put && rec[0] != op_erase))
+            return false;
+        if (! get_u64(rec, off, lsn) || ! get_u32(rec, off, key_len) ||
+            ! get_bytes(rec, off, key_len, data) || ! radix_tree_codec<K>::decode(data, key_len, key))
+            return false;
+
+        if (lsn > from) {
+            if (rec[0] == op_put) {
+                std::uint32_t val_len;
+                T val;
+
+                if (! get_u32(rec, off, val_len) || ! get_bytes(rec, off, val_len, data) ||
+                    ! radix_tree_codec<T>::decode(data, val_len, val))
+                    return false;
+
+                std::pair<typename tree_type::iterator, bool> ret;
+                ret = m_tree.insert(typename tree_type::value_type(key, val));
+                if (! ret.second)
+                    ret.first->second = val;
+            } else {
+                m_tree.erase(key);
+            }
+
+            m_last_lsn = m_durable_lsn = lsn;
+        }
+
+        valid = pos;
+    }
+
+    // drop a record torn by the crash, so that new records follow good ones
+    if (valid != in.size() && ::truncate(path.c_str(), valid) != 0)
+        return false;
+
+    m_wal_bytes = valid;
+
+    return true;
+}
+
+// FNV-1a
+template <typename K, typename T, class Compare, class Stats>
+std::uint32_t durable_radix_tree<K, T, Compare, Stats>::checksum(const char *data, std::size_t len)
+{
+    std::uint32_t hash = 2166136261u;
+
+    for (std::size_t i = 0; i < len; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void durable_radix_tree<K, T, Compare, Stats>::put_u32(std::string &out, std::uint32_t val)
+{
+    out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+template <typename K, typename T, class Compare, class Stats>
+void durable_radix_tree<K, T, Compare, Stats>::put_u64(std::string &out, std::uint64_t val)
+{
+    out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::get_u32(const std::string &in, std::size_t &pos, std::uint32_t &val)
+{
+    if (in.size() - pos < sizeof(val))
+        return false;
+
+    std::memcpy(&val, in.data() + pos, sizeof(val));
+    pos += sizeof(val);
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::get_u64(const std::string &in, std::size_t &pos, std::uint64_t &val)
+{
+    if (in.size() - pos < sizeof(val))
+        return false;
+
+    std::memcpy(&val, in.data() + pos, sizeof(val));
+    pos += sizeof(val);
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::get_bytes(const std::string &in, std::size_t &pos, std::size_t len, const char *&data)
+{
+    if (in.size() - pos < len)
+        return false;
+
+    data = in.data() + pos;
+    pos += len;
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::read_file(const std::string &path, std::string &data)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    char buf[65536];
+    ssize_t n;
+
+    data.clear();
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0)
+        data.append(buf, n);
+
+    int err = errno;
+    ::close(fd);
+    errno = err;
+
+    return n == 0;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::write_all(int fd, const char *data, std::size_t len)
+{
+    while (len > 0) {
+        ssize_t n = ::write(fd, data, len);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data += n;
+        len  -= n;
+    }
+
+    return true;
+}
+
+template <typename K, typename T, class Compare, class Stats>
+bool durable_radix_tree<K, T, Compare, Stats>::sync_dir() const
+{
+    std::string::size_type slash = m_path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : m_path.substr(0, slash + 1);
+
+    int fd = ::open(dir.c_str(), O_RDONLY);
+
+    if (fd < 0)
+        return false;
+
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+
+    return ok;
+}
+
+#endif // RADIX_TREE_WAL_HPP
@@ -0,0 +1,267 @@
+#include "common.hpp"
+
+#include <radix_tree_arena.hpp>
+#include <sstream>
+
+typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_counting_stats> counted_tree_t;
+
+static std::string key_of(int i)
+{
+    std::ostringstream os;
+    os << "host" << i << ".example.com";
+    return os.str();
+}
+
+TEST(arena, nodes_come_from_the_arena)
+{
+    radix_tree_arena arena;
+    counted_tree_t tree;
+    tree.set_memory_resource(&arena);
+    ASSERT_EQ(&arena, tree.memory_resource());
+
+    for (int i = 0; i < 10000; i++)
+        tree[key_of(i)] = i;
+
+    ASSERT_EQ(1u, arena.regions());
+    ASSERT_LT(0u, arena.bytes_in_use());
+    for (int i = 0; i < 10000; i++)
+        ASSERT_EQ(i, tree.find(key_of(i))->second);
+
+    const radix_tree_counters &c = tree.stats().counters();
+    // every live node is in the arena, along with its entry
+    ASSERT_LE(10001u, c.allocs - c.frees);
+    ASSERT_LE((c.allocs - c.frees) * sizeof(void*), arena.bytes_in_use());
+
+    for (int i = 0; i < 10000; i += 2)
+        ASSERT_TRUE(tree.erase(key_of(i)));
+    size_t in_use = arena.bytes_in_use();
+
+    // freed blocks are reused before the region grows
+    for (int i = 0; i < 10000; i += 2)
+        tree[key_of(i)] = i;
+    ASSERT_LT(in_use, arena.bytes_in_use());
+    ASSERT_EQ(1u, arena.regions());
+
+    tree.clear();
+    ASSERT_EQ(0u, arena.bytes_in_use());
+}
+
+TEST(arena, moving_between_resources)
+{
+    radix_tree_arena arena1, arena2;
+    tree_t tree;
+    tree["apache"] = 0;
+    tree["apple"]  = 1;
+    tree["bind"]   = 2;
+
+    tree_t snap = tree.snapshot();
+
+    tree.set_memory_resource(&arena1);
+    ASSERT_LT(0u, arena1.bytes_in_use());
+    ASSERT_EQ(1, tree.find("apple")->second);
+    ASSERT_EQ(NULL, snap.memory_resource());
+
+    // copies allocate where the source does
+    tree_t copy(tree);
+    copy["cvs"] = 3;
+    ASSERT_EQ(&arena1, copy.memory_resource());
+    copy.set_memory_resource(&arena2);
+    ASSERT_LT(0u, arena2.bytes_in_use());
+
+    size_t in_use = arena1.bytes_in_use();
+    copy.clear();
+    ASSERT_EQ(0u, arena2.bytes_in_use());
+    ASSERT_EQ(in_use, arena1.bytes_in_use());
+
+    tree.set_memory_resource(NULL);
+    ASSERT_EQ(0u, arena1.bytes_in_use());
+    ASSERT_EQ(3u, tree.size());
+    ASSERT_EQ(2, tree.find("bind")->second);
+}
+
+TEST(arena, merge_across_resources)
+{
+    radix_tree_arena arena1, arena2;
+    tree_t a, b;
+    a.set_memory_resource(&arena1);
+    b.set_memory_resource(&arena2);
+
+    a["apple"] = 1;
+    a["bind"]  = 2;
+    b["apple"] = 10;
+    b["apache"] = 11;
+    b["cvs"]   = 12;
+
+    a.merge(b);
+    ASSERT_EQ(4u, a.size());
+    ASSERT_EQ(11, a.find("apache")->second);
+    ASSERT_EQ(1u, b.size());
+    ASSERT_EQ(10, b.find("apple")->second);
+    ASSERT_EQ(&arena2, b.memory_resource());
+
+    b.clear();
+    ASSERT_EQ(0u, arena2.bytes_in_use());
+    a.clear();
+    ASSERT_EQ(0u, arena1.bytes_in_use());
+}
+
+// the global heap, until it has handed out budget more blocks
+class limited_resource : public radix_tree_memory_resource {
+public:
+    explicit limited_resource(int budget) : budget(budget) { }
+
+    void* allocate(std::size_t size) {
+        if (budget-- <= 0)
+            throw std::bad_alloc();
+        return ::operator new(size);
+    }
+    void deallocate(void *p, std::size_t) {
+        ::operator delete(p);
+    }
+
+    int budget;
+};
+
+TEST(arena, failed_merge_keeps_other)
+{
+    limited_resource limited(1000);
+    tree_t a, b;
+    b.set_memory_resource(&limited);
+
+    a["apple"] = 1;
+    for (int i = 0; i < 100; i++)
+        b[key_of(i)] = i;
+
+    // the entries left in b cannot be copied back into its resource
+    limited.budget = 0;
+    ASSERT_THROW(a.merge(b), std::bad_alloc);
+
+    ASSERT_EQ(100u, b.size());
+    for (int i = 0; i < 100; i++)
+        ASSERT_EQ(i, b.find(key_of(i))->second);
+    // the copies merged before the throw stay in a as well
+    ASSERT_EQ(1, a.find("apple")->second);
+    ASSERT_LE(1u, a.size());
+    ASSERT_GE(101u, a.size());
+}
+
+TEST(arena, numa_binding)
+{
+    radix_tree_arena arena(0);
+    tree_t tree;
+    tree.set_memory_resource(&arena);
+    tree["apple"] = 1;
+
+    ASSERT_EQ(1u, arena.regions());
+    // binding needs a NUMA kernel, so it may not have happened
+    ASSERT_GE(1u, arena.bound_regions());
+    ASSERT_GE(1u, arena.huge_regions());
+}
+
+TEST(arena, replicas)
+{
+    tree_t tree;
+    for (int i = 0; i < 1000; i++)
+        tree[key_of(i)] = i;
+
+    radix_tree_replicas<tree_t> replicas(tree, 2);
+    ASSERT_EQ(2, replicas.size());
+
+    for (int n = 0; n < replicas.size(); n++) {
+        const tree_t &replica = replicas.replica(n);
+        ASSERT_EQ(&replicas.arena(n), replica.memory_resource());
+        ASSERT_LT(0u, replicas.arena(n).bytes_in_use());
+        ASSERT_EQ(1000u, replica.size());
+        ASSERT_EQ(7, replica.find(key_of(7))->second);
+    }
+    ASSERT_EQ(1000u, replicas.local().size());
+
+    tree.erase(key_of(7));
+    replicas.assign(tree);
+    ASSERT_EQ(replicas.replica(1).end(), replicas.replica(1).find(key_of(7)));
+    ASSERT_EQ(999u, replicas.replica(0).size());
+}
+
+// stands in for a tree whose copy into a replica throws
+struct throwing_tree {
+    static int live;
+
+    throwing_tree() { live++; }
+    throwing_tree(const throwing_tree &) { live++; }
+    ~throwing_tree() { live--; }
+    throwing_tree& operator =(const throwing_tree &) {
+        throw std::bad_alloc();
+    }
+    void set_memory_resource(radix_tree_memory_resource *) { }
+};
+
+int throwing_tree::live = 0;
+
+TEST(arena, failed_replicas_free_what_they_made)
+{
+    throwing_tree tree;
+    ASSERT_THROW(radix_tree_replicas<throwing_tree> replicas(tree, 3), std::bad_alloc);
+    ASSERT_EQ(1, throwing_tree::live);
+}
+
+TEST(arena, copy_moved_off_the_arena)
+{
+    radix_tree_arena arena;
+    tree_t tree;
+    tree.set_memory_resource(&arena);
+    for (int i = 0; i < 100; i++)
+        tree[key_of(i)] = i;
+
+    // what another thread may own: nothing of it is in the arena
+    tree_t copy(tree);
+    copy.set_memory_resource(NULL);
+
+    tree.clear();
+    ASSERT_EQ(0u, arena.bytes_in_use());
+    ASSERT_EQ(100u, copy.size());
+    ASSERT_EQ(7, copy.find(key_of(7))->second);
+}
+
+// hands out blocks from the global heap and counts what is outstanding
+class counting_resource : public radix_tree_memory_resource {
+public:
+    counting_resource() : bytes(0), blocks(0) { }
+
+    void* allocate(std::size_t size) {
+        bytes += size;
+        blocks++;
+        return ::operator new(size);
+    }
+    void deallocate(void *p, std::size_t size) {
+        bytes -= size;
+        blocks--;
+        ::operator delete(p);
+    }
+
+    size_t bytes;
+    size_t blocks;
+};
+
+TEST(arena, child_arrays_come_from_the_resource)
+{
+    counting_resource res;
+    counted_tree_t tree;
+    tree.set_memory_resource(&res);
+
+    for (int i = 0; i < 256; i++)
+        tree[std::string(1, static_cast<char>(i))] = i;
+
+    // one node and one entry per key, the root, and its child array
+    const radix_tree_counters &c = tree.stats().counters();
+    ASSERT_EQ(c.allocs - c.frees + tree.size() + 1, res.blocks);
+
+    for (int i = 0; i < 200; i++)
+        ASSERT_TRUE(tree.erase(std::string(1, static_cast<char>(i))));
+    size_t before = res.bytes;
+    ASSERT_LT(0u, tree.compact());
+    ASSERT_GT(before, res.bytes);
+
+    tree.clear();
+    ASSERT_EQ(0u, res.blocks);
+    ASSERT_EQ(0u, res.bytes);
+}
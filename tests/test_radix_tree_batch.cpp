@@ -0,0 +1,167 @@
+#include "common.hpp"
+
+#include <cstdlib>
+#include <sstream>
+
+typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_counting_stats> counted_tree_t;
+
+static std::string route_of(int i)
+{
+    std::ostringstream os;
+    os << "10." << i / 250 % 250 << "." << i % 250 << ".0/24";
+    return os.str();
+}
+
+static tree_t::mutation_type mutation(tree_t::mutation_kind kind, const std::string &key, int value = 0)
+{
+    tree_t::mutation_type mut = { kind, key, value };
+    return mut;
+}
+
+TEST(batch, insert_assign_erase)
+{
+    tree_t tree;
+    tree["apple"] = 1;
+    tree["banana"] = 2;
+
+    std::vector<tree_t::mutation_type> batch;
+    batch.push_back(mutation(tree_t::mutation_insert, "apple", 10));   // kept
+    batch.push_back(mutation(tree_t::mutation_insert, "apricot", 3));
+    batch.push_back(mutation(tree_t::mutation_assign, "banana", 20));
+    batch.push_back(mutation(tree_t::mutation_erase,  "blueberry"));   // absent
+    batch.push_back(mutation(tree_t::mutation_assign, "cherry", 4));
+
+    ASSERT_EQ(3u, tree.apply_batch(batch));
+    ASSERT_EQ(4u, tree.size());
+    ASSERT_EQ(1, tree["apple"]);
+    ASSERT_EQ(3, tree["apricot"]);
+    ASSERT_EQ(20, tree["banana"]);
+    ASSERT_EQ(4, tree["cherry"]);
+
+    batch.clear();
+    batch.push_back(mutation(tree_t::mutation_erase, "apple"));
+    batch.push_back(mutation(tree_t::mutation_erase, "apricot"));
+    batch.push_back(mutation(tree_t::mutation_erase, "banana"));
+    batch.push_back(mutation(tree_t::mutation_erase, "cherry"));
+
+    ASSERT_EQ(4u, tree.apply_batch(batch));
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQ(tree.end(), tree.begin());
+
+    ASSERT_EQ(0u, tree.apply_batch(std::vector<tree_t::mutation_type>()));
+}
+
+TEST(batch, erase_then_insert_below)
+{
+    counted_tree_t tree;
+    tree["ab"] = 1;
+    tree["abc"] = 2;
+    tree["abd"] = 3;
+    tree.stats().reset();
+
+    // one at a time, erasing "abc" merges "ab" into "abd" and inserting
+    // "abce" splits it again; in one batch the node stays for "abce"
+    std::vector<counted_tree_t::mutation_type> batch;
+    counted_tree_t::mutation_type erase_ab  = { counted_tree_t::mutation_erase, "ab", 0 };
+    counted_tree_t::mutation_type erase_abc = { counted_tree_t::mutation_erase, "abc", 0 };
+    counted_tree_t::mutation_type add_abce  = { counted_tree_t::mutation_insert, "abce", 5 };
+    batch.push_back(erase_ab);
+    batch.push_back(erase_abc);
+    batch.push_back(add_abce);
+
+    ASSERT_EQ(3u, tree.apply_batch(batch));
+    ASSERT_EQ(0u, tree.stats().counters().splits);
+    ASSERT_EQ(1u, tree.stats().counters().merges);
+
+    std::vector<std::string> keys;
+    for (counted_tree_t::iterator it = tree.begin(); it != tree.end(); ++it)
+        keys.push_back(it->first);
+    ASSERT_EQ(2u, keys.size());
+    ASSERT_EQ("abce", keys[0]);
+    ASSERT_EQ("abd", keys[1]);
+
+    std::vector<counted_tree_t::iterator> vec;
+    tree.prefix_match("abc", vec);
+    ASSERT_EQ(1u, vec.size());
+}
+
+TEST(batch, shares_descents)
+{
+    std::vector<counted_tree_t::mutation_type> batch;
+    for (int i = 0; i < 20000; i++) {
+        counted_tree_t::mutation_type mut = { counted_tree_t::mutation_insert, route_of(i), i };
+        batch.push_back(mut);
+    }
+    std::sort(batch.begin(), batch.end(), [](const counted_tree_t::mutation_type &a, const counted_tree_t::mutation_type &b) {
+        return a.key < b.key;
+    });
+
+    counted_tree_t one_by_one, batched;
+    for (size_t i = 0; i < batch.size(); i++)
+        one_by_one.insert(std::make_pair(batch[i].key, batch[i].value));
+    ASSERT_EQ(batch.size(), batched.apply_batch(batch));
+
+    ASSERT_EQ(one_by_one.size(), batched.size());
+    ASSERT_LT(batched.stats().counters().nodes_visited * 2, one_by_one.stats().counters().nodes_visited);
+
+    counted_tree_t::iterator a = one_by_one.begin(), b = batched.begin();
+    for (; a != one_by_one.end(); ++a, ++b) {
+        ASSERT_EQ(a->first, b->first);
+        ASSERT_EQ(a->second, b->second);
+    }
+    ASSERT_EQ(batched.end(), b);
+}
+
+TEST(batch, random_against_map)
+{
+    tree_t tree;
+    std::map<std::string, int> model;
+
+    tree.set_cache_size(64);
+    tree.set_filter_size(1024);
+    srand(5);
+
+    for (int round = 0; round < 200; round++) {
+        std::vector<tree_t::mutation_type> batch;
+        size_t expected = 0;
+
+        for (int n = rand() % 50; n > 0; n--) {
+            std::string key;
+            for (int l = rand() % 5; l > 0; l--)
+                key += static_cast<char>('a' + rand() % 3);
+            batch.push_back(mutation(static_cast<tree_t::mutation_kind>(rand() % 3), key, round * 100 + n));
+        }
+        // sorted batches mostly, some in arbitrary order
+        if (round % 4 != 0) {
+            std::stable_sort(batch.begin(), batch.end(), [](const tree_t::mutation_type &a, const tree_t::mutation_type &b) {
+                return a.key < b.key;
+            });
+        }
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            const tree_t::mutation_type &mut = batch[i];
+
+            if (mut.kind == tree_t::mutation_erase) {
+                expected += model.erase(mut.key);
+            } else if (mut.kind == tree_t::mutation_assign || model.count(mut.key) == 0) {
+                model[mut.key] = mut.value;
+                expected++;
+            }
+        }
+
+        ASSERT_EQ(expected, tree.apply_batch(batch));
+        ASSERT_EQ(model.size(), tree.size());
+
+        std::map<std::string, int>::iterator mit = model.begin();
+        for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it, ++mit) {
+            ASSERT_EQ(mit->first, it->first);
+            ASSERT_EQ(mit->second, it->second);
+        }
+        for (int i = 0; i < 20; i++) {
+            std::string key;
+            for (int l = rand() % 5; l > 0; l--)
+                key += static_cast<char>('a' + rand() % 3);
+            ASSERT_EQ(model.count(key) == 1, tree.find(key) != tree.end());
+        }
+    }
+}
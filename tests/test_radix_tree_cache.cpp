@@ -0,0 +1,154 @@
+#include "common.hpp"
+
+#include <sstream>
+#include <thread>
+
+typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_counting_stats> counted_tree_t;
+
+static bool is_odd(const std::string &key)
+{
+    return key.size() % 2 == 1;
+}
+
+TEST(cache, hits_and_misses)
+{
+    counted_tree_t tree;
+    tree.set_cache_size(100);
+    ASSERT_EQ(128u, tree.cache_size());
+
+    tree["apache"] = 0;
+    tree["apple"]  = 1;
+    tree["bind"]   = 2;
+
+    tree.stats().reset();
+
+    ASSERT_NE(tree.end(), tree.find("apple"));
+    ASSERT_EQ(0u, tree.stats().counters().cache_hits);
+    ASSERT_EQ(1u, tree.stats().counters().cache_misses);
+    ASSERT_EQ(1u, tree.stats().counters().lookups);
+
+    const counted_tree_t &ctree = tree;
+    for (int i = 0; i < 10; i++) {
+        counted_tree_t::const_iterator it = ctree.find("apple");
+        ASSERT_NE(ctree.end(), it);
+        ASSERT_EQ(1, it->second);
+    }
+    ASSERT_EQ(10u, tree.stats().counters().cache_hits);
+    ASSERT_EQ(1u, tree.stats().counters().lookups);
+
+    // misses are not cached
+    ASSERT_EQ(tree.end(), tree.find("app"));
+    ASSERT_EQ(tree.end(), tree.find("app"));
+    ASSERT_EQ(3u, tree.stats().counters().cache_misses);
+
+    tree.set_cache_size(0);
+    ASSERT_EQ(0u, tree.cache_size());
+    ASSERT_NE(tree.end(), tree.find("apple"));
+    ASSERT_EQ(10u, tree.stats().counters().cache_hits);
+    ASSERT_EQ(3u, tree.stats().counters().cache_misses);
+}
+
+TEST(cache, invalidated_by_mutations)
+{
+    tree_t tree;
+    tree.set_cache_size(1024);
+
+    for (int i = 0; i < 200; i++) {
+        std::ostringstream os;
+        os << "key" << i;
+        tree[os.str()] = i;
+    }
+    for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it)
+        ASSERT_EQ(it->second, tree.find(it->first)->second);
+
+    ASSERT_TRUE(tree.erase("key17"));
+    ASSERT_EQ(tree.end(), tree.find("key17"));
+    // erasing key17 merges key170..key179 into its place
+    ASSERT_EQ(170, tree.find("key170")->second);
+
+    tree["key17"] = -17;
+    ASSERT_EQ(-17, tree.find("key17")->second);
+
+    ASSERT_EQ(11u, tree.erase_prefix("key3"));
+    ASSERT_EQ(tree.end(), tree.find("key3"));
+    ASSERT_EQ(tree.end(), tree.find("key35"));
+
+    ASSERT_NE(tree.end(), tree.find("key55"));
+    tree.remove_if(is_odd);
+    ASSERT_NE(tree.end(), tree.find("key5"));
+    ASSERT_EQ(tree.end(), tree.find("key55"));
+
+    tree_t other;
+    other["key5"] = 5;
+    other["key55"] = 55;
+    other.set_cache_size(16);
+    ASSERT_NE(other.end(), other.find("key5"));
+    ASSERT_NE(other.end(), other.find("key55"));
+    tree.merge(other);
+    ASSERT_EQ(55, tree.find("key55")->second);
+    ASSERT_EQ(other.end(), other.find("key55"));
+    ASSERT_NE(other.end(), other.find("key5"));
+
+    tree_t empty;
+    tree.intersect(empty);
+    ASSERT_EQ(tree.end(), tree.find("key55"));
+
+    tree["key1"] = 1;
+    ASSERT_NE(tree.end(), tree.find("key1"));
+    tree.clear();
+    ASSERT_EQ(tree.end(), tree.find("key1"));
+}
+
+TEST(cache, copy_on_write)
+{
+    tree_t tree;
+    tree.set_cache_size(64);
+    tree["apple"] = 1;
+    ASSERT_EQ(1, tree.find("apple")->second);
+
+    tree_t snap = tree.snapshot();
+    ASSERT_EQ(0u, snap.cache_size());
+
+    tree["apple"] = 2;
+    ASSERT_EQ(2, tree.find("apple")->second);
+    ASSERT_EQ(1, snap.find("apple")->second);
+}
+
+TEST(cache, concurrent_readers)
+{
+    typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_thread_stats> thread_tree_t;
+
+    thread_tree_t tree;
+    tree.set_cache_size(256);
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 500; i++) {
+        std::ostringstream os;
+        os << "host" << i << ".example.com";
+        keys.push_back(os.str());
+        tree[os.str()] = i;
+    }
+
+    const thread_tree_t &ctree = tree;
+    std::vector<std::thread> readers;
+    std::vector<int> errors(4, 0);
+
+    for (int t = 0; t < 4; t++) {
+        readers.push_back(std::thread([&ctree, &keys, &errors, t]() {
+            for (int round = 0; round < 20; round++) {
+                for (size_t i = 0; i < keys.size(); i++) {
+                    thread_tree_t::const_iterator it = ctree.find(keys[(i * 7 + t) % keys.size()]);
+                    if (it == ctree.end() || it->first != keys[(i * 7 + t) % keys.size()])
+                        errors[t]++;
+                }
+            }
+            if (radix_tree_thread_stats::counters().cache_hits == 0)
+                errors[t]++;
+        }));
+    }
+    for (size_t t = 0; t < readers.size(); t++)
+        readers[t].join();
+
+    for (size_t t = 0; t < errors.size(); t++)
+        ASSERT_EQ(0, errors[t]);
+}
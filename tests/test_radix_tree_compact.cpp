@@ -0,0 +1,185 @@
+#include "common.hpp"
+
+#include <radix_tree_arena.hpp>
+#include <cstdlib>
+#include <sstream>
+
+typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_counting_stats> counted_tree_t;
+
+static std::string path_of(int i)
+{
+    std::ostringstream os;
+    os << "/srv/" << i % 7 << "/data/" << i % 101 << "/" << i;
+    return os.str();
+}
+
+static void expect_same(tree_t &tree, const std::map<std::string, int> &model)
+{
+    ASSERT_EQ(model.size(), tree.size());
+
+    std::map<std::string, int>::const_iterator mit = model.begin();
+    for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it, ++mit) {
+        ASSERT_EQ(mit->first, it->first);
+        ASSERT_EQ(mit->second, it->second);
+    }
+    for (mit = model.begin(); mit != model.end(); ++mit) {
+        tree_t::iterator it = tree.find(mit->first);
+        ASSERT_NE(tree.end(), it);
+        ASSERT_EQ(mit->second, it->second);
+    }
+}
+
+TEST(compact, whole_tree)
+{
+    tree_t tree;
+    std::map<std::string, int> model;
+
+    for (int i = 0; i < 5000; i++) {
+        tree[path_of(i)] = i;
+        model[path_of(i)] = i;
+    }
+    // churn leaves child arrays with room for siblings long gone
+    for (int i = 0; i < 5000; i++) {
+        if (i % 3 != 0) {
+            tree.erase(path_of(i));
+            model.erase(path_of(i));
+        }
+    }
+
+    int &ref = tree[path_of(3)];
+
+    ASSERT_GT(tree.compact(), 0u);
+    ASSERT_FALSE(tree.compacting());
+    expect_same(tree, model);
+
+    // entries did not move
+    ASSERT_EQ(&ref, &tree[path_of(3)]);
+
+    // nothing left to trim
+    ASSERT_EQ(0u, tree.compact());
+}
+
+TEST(compact, bounded_steps)
+{
+    radix_tree_arena arena;
+    counted_tree_t tree;
+    tree.set_memory_resource(&arena);
+
+    for (int i = 0; i < 2000; i++)
+        tree[path_of(i)] = i;
+    tree.stats().reset();
+
+    size_t calls = 0;
+    do {
+        tree.compact(100);
+        calls++;
+    } while (tree.compacting());
+
+    // every node moved once, and no pass went round twice
+    ASSERT_EQ(tree.stats().counters().allocs, tree.stats().counters().frees);
+    ASSERT_LE(tree.stats().counters().allocs, 2 * tree.size());
+    ASSERT_EQ((tree.stats().counters().allocs + 99) / 100, calls);
+    ASSERT_EQ(0u, tree.stats().counters().merges);
+}
+
+TEST(compact, nodes_stay_on_the_heap)
+{
+    counted_tree_t tree;
+
+    for (int i = 0; i < 2000; i++)
+        tree[path_of(i)] = i;
+    for (int i = 0; i < 2000; i += 2)
+        tree.erase(path_of(i));
+    tree.stats().reset();
+
+    // without a resource there is no order to move the nodes into
+    ASSERT_GT(tree.compact(), 0u);
+    ASSERT_EQ(0u, tree.stats().counters().allocs);
+    ASSERT_EQ(0u, tree.stats().counters().frees);
+    ASSERT_EQ(0u, tree.compact());
+}
+
+// the global heap, counting the bytes asked for
+class counting_resource : public radix_tree_memory_resource {
+public:
+    counting_resource() : bytes(0) { }
+
+    void* allocate(std::size_t size) {
+        bytes += size;
+        return ::operator new(size);
+    }
+    void deallocate(void *p, std::size_t size) {
+        bytes -= size;
+        ::operator delete(p);
+    }
+
+    size_t bytes;
+};
+
+TEST(compact, reclaimed_is_what_the_resource_gets_back)
+{
+    counting_resource res;
+    tree_t tree;
+    tree.set_memory_resource(&res);
+
+    for (int i = 0; i < 5000; i++)
+        tree[path_of(i)] = i;
+    for (int i = 0; i < 5000; i++) {
+        if (i % 3 != 0)
+            tree.erase(path_of(i));
+    }
+
+    // the labels are cut to size already, so all of it is nodes and arrays
+    size_t in_use = res.bytes;
+    size_t reclaimed = tree.compact();
+    ASSERT_GT(reclaimed, 0u);
+    ASSERT_EQ(in_use - res.bytes, reclaimed);
+
+    tree.clear();
+    ASSERT_EQ(0u, res.bytes);
+}
+
+TEST(compact, churn_between_steps)
+{
+    tree_t tree;
+    std::map<std::string, int> model;
+
+    tree.set_cache_size(256);
+    tree.set_filter_size(4096);
+    srand(3);
+
+    for (int round = 0; round < 300; round++) {
+        for (int n = 0; n < 40; n++) {
+            std::string key = path_of(rand() % 3000);
+
+            if (rand() % 3 == 0) {
+                ASSERT_EQ(model.erase(key), tree.erase(key));
+            } else {
+                tree[key] = round;
+                model[key] = round;
+            }
+        }
+
+        // a cached node moved by compact() must still be found
+        if (! model.empty()) {
+            ASSERT_NE(tree.end(), tree.find(model.begin()->first));
+        }
+
+        tree.compact(1 + rand() % 50);
+        expect_same(tree, model);
+    }
+
+    while (tree.compacting())
+        tree.compact(64);
+    expect_same(tree, model);
+
+    // a copy is unshared before its nodes move
+    tree_t copy(tree);
+    copy.compact();
+    expect_same(tree, model);
+    expect_same(copy, model);
+
+    tree.clear();
+    ASSERT_FALSE(tree.compacting());
+    ASSERT_EQ(0u, tree.compact());
+}
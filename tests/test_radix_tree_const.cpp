@@ -0,0 +1,99 @@
+#include "common.hpp"
+
+#include <thread>
+
+typedef std::vector<tree_t::const_iterator> vector_const_found_t;
+
+static void fill(tree_t &tree)
+{
+    tree["abcdef"] = 1;
+    tree["abcdege"] = 2;
+    tree["bcdef"] = 3;
+    tree["cd"] = 4;
+    tree["ce"] = 5;
+    tree["c"] = 6;
+}
+
+TEST(const_api, matches_mutable_api)
+{
+    tree_t tree;
+    fill(tree);
+    const tree_t &ctree = tree;
+
+    {
+        SCOPED_TRACE("iteration");
+        tree_t::iterator it = tree.begin();
+        tree_t::const_iterator cit = ctree.begin();
+        for (; it != tree.end(); ++it, ++cit) {
+            ASSERT_NE(ctree.end(), cit);
+            ASSERT_EQ(it->first, cit->first);
+            ASSERT_EQ((*it).second, (*cit).second);
+        }
+        ASSERT_EQ(ctree.end(), cit);
+    }
+    {
+        SCOPED_TRACE("find and longest_match");
+        ASSERT_EQ(3, ctree.find("bcdef")->second);
+        ASSERT_EQ(ctree.end(), ctree.find("bcde"));
+        ASSERT_EQ("ce", ctree.longest_match("ced")->first);
+        ASSERT_EQ(ctree.end(), ctree.longest_match("d"));
+    }
+    {
+        SCOPED_TRACE("prefix_match and greedy_match");
+        vector_const_found_t cvec;
+        vector_found_t vec;
+        ctree.prefix_match("c", cvec);
+        tree.prefix_match("c", vec);
+        ASSERT_EQ(vec.size(), cvec.size());
+        for (size_t i = 0; i < vec.size(); i++)
+            ASSERT_EQ(tree_t::const_iterator(vec[i]), cvec[i]);
+
+        ctree.greedy_match("abcdx", cvec);
+        ASSERT_EQ(2u, cvec.size());
+    }
+    {
+        SCOPED_TRACE("iterator converts to const_iterator");
+        tree_t::const_iterator cit = tree.find("cd");
+        ASSERT_EQ(4, cit->second);
+        ASSERT_TRUE(cit == tree.find("cd"));
+    }
+}
+
+TEST(const_api, reads_do_not_unshare)
+{
+    tree_t tree;
+    fill(tree);
+    const tree_t snap = tree.snapshot();
+
+    ASSERT_EQ(6, std::distance(snap.begin(), snap.end()));
+    ASSERT_NE(snap.end(), snap.find("c"));
+    ASSERT_TRUE(snap.shared());
+    ASSERT_TRUE(tree.shared());
+}
+
+TEST(const_api, concurrent_readers)
+{
+    std::vector<std::string> unique_keys = get_unique_keys();
+    tree_t tree;
+    for (size_t i = 0; i < unique_keys.size(); i++)
+        tree[unique_keys[i]] = int(i);
+    const tree_t &ctree = tree;
+
+    std::vector<int> found(4, 0);
+    std::vector<std::thread> readers;
+    for (size_t t = 0; t < found.size(); t++) {
+        readers.push_back(std::thread([&ctree, &unique_keys, &found, t]() {
+            for (int round = 0; round < 100; round++) {
+                for (size_t i = 0; i < unique_keys.size(); i++) {
+                    if (ctree.find(unique_keys[i]) != ctree.end())
+                        found[t]++;
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < readers.size(); t++)
+        readers[t].join();
+
+    for (size_t t = 0; t < found.size(); t++)
+        ASSERT_EQ(int(100 * unique_keys.size()), found[t]);
+}
@@ -128,3 +128,110 @@ TEST(erase, empty_key)
         }
     }
 }
+
+TEST(erase, erase_prefix)
+{
+    tree_t tree;
+    tree["apache"]    = 0;
+    tree["afford"]    = 1;
+    tree["available"] = 2;
+    tree["affair"]    = 3;
+    tree["avenger"]   = 4;
+    tree["binary"]    = 5;
+    tree["bind"]      = 6;
+    tree["a"]         = 7;
+
+    {
+        SCOPED_TRACE("prefix inside an edge");
+        ASSERT_EQ(2u, tree.erase_prefix("af"));
+        ASSERT_EQ(6u, tree.size());
+        ASSERT_EQ(tree.end(), tree.find("afford"));
+        ASSERT_EQ(tree.end(), tree.find("affair"));
+        ASSERT_NE(tree.end(), tree.find("apache"));
+    }
+    {
+        SCOPED_TRACE("prefix that is a key itself");
+        ASSERT_EQ(4u, tree.erase_prefix("a"));
+        ASSERT_EQ(2u, tree.size());
+        ASSERT_EQ(tree.end(), tree.find("a"));
+        ASSERT_EQ(tree.end(), tree.find("avenger"));
+    }
+    {
+        SCOPED_TRACE("prefix not in tree");
+        ASSERT_EQ(0u, tree.erase_prefix("bindx"));
+        ASSERT_EQ(0u, tree.erase_prefix("c"));
+        ASSERT_EQ(2u, tree.size());
+    }
+    {
+        SCOPED_TRACE("remaining keys are intact");
+        ASSERT_EQ(5, tree["binary"]);
+        ASSERT_EQ(6, tree["bind"]);
+        vector_found_t vec;
+        tree.prefix_match("bin", vec);
+        ASSERT_EQ(2u, vec.size());
+    }
+    {
+        SCOPED_TRACE("empty prefix erases everything");
+        ASSERT_EQ(2u, tree.erase_prefix(""));
+        ASSERT_EQ(0u, tree.size());
+        ASSERT_EQ(tree.begin(), tree.end());
+    }
+}
+
+struct starts_with_b {
+    bool operator() (const std::string &key) const {
+        return !key.empty() && key[0] == 'b';
+    }
+};
+
+struct longer_than_two {
+    bool operator() (const std::string &key) const {
+        return key.size() > 2;
+    }
+};
+
+TEST(erase, remove_if)
+{
+    std::vector<std::string> unique_keys = get_unique_keys();
+    tree_t tree;
+    for (size_t i = 0; i < unique_keys.size(); i++)
+        tree[unique_keys[i]] = int(i);
+    tree[""] = -1;
+
+    tree.remove_if(starts_with_b());
+    {
+        SCOPED_TRACE("matching keys are gone, the others stay");
+        for (size_t i = 0; i < unique_keys.size(); i++) {
+            const std::string &key = unique_keys[i];
+            if (starts_with_b()(key))
+                ASSERT_EQ(tree.end(), tree.find(key));
+            else
+                ASSERT_NE(tree.end(), tree.find(key));
+        }
+        ASSERT_NE(tree.end(), tree.find(""));
+        ASSERT_EQ(size_t(std::distance(tree.begin(), tree.end())), tree.size());
+    }
+
+    tree.remove_if(longer_than_two());
+    {
+        SCOPED_TRACE("paths are recompressed");
+        map_found_t expected;
+        expected[""] = -1;
+        expected["a"] = tree["a"];
+        expected["aa"] = tree["aa"];
+        expected["ab"] = tree["ab"];
+        map_found_t found;
+        for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it)
+            found[it->first] = it->second;
+        ASSERT_EQ(expected, found);
+        ASSERT_EQ(4u, tree.size());
+
+        tree["abc"] = 10;
+        ASSERT_EQ(10, tree.find("abc")->second);
+        tree.erase("a");
+        tree.erase("aa");
+        vector_found_t vec;
+        tree.prefix_match("ab", vec);
+        ASSERT_EQ(2u, vec.size());
+    }
+}
@@ -0,0 +1,132 @@
+#include "common.hpp"
+
+#include <sstream>
+
+typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_counting_stats> counted_tree_t;
+
+static std::string key_of(const char *prefix, int i)
+{
+    std::ostringstream os;
+    os << prefix << i;
+    return os.str();
+}
+
+static bool is_odd(const std::string &key)
+{
+    return key.size() % 2 == 1;
+}
+
+TEST(filter, rejects_misses)
+{
+    counted_tree_t tree;
+    for (int i = 0; i < 1000; i++)
+        tree[key_of("user", i)] = i;
+
+    tree.set_filter_size(6000);
+    ASSERT_EQ(8192u, tree.filter_size());
+
+    tree.stats().reset();
+    for (int i = 0; i < 1000; i++)
+        ASSERT_EQ(i, tree.find(key_of("user", i))->second);
+    ASSERT_EQ(0u, tree.stats().counters().filter_rejects);
+    ASSERT_EQ(0u, tree.stats().counters().filter_false_positives);
+
+    tree.stats().reset();
+    for (int i = 0; i < 10000; i++)
+        ASSERT_EQ(tree.end(), tree.find(key_of("spam", i)));
+
+    const radix_tree_counters &c = tree.stats().counters();
+    ASSERT_EQ(10000u, c.filter_rejects + c.filter_false_positives);
+    // rejected lookups never descend
+    ASSERT_EQ(c.filter_false_positives, c.lookups);
+    ASSERT_GT(0.05, c.filter_false_positive_rate());
+
+    tree.set_filter_size(0);
+    ASSERT_EQ(0u, tree.filter_size());
+    tree.stats().reset();
+    ASSERT_EQ(tree.end(), tree.find("spam"));
+    ASSERT_EQ(0u, tree.stats().counters().filter_rejects);
+    ASSERT_EQ(1u, tree.stats().counters().lookups);
+}
+
+// every key in the tree must pass the filter after each kind of mutation
+static void expect_all_found(const tree_t &tree)
+{
+    for (tree_t::const_iterator it = tree.begin(); it != tree.end(); ++it) {
+        tree_t::const_iterator found = tree.find(it->first);
+        ASSERT_EQ(it, found) << it->first;
+    }
+}
+
+TEST(filter, follows_mutations)
+{
+    tree_t tree;
+    tree.set_filter_size(1024);
+
+    for (int i = 0; i < 300; i++)
+        tree[key_of("key", i)] = i;
+    expect_all_found(tree);
+
+    for (int i = 0; i < 300; i += 3)
+        ASSERT_TRUE(tree.erase(key_of("key", i)));
+    for (int i = 0; i < 300; i++)
+        ASSERT_EQ(i % 3 != 0, tree.find(key_of("key", i)) != tree.end());
+
+    tree.erase_prefix("key1");
+    ASSERT_EQ(tree.end(), tree.find("key100"));
+    expect_all_found(tree);
+
+    tree.remove_if(is_odd);
+    expect_all_found(tree);
+
+    // keys counted out are counted back in
+    for (int i = 0; i < 300; i++)
+        tree[key_of("key", i)] = i;
+    expect_all_found(tree);
+    ASSERT_EQ(300u, tree.size());
+
+    tree_t other;
+    other.set_filter_size(256);
+    other["key5"]  = -5;
+    other["zone1"] = 1;
+    other["zone2"] = 2;
+    tree.merge(other);
+    ASSERT_EQ(1, tree.find("zone1")->second);
+    ASSERT_EQ(-5, other.find("key5")->second);
+    ASSERT_EQ(other.end(), other.find("zone1"));
+    expect_all_found(tree);
+    expect_all_found(other);
+
+    tree_t empty;
+    empty.set_filter_size(256);
+    empty.merge(other);
+    ASSERT_EQ(-5, empty.find("key5")->second);
+    ASSERT_EQ(other.end(), other.find("key5"));
+
+    tree_t small;
+    small["only"] = 1;
+    tree = small;
+    ASSERT_EQ(1, tree.find("only")->second);
+    expect_all_found(tree);
+
+    tree.clear();
+    ASSERT_EQ(tree.end(), tree.find("only"));
+    tree["again"] = 1;
+    ASSERT_EQ(1, tree.find("again")->second);
+}
+
+TEST(filter, saturated_counters)
+{
+    // far more keys than counters: every counter saturates, and the
+    // filter must still never reject a stored key
+    tree_t tree;
+    tree.set_filter_size(64);
+
+    for (int i = 0; i < 2000; i++)
+        tree[key_of("k", i)] = i;
+    for (int i = 0; i < 2000; i += 2)
+        tree.erase(key_of("k", i));
+
+    for (int i = 1; i < 2000; i += 2)
+        ASSERT_EQ(i, tree.find(key_of("k", i))->second);
+}
@@ -47,3 +47,77 @@ TEST(find, find_after_insert_or_erase)
         }
     }
 }
+
+static bool less_fn(const std::string &lhs, const std::string &rhs)
+{
+    return lhs < rhs;
+}
+
+template <class Tree>
+static void expect_finds(Tree &tree, const std::map<std::string, int> &model)
+{
+    ASSERT_EQ(model.size(), tree.size());
+    for (std::map<std::string, int>::const_iterator it = model.begin(); it != model.end(); ++it) {
+        typename Tree::iterator found = tree.find(it->first);
+        ASSERT_NE(tree.end(), found);
+        ASSERT_EQ(it->second, found->second);
+    }
+    ASSERT_EQ(tree.end(), tree.find(std::string("\x01\x02", 2)));
+}
+
+TEST(find, every_first_byte)
+{
+    // 256 children below the root, the high bytes sorting last
+    tree_t tree;
+    std::map<std::string, int> model;
+
+    for (int i = 0; i < 256; i++) {
+        std::string key(1, static_cast<char>(i));
+        tree[key] = i;
+        tree[key + "x"] = i + 256;
+        model[key] = i;
+        model[key + "x"] = i + 256;
+    }
+    expect_finds(tree, model);
+
+    std::map<std::string, int>::iterator mit = model.begin();
+    for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it, ++mit)
+        ASSERT_EQ(mit->first, it->first);
+
+    for (int i = 0; i < 256; i += 2) {
+        ASSERT_TRUE(tree.erase(std::string(1, static_cast<char>(i))));
+        model.erase(std::string(1, static_cast<char>(i)));
+    }
+    expect_finds(tree, model);
+}
+
+TEST(find, other_comparators)
+{
+    std::vector<std::string> keys = get_unique_keys();
+    std::map<std::string, int> model;
+
+    // siblings in descending order, which the lookups must not assume away
+    radix_tree<std::string, int, std::greater<std::string> > desc;
+    radix_tree<std::string, int, bool (*)(const std::string&, const std::string&)> by_fn(less_fn);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        desc[keys[i]] = static_cast<int>(i);
+        by_fn[keys[i]] = static_cast<int>(i);
+        model[keys[i]] = static_cast<int>(i);
+    }
+    expect_finds(desc, model);
+    expect_finds(by_fn, model);
+
+    ASSERT_EQ("b", desc.begin()->first);
+    ASSERT_EQ("bb", (++desc.begin())->first);
+    ASSERT_EQ("a", by_fn.begin()->first);
+
+    ASSERT_TRUE(desc.erase("ab"));
+    ASSERT_TRUE(by_fn.erase("ab"));
+    model.erase("ab");
+    expect_finds(desc, model);
+    expect_finds(by_fn, model);
+
+    // a stateless comparator takes no room in the tree
+    ASSERT_LT(sizeof(tree_t), sizeof(by_fn));
+}
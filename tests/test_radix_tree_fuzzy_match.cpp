@@ -0,0 +1,123 @@
+#include "common.hpp"
+
+#include <cstdlib>
+
+static int levenshtein(const std::string &a, const std::string &b)
+{
+    std::vector<int> row(b.size() + 1);
+
+    for (size_t j = 0; j <= b.size(); j++)
+        row[j] = static_cast<int>(j);
+
+    for (size_t i = 1; i <= a.size(); i++) {
+        int diag = row[0];
+        row[0] = static_cast<int>(i);
+
+        for (size_t j = 1; j <= b.size(); j++) {
+            int cost = diag + (a[i - 1] == b[j - 1] ? 0 : 1);
+            diag = row[j];
+            row[j] = std::min(std::min(row[j] + 1, row[j - 1] + 1), cost);
+        }
+    }
+
+    return row[b.size()];
+}
+
+static int prefix_distance(const std::string &query, const std::string &key)
+{
+    int best = levenshtein(query, "");
+
+    for (size_t len = 1; len <= key.size(); len++)
+        best = std::min(best, levenshtein(query, key.substr(0, len)));
+
+    return best;
+}
+
+static std::vector<std::string> keys_of(const vector_found_t &vec)
+{
+    std::vector<std::string> keys;
+
+    for (size_t i = 0; i < vec.size(); i++)
+        keys.push_back(vec[i]->first);
+
+    return keys;
+}
+
+TEST(fuzzy_match, simple)
+{
+    tree_t tree;
+
+    tree["apache"]    = 0;
+    tree["afford"]    = 1;
+    tree["available"] = 2;
+    tree["affair"]    = 3;
+    tree["binary"]    = 5;
+    tree["bind"]      = 6;
+    tree["blind"]     = 9;
+    tree["bro"]       = 10;
+
+    vector_found_t vec;
+
+    tree.fuzzy_match("bind", 0, vec);
+    ASSERT_EQ(1u, vec.size());
+    ASSERT_EQ("bind", vec[0]->first);
+
+    tree.fuzzy_match("bnid", 2, vec);
+    std::vector<std::string> keys = keys_of(vec);
+    ASSERT_EQ(2u, keys.size());
+    ASSERT_EQ("bind", keys[0]);
+    ASSERT_EQ("blind", keys[1]);
+
+    tree.fuzzy_match("apahce", 1, vec);
+    ASSERT_TRUE(vec.empty());
+
+    tree.fuzzy_prefix_match("afo", 1, vec);
+    keys = keys_of(vec);
+    ASSERT_EQ(2u, keys.size());
+    ASSERT_EQ("affair", keys[0]);
+    ASSERT_EQ("afford", keys[1]);
+
+    tree.fuzzy_prefix_match("", 0, vec);
+    ASSERT_EQ(tree.size(), vec.size());
+
+    tree_t empty;
+    empty.fuzzy_match("a", 3, vec);
+    ASSERT_TRUE(vec.empty());
+}
+
+TEST(fuzzy_match, same_as_brute_force)
+{
+    tree_t tree;
+    std::srand(7);
+
+    for (int i = 0; i < 500; i++) {
+        std::string key;
+        int len = std::rand() % 7;
+        for (int j = 0; j < len; j++)
+            key += static_cast<char>('a' + std::rand() % 4);
+        tree[key] = i;
+    }
+
+    const char *queries[] = { "", "a", "abc", "dcba", "aaaa", "bdbdb", "cabbage" };
+
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        for (int edits = 0; edits <= 2; edits++) {
+            std::vector<std::string> exact, prefix;
+
+            for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it) {
+                if (levenshtein(queries[q], it->first) <= edits)
+                    exact.push_back(it->first);
+                if (prefix_distance(queries[q], it->first) <= edits)
+                    prefix.push_back(it->first);
+            }
+
+            vector_found_t vec;
+
+            tree.fuzzy_match(queries[q], edits, vec);
+            ASSERT_EQ(exact, keys_of(vec)) << queries[q] << " " << edits;
+
+            tree.fuzzy_prefix_match(queries[q], edits, vec);
+            ASSERT_EQ(prefix, keys_of(vec)) << queries[q] << " " << edits;
+        }
+    }
+}
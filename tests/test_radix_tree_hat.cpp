@@ -0,0 +1,248 @@
+#include "common.hpp"
+
+#include <radix_tree_hat.hpp>
+#include <cstdlib>
+#include <pthread.h>
+#include <sstream>
+
+typedef hat_radix_tree<int> hat_t;
+
+static std::string dense_key(int i)
+{
+    std::ostringstream os;
+    os << (i * 7919) % 10007;
+    return os.str();
+}
+
+static void expect_same(const hat_t &hat, const std::map<std::string, int> &model)
+{
+    ASSERT_EQ(model.size(), hat.size());
+
+    std::map<std::string, int>::const_iterator mit = model.begin();
+    for (hat_t::const_iterator it = hat.begin(); it != hat.end(); ++it, ++mit) {
+        ASSERT_TRUE(mit != model.end());
+        ASSERT_EQ(mit->first, it->first);
+        ASSERT_EQ(mit->second, it->second);
+    }
+    ASSERT_TRUE(mit == model.end());
+}
+
+TEST(hat, insert_find_erase)
+{
+    hat_t hat(8);
+    std::map<std::string, int> model;
+
+    for (int i = 0; i < 3000; i++) {
+        std::pair<hat_t::iterator, bool> r = hat.insert(std::make_pair(dense_key(i), i));
+        ASSERT_EQ(model.insert(std::make_pair(dense_key(i), i)).second, r.second);
+        ASSERT_EQ(dense_key(i), r.first->first);
+        ASSERT_EQ(model[dense_key(i)], r.first->second);
+    }
+    ASSERT_LT(0u, hat.trie_nodes());
+    ASSERT_LT(1u, hat.buckets());
+    expect_same(hat, model);
+
+    for (int i = 0; i < 10007; i += 3) {
+        std::ostringstream os;
+        os << i;
+        hat_t::iterator it = hat.find(os.str());
+        if (model.count(os.str())) {
+            ASSERT_NE(hat.end(), it);
+            ASSERT_EQ(model[os.str()], it->second);
+        } else {
+            ASSERT_EQ(hat.end(), it);
+        }
+    }
+
+    for (int i = 0; i < 3000; i += 2) {
+        ASSERT_EQ(model.erase(dense_key(i)) == 1, hat.erase(dense_key(i)));
+        ASSERT_FALSE(hat.erase(dense_key(i)));
+    }
+    expect_same(hat, model);
+
+    for (int i = 1; i < 3000; i += 2)
+        hat.erase(dense_key(i));
+    ASSERT_TRUE(hat.empty());
+    ASSERT_EQ(0u, hat.trie_nodes());
+    ASSERT_EQ(0u, hat.buckets());
+    ASSERT_EQ(hat.end(), hat.begin());
+}
+
+TEST(hat, keys_ending_at_trie_nodes)
+{
+    hat_t hat(2);
+    std::map<std::string, int> model;
+    const char *keys[] = { "", "a", "ab", "abc", "abd", "abe", "b", "ba", "\xff", "\xff\xff" };
+
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        hat[keys[i]] = static_cast<int>(i);
+        model[keys[i]] = static_cast<int>(i);
+    }
+    hat[std::string("a\0b", 3)] = 42;
+    model[std::string("a\0b", 3)] = 42;
+
+    expect_same(hat, model);
+    ASSERT_EQ(0, hat.find("")->second);
+    ASSERT_EQ(1, hat.find("a")->second);
+
+    // an iterator from find() moves on like any other
+    hat_t::iterator it = hat.find("ab");
+    ASSERT_EQ("abc", (++it)->first);
+
+    ASSERT_TRUE(hat.erase("ab"));
+    ASSERT_TRUE(hat.erase(""));
+    model.erase("ab");
+    model.erase("");
+    expect_same(hat, model);
+}
+
+TEST(hat, prefix_match)
+{
+    hat_t hat(4);
+    std::map<std::string, int> model;
+
+    for (int i = 0; i < 2000; i++) {
+        hat[dense_key(i)] = i;
+        model[dense_key(i)] = i;
+    }
+
+    const char *prefixes[] = { "", "1", "12", "123", "1234", "99", "0", "x", "10006" };
+
+    for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+        std::string prefix(prefixes[p]);
+        std::vector<hat_t::iterator> vec;
+        hat.prefix_match(prefix, vec);
+
+        std::vector<std::string> expected;
+        for (std::map<std::string, int>::iterator it = model.lower_bound(prefix); it != model.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+            expected.push_back(it->first);
+
+        ASSERT_EQ(expected.size(), vec.size()) << prefix;
+        for (size_t i = 0; i < vec.size(); i++)
+            ASSERT_EQ(expected[i], vec[i]->first);
+    }
+
+    const hat_t &chat = hat;
+    std::vector<hat_t::const_iterator> cvec;
+    chat.prefix_match("5", cvec);
+    ASSERT_FALSE(cvec.empty());
+    for (size_t i = 0; i < cvec.size(); i++)
+        ASSERT_EQ('5', cvec[i]->first[0]);
+}
+
+TEST(hat, copy_and_assign)
+{
+    hat_t hat(4);
+    for (int i = 0; i < 500; i++)
+        hat[dense_key(i)] = i;
+
+    hat_t copy(hat);
+    ASSERT_EQ(hat.size(), copy.size());
+    ASSERT_EQ(hat.trie_nodes(), copy.trie_nodes());
+    ASSERT_EQ(hat.buckets(), copy.buckets());
+
+    copy[dense_key(0)] = -1;
+    ASSERT_EQ(0, hat.find(dense_key(0))->second);
+
+    hat_t other;
+    other["x"] = 1;
+    other = copy;
+    ASSERT_EQ(-1, other.find(dense_key(0))->second);
+    ASSERT_EQ(other.end(), other.find("x"));
+
+    std::map<std::string, int> model;
+    for (hat_t::iterator it = copy.begin(); it != copy.end(); ++it)
+        model[it->first] = it->second;
+    expect_same(other, model);
+
+    other.clear();
+    ASSERT_TRUE(other.empty());
+    ASSERT_EQ(0u, other.buckets());
+}
+
+struct deep_result {
+    size_t nodes;
+    size_t copy_size;
+    bool found;
+};
+
+// two keys sharing a long prefix burst once per byte of it
+static void* build_deep(void *arg)
+{
+    deep_result *result = static_cast<deep_result*>(arg);
+    std::string prefix(4000, 'x');
+
+    hat_t hat(1);
+    hat[prefix + "a"] = 1;
+    hat[prefix + "b"] = 2;
+    result->nodes = hat.trie_nodes();
+
+    hat_t copy(hat);
+    result->copy_size = copy.size();
+    result->found = copy.find(prefix + "b") != copy.end() && copy.find(prefix + "b")->second == 2;
+
+    hat.clear();
+    return NULL;
+}
+
+TEST(hat, deep_trie)
+{
+    // far less stack than a level of recursion per trie node would need
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, 256 * 1024);
+
+    deep_result result = { 0, 0, false };
+    pthread_t thread;
+    ASSERT_EQ(0, pthread_create(&thread, &attr, build_deep, &result));
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+
+    ASSERT_GT(result.nodes, 4000u);
+    ASSERT_EQ(2u, result.copy_size);
+    ASSERT_TRUE(result.found);
+}
+
+TEST(hat, values_move_on_insert)
+{
+    hat_t hat(4);
+    hat["apple"] = 1;
+
+    const int *before = &hat["apple"];
+    ASSERT_EQ(0u, hat.trie_nodes());
+
+    // the burst copies the values into new buckets
+    const char *keys[] = { "apricot", "banana", "cherry", "date", "elder" };
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++)
+        hat[keys[i]] = static_cast<int>(i) + 2;
+    ASSERT_LT(0u, hat.trie_nodes());
+
+    ASSERT_NE(before, &hat["apple"]);
+    ASSERT_EQ(1, hat["apple"]);
+
+    // copied out before the insert that may move it
+    int apple = hat["apple"];
+    hat["pear"] = apple;
+    ASSERT_EQ(1, hat.find("pear")->second);
+}
+
+TEST(hat, random_against_map)
+{
+    hat_t hat(16);
+    std::map<std::string, int> model;
+
+    srand(7);
+    for (int i = 0; i < 20000; i++) {
+        std::string key;
+        for (int n = rand() % 6; n > 0; n--)
+            key += static_cast<char>('a' + rand() % 4);
+
+        if (rand() % 3 == 0) {
+            ASSERT_EQ(model.erase(key) == 1, hat.erase(key));
+        } else {
+            hat[key] = i;
+            model[key] = i;
+        }
+    }
+    expect_same(hat, model);
+}
@@ -108,3 +108,39 @@ TEST(iterator, std__copy)
         ASSERT_NE(map.end(), map.find(it->first));
     }
 }
+
+TEST(iterator, deep_tree)
+{
+    // every key is a prefix of the next one, so the tree is as deep as
+    // the number of keys
+    const int depth = 2000;
+    tree_t tree;
+    std::string key;
+    for (int i = 0; i < depth; i++) {
+        key += (i % 2) ? 'a' : 'b';
+        tree[key] = i;
+    }
+    ASSERT_EQ(size_t(depth), tree.size());
+
+    {
+        SCOPED_TRACE("iteration visits every level in order");
+        int expected = 0;
+        for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it, ++expected)
+            ASSERT_EQ(expected, it->second);
+        ASSERT_EQ(depth, expected);
+    }
+    {
+        SCOPED_TRACE("greedy_match collects the whole chain");
+        vector_found_t vec;
+        tree.greedy_match("b", vec);
+        ASSERT_EQ(size_t(depth), vec.size());
+    }
+    {
+        SCOPED_TRACE("find reaches the deepest leaf");
+        tree_t::iterator it = tree.find(key);
+        ASSERT_NE(tree.end(), it);
+        ASSERT_EQ(depth - 1, it->second);
+    }
+    tree.clear();
+    ASSERT_EQ(tree.begin(), tree.end());
+}
@@ -69,3 +69,58 @@ TEST(longest_match, complex_tree)
         }
     }
 }
+
+TEST(longest_match, all_prefixes_of)
+{
+    tree_t tree;
+
+    tree[""]       = 0;
+    tree["1"]      = 1;
+    tree["10"]     = 2;
+    tree["1010"]   = 3;
+    tree["10101"]  = 4;
+    tree["1011"]   = 5;
+    tree["11"]     = 6;
+    tree["101010"] = 7;
+
+    vector_found_t vec;
+
+    tree.all_prefixes_of("101011", vec);
+    ASSERT_EQ(5u, vec.size());
+    ASSERT_EQ("", vec[0]->first);
+    ASSERT_EQ("1", vec[1]->first);
+    ASSERT_EQ("10", vec[2]->first);
+    ASSERT_EQ("1010", vec[3]->first);
+    ASSERT_EQ("10101", vec[4]->first);
+
+    tree.all_prefixes_of("101010", vec);
+    ASSERT_EQ(6u, vec.size());
+    ASSERT_EQ("101010", vec.back()->first);
+
+    tree.all_prefixes_of("0", vec);
+    ASSERT_EQ(1u, vec.size());
+    ASSERT_EQ("", vec[0]->first);
+
+    tree.erase("");
+    tree.all_prefixes_of("0", vec);
+    ASSERT_TRUE(vec.empty());
+
+    // agrees with longest_match on every key of the tree and their neighbours
+    for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it) {
+        const std::string keys[] = { it->first, it->first + "0", it->first.substr(0, it->first.size() - 1) };
+        for (size_t i = 0; i < 3; i++) {
+            tree.all_prefixes_of(keys[i], vec);
+            tree_t::iterator longest = tree.longest_match(keys[i]);
+            if (longest == tree.end()) {
+                ASSERT_TRUE(vec.empty());
+            } else {
+                ASSERT_FALSE(vec.empty());
+                ASSERT_EQ(longest->first, vec.back()->first);
+            }
+        }
+    }
+
+    tree_t empty;
+    empty.all_prefixes_of("1", vec);
+    ASSERT_TRUE(vec.empty());
+}
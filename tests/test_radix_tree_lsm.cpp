@@ -0,0 +1,238 @@
+#include "common.hpp"
+
+#include <radix_tree_lsm.hpp>
+#include <cstdlib>
+#include <sstream>
+
+typedef lsm_radix_tree<std::string, int> lsm_t;
+
+static std::string key_of(int i)
+{
+    std::ostringstream os;
+    os << "host" << i % 17 << ".example" << i << ".com";
+    return os.str();
+}
+
+static void expect_same(const lsm_t &lsm, const std::map<std::string, int> &model)
+{
+    ASSERT_EQ(model.size(), lsm.size());
+
+    std::vector<std::pair<const std::string, int> > seen;
+    lsm.for_each([&seen](const std::pair<const std::string, int> &e) {
+        seen.push_back(e);
+    });
+    ASSERT_EQ(model.size(), seen.size());
+    ASSERT_TRUE(std::equal(seen.begin(), seen.end(), model.begin()));
+}
+
+TEST(lsm, tombstones)
+{
+    lsm_t lsm(1000);
+
+    ASSERT_TRUE(lsm.insert("apple", 1));
+    ASSERT_TRUE(lsm.insert("apricot", 2));
+    ASSERT_FALSE(lsm.insert("apple", 3));
+    lsm.compact();
+    ASSERT_EQ(2u, lsm.base_size());
+    ASSERT_EQ(0u, lsm.delta_size());
+
+    // erasing a key of the base leaves a tombstone in the delta
+    ASSERT_TRUE(lsm.erase("apple"));
+    ASSERT_FALSE(lsm.erase("apple"));
+    ASSERT_EQ(1u, lsm.delta_size());
+    ASSERT_EQ(1u, lsm.size());
+
+    int val;
+    ASSERT_FALSE(lsm.find("apple", val));
+    ASSERT_TRUE(lsm.find("apricot", val));
+    ASSERT_EQ(2, val);
+
+    // a key only in the delta goes without one
+    ASSERT_TRUE(lsm.insert("banana", 4));
+    ASSERT_TRUE(lsm.erase("banana"));
+    ASSERT_EQ(1u, lsm.delta_size());
+
+    ASSERT_TRUE(lsm.insert("apple", 5));
+    ASSERT_TRUE(lsm.find("apple", val));
+    ASSERT_EQ(5, val);
+    ASSERT_FALSE(lsm.insert_or_assign("apricot", 6));
+    ASSERT_TRUE(lsm.erase("apple"));
+
+    lsm.compact();
+    ASSERT_EQ(1u, lsm.base_size());
+    ASSERT_EQ(0u, lsm.delta_size());
+    ASSERT_TRUE(lsm.find("apricot", val));
+    ASSERT_EQ(6, val);
+}
+
+TEST(lsm, merged_lookups)
+{
+    lsm_t lsm(1000);
+
+    lsm.insert("10.", 1);
+    lsm.insert("10.1.", 2);
+    lsm.insert("10.1.2.", 3);
+    lsm.compact();
+
+    std::pair<std::string, int> entry;
+    ASSERT_TRUE(lsm.longest_match("10.1.2.3", entry));
+    ASSERT_EQ("10.1.2.", entry.first);
+
+    // the tombstone hides the longest match, so the next one shows
+    lsm.erase("10.1.2.");
+    ASSERT_TRUE(lsm.longest_match("10.1.2.3", entry));
+    ASSERT_EQ("10.1.", entry.first);
+    ASSERT_EQ(2, entry.second);
+
+    lsm.insert_or_assign("10.1.", 20);
+    lsm.insert("10.1.2.3", 4);
+    ASSERT_TRUE(lsm.longest_match("10.1.2.3", entry));
+    ASSERT_EQ("10.1.2.3", entry.first);
+    ASSERT_FALSE(lsm.longest_match("11.", entry));
+
+    std::vector<std::pair<std::string, int> > vec;
+    lsm.prefix_match("10.1", vec);
+    ASSERT_EQ(2u, vec.size());
+    ASSERT_EQ("10.1.", vec[0].first);
+    ASSERT_EQ(20, vec[0].second);
+    ASSERT_EQ("10.1.2.3", vec[1].first);
+}
+
+TEST(lsm, random_against_map)
+{
+    lsm_t lsm(64);
+    std::map<std::string, int> model;
+
+    srand(11);
+    for (int i = 0; i < 20000; i++) {
+        std::string key = key_of(rand() % 500);
+
+        switch (rand() % 4) {
+        case 0:
+            ASSERT_EQ(model.erase(key) == 1, lsm.erase(key));
+            break;
+        case 1:
+            ASSERT_EQ(model.insert(std::make_pair(key, i)).second, lsm.insert(key, i));
+            break;
+        default:
+            ASSERT_EQ(model.count(key) == 0, lsm.insert_or_assign(key, i));
+            model[key] = i;
+            break;
+        }
+
+        if (i % 1000 == 0)
+            expect_same(lsm, model);
+        if (i % 5000 == 0)
+            lsm.compact();
+    }
+
+    lsm.compact();
+    ASSERT_FALSE(lsm.compacting());
+    ASSERT_EQ(model.size(), lsm.base_size());
+    expect_same(lsm, model);
+
+    for (std::map<std::string, int>::iterator it = model.begin(); it != model.end(); ++it) {
+        int val;
+        ASSERT_TRUE(lsm.find(it->first, val));
+        ASSERT_EQ(it->second, val);
+    }
+
+    std::vector<std::pair<std::string, int> > vec;
+    lsm.prefix_match("host3.", vec);
+    size_t expected = 0;
+    for (std::map<std::string, int>::iterator it = model.begin(); it != model.end(); ++it)
+        expected += it->first.compare(0, 6, "host3.") == 0;
+    ASSERT_EQ(expected, vec.size());
+
+    lsm.clear();
+    ASSERT_TRUE(lsm.empty());
+    ASSERT_EQ(0u, lsm.base_size());
+}
+
+TEST(lsm, delta_stays_bounded)
+{
+    lsm_t lsm(16);
+
+    for (int i = 0; i < 2000; i++)
+        lsm.insert(key_of(i), i);
+
+    // writers wait for a merge rather than let the delta grow meanwhile
+    for (int i = 0; i < 2000; i++) {
+        lsm.insert_or_assign(key_of(i), -i);
+        ASSERT_LE(lsm.delta_size(), lsm.delta_limit());
+        if (i % 2 == 0) {
+            lsm.erase(key_of(i));
+            ASSERT_LE(lsm.delta_size(), lsm.delta_limit());
+        }
+    }
+
+    lsm.compact();
+    ASSERT_EQ(1000u, lsm.base_size());
+    for (int i = 1; i < 2000; i += 2) {
+        int val;
+        ASSERT_TRUE(lsm.find(key_of(i), val));
+        ASSERT_EQ(-i, val);
+    }
+}
+
+TEST(lsm, delta_limit_grows_with_the_base)
+{
+    lsm_t lsm(16);
+    ASSERT_EQ(16u, lsm.delta_limit());
+
+    for (int i = 0; i < 20000; i++) {
+        lsm.insert(key_of(i), i);
+        ASSERT_LE(lsm.delta_size(), lsm.delta_limit());
+    }
+
+    // a merge copies the base, so the deltas merged into it grow with it
+    ASSERT_LT(16u, lsm.delta_limit());
+    ASSERT_GE(20000u / 8, lsm.delta_limit());
+
+    lsm.compact();
+    ASSERT_EQ(20000u, lsm.base_size());
+    ASSERT_EQ(20000u / 8, lsm.delta_limit());
+
+    lsm.clear();
+    ASSERT_EQ(16u, lsm.delta_limit());
+}
+
+TEST(lsm, readers_during_compaction)
+{
+    lsm_t lsm(256);
+
+    for (int i = 0; i < 1000; i++)
+        lsm.insert(key_of(i), i);
+    lsm.compact();
+
+    std::vector<std::thread> readers;
+    std::vector<int> errors(4, 0);
+
+    for (int t = 0; t < 4; t++) {
+        readers.push_back(std::thread([&lsm, &errors, t]() {
+            for (int round = 0; round < 50; round++) {
+                for (int i = t; i < 1000; i += 7) {
+                    int val;
+                    if (! lsm.find(key_of(i), val) || val != i)
+                        errors[t]++;
+                }
+            }
+        }));
+    }
+
+    // the writer never touches the keys the readers look for
+    for (int i = 1000; i < 20000; i++) {
+        lsm.insert(key_of(i), i);
+        if (i % 3 == 0)
+            lsm.erase(key_of(i - 1));
+    }
+    for (size_t t = 0; t < readers.size(); t++)
+        readers[t].join();
+
+    for (size_t t = 0; t < errors.size(); t++)
+        ASSERT_EQ(0, errors[t]);
+
+    lsm.compact();
+    ASSERT_EQ(lsm.size(), lsm.base_size());
+    ASSERT_EQ(1000u + 19000u - 6333u, lsm.size());
+}
@@ -0,0 +1,146 @@
+#include "common.hpp"
+
+#include <radix_tree_parallel.hpp>
+#include <sstream>
+#include <stdexcept>
+
+static std::string key_of(int i)
+{
+    std::ostringstream os;
+    os << "host" << i % 97 << "/" << i;
+    return os.str();
+}
+
+TEST(parallel, split)
+{
+    tree_t tree;
+    std::vector<tree_t::const_range> ranges;
+
+    tree.split(4, ranges);
+    ASSERT_TRUE(ranges.empty());
+
+    for (int i = 0; i < 10000; i++)
+        tree[key_of(i)] = i;
+    tree[""] = -1;
+
+    const tree_t &ctree = tree;
+
+    for (size_t n = 1; n <= 64; n *= 2) {
+        ctree.split(n, ranges);
+        ASSERT_LE(ranges.size(), n);
+        ASSERT_LE(1u, ranges.size());
+        ASSERT_EQ(ctree.begin(), ranges.front().first);
+        ASSERT_EQ(ctree.end(), ranges.back().second);
+
+        // the ranges line up and cover every entry once
+        size_t count = 0;
+        for (size_t r = 0; r < ranges.size(); r++) {
+            if (r > 0) {
+                ASSERT_EQ(ranges[r - 1].second, ranges[r].first);
+            }
+            for (tree_t::const_iterator it = ranges[r].first; it != ranges[r].second; ++it)
+                count++;
+        }
+        ASSERT_EQ(tree.size(), count);
+    }
+
+    ctree.split(8, ranges);
+    ASSERT_EQ(8u, ranges.size());
+    for (size_t r = 0; r < ranges.size(); r++)
+        ASSERT_NE(ranges[r].first, ranges[r].second);
+}
+
+TEST(parallel, for_each)
+{
+    tree_t tree;
+    long expected = 0;
+    for (int i = 0; i < 20000; i++) {
+        tree[key_of(i)] = i;
+        expected += i;
+    }
+
+    radix_tree_pool pool(4);
+    ASSERT_EQ(4u, pool.size());
+
+    std::atomic<long> sum(0);
+    std::atomic<int> count(0);
+    parallel_for_each(pool, tree, [&](const tree_t::value_type &val) {
+        sum += val.second;
+        count++;
+    });
+    ASSERT_EQ(20000, count.load());
+    ASSERT_EQ(expected, sum.load());
+
+    // host5/... and host5x/...
+    vector_found_t found;
+    tree.prefix_match("host5", found);
+
+    count = 0;
+    parallel_for_each(pool, tree, "host5", [&](const tree_t::value_type &val) {
+        ASSERT_EQ(0u, val.first.find("host5"));
+        count++;
+    });
+    ASSERT_EQ(static_cast<int>(found.size()), count.load());
+
+    count = 0;
+    parallel_for_each(pool, tree, "nohost", [&](const tree_t::value_type &) {
+        count++;
+    });
+    ASSERT_EQ(0, count.load());
+
+    tree_t empty;
+    parallel_for_each(pool, empty, [&](const tree_t::value_type &) {
+        count++;
+    });
+    ASSERT_EQ(0, count.load());
+}
+
+TEST(parallel, reduce)
+{
+    tree_t tree;
+    long expected = 0, expected_prefix = 0;
+    for (int i = 0; i < 20000; i++) {
+        tree[key_of(i)] = i;
+        expected += i;
+        if (key_of(i).compare(0, 6, "host1/") == 0)
+            expected_prefix += i;
+    }
+
+    radix_tree_pool pool(3);
+
+    long sum = parallel_reduce(pool, tree, 100L,
+        [](const tree_t::value_type &val) { return static_cast<long>(val.second); },
+        [](long a, long b) { return a + b; });
+    ASSERT_EQ(expected + 100, sum);
+
+    sum = parallel_reduce(pool, tree, "host1/", 0L,
+        [](const tree_t::value_type &val) { return static_cast<long>(val.second); },
+        [](long a, long b) { return a + b; });
+    ASSERT_EQ(expected_prefix, sum);
+
+    size_t longest = parallel_reduce(pool, tree, static_cast<size_t>(0),
+        [](const tree_t::value_type &val) { return val.first.size(); },
+        [](size_t a, size_t b) { return std::max(a, b); });
+    ASSERT_EQ(key_of(19999).size(), longest);
+}
+
+TEST(parallel, exceptions)
+{
+    tree_t tree;
+    for (int i = 0; i < 1000; i++)
+        tree[key_of(i)] = i;
+
+    radix_tree_pool pool(2);
+
+    ASSERT_THROW(parallel_for_each(pool, tree, [](const tree_t::value_type &val) {
+        if (val.second == 500)
+            throw std::runtime_error("500");
+    }), std::runtime_error);
+
+    // the pool is still usable
+    std::atomic<int> count(0);
+    parallel_for_each(pool, tree, [&](const tree_t::value_type &) {
+        count++;
+    });
+    ASSERT_EQ(1000, count.load());
+}
@@ -0,0 +1,130 @@
+#include "common.hpp"
+
+#include <cstdlib>
+
+static bool glob(const char *pattern, const char *key)
+{
+    if (*pattern == '\0')
+        return *key == '\0';
+    if (*pattern == '*')
+        return glob(pattern + 1, key) || (*key != '\0' && glob(pattern, key + 1));
+    if (*key == '\0')
+        return false;
+    if (*pattern == '?' || *pattern == *key)
+        return glob(pattern + 1, key + 1);
+    return false;
+}
+
+static std::vector<std::string> keys_of(const vector_found_t &vec)
+{
+    std::vector<std::string> keys;
+
+    for (size_t i = 0; i < vec.size(); i++)
+        keys.push_back(vec[i]->first);
+
+    return keys;
+}
+
+struct stop_after {
+    std::vector<std::string> *keys;
+    size_t limit;
+    bool operator() (const tree_t::value_type &val) const {
+        keys->push_back(val.first);
+        return keys->size() < limit;
+    }
+};
+
+TEST(pattern_match, hosts_and_paths)
+{
+    tree_t tree;
+
+    tree["api.eu.example.com"]  = 0;
+    tree["api.us.example.com"]  = 1;
+    tree["www.example.com"]     = 2;
+    tree["api.example.org"]     = 3;
+    tree["/v1/users/7/orders"]  = 4;
+    tree["/v1/users/42/orders"] = 5;
+    tree["/v1/users/42"]        = 6;
+    tree["/v2/users/7/orders"]  = 7;
+
+    vector_found_t vec;
+
+    tree.pattern_match("api.*.example.com", vec);
+    std::vector<std::string> keys = keys_of(vec);
+    ASSERT_EQ(2u, keys.size());
+    ASSERT_EQ("api.eu.example.com", keys[0]);
+    ASSERT_EQ("api.us.example.com", keys[1]);
+
+    tree.pattern_match("/v1/users/*/orders", vec);
+    ASSERT_EQ(2u, vec.size());
+
+    tree.pattern_match("/v?/users/7/orders", vec);
+    ASSERT_EQ(2u, vec.size());
+
+    tree.pattern_match("api.*", vec);
+    ASSERT_EQ(3u, vec.size());
+
+    tree.pattern_match("*", vec);
+    ASSERT_EQ(tree.size(), vec.size());
+
+    tree.pattern_match("www.example.com", vec);
+    ASSERT_EQ(1u, vec.size());
+
+    tree.pattern_match("ftp.*", vec);
+    ASSERT_TRUE(vec.empty());
+
+    tree.pattern_match("", vec);
+    ASSERT_TRUE(vec.empty());
+    tree[""] = 8;
+    tree.pattern_match("", vec);
+    ASSERT_EQ(1u, vec.size());
+}
+
+TEST(pattern_match, for_each_stops_early)
+{
+    tree_t tree;
+
+    tree["a1"] = 1;
+    tree["a2"] = 2;
+    tree["a3"] = 3;
+    tree["b1"] = 4;
+
+    std::vector<std::string> keys;
+    stop_after fn = { &keys, 2 };
+
+    const tree_t &ctree = tree;
+    ctree.pattern_for_each("a?", fn);
+
+    ASSERT_EQ(2u, keys.size());
+    ASSERT_EQ("a1", keys[0]);
+    ASSERT_EQ("a2", keys[1]);
+}
+
+TEST(pattern_match, same_as_brute_force)
+{
+    tree_t tree;
+    std::srand(11);
+
+    for (int i = 0; i < 500; i++) {
+        std::string key;
+        int len = std::rand() % 8;
+        for (int j = 0; j < len; j++)
+            key += static_cast<char>('a' + std::rand() % 3);
+        tree[key] = i;
+    }
+
+    const char *patterns[] = { "a*", "*a", "a*b*c", "?b?", "**", "*ab*", "c?*a", "abcabc", "?*?*?" };
+
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        std::vector<std::string> expected;
+
+        for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it) {
+            if (glob(patterns[p], it->first.c_str()))
+                expected.push_back(it->first);
+        }
+
+        vector_found_t vec;
+        tree.pattern_match(patterns[p], vec);
+        ASSERT_EQ(expected, keys_of(vec)) << patterns[p];
+    }
+}
@@ -0,0 +1,133 @@
+#include "common.hpp"
+
+#include <radix_tree_reverse.hpp>
+
+typedef radix_tree<radix_reverse_key<>, int> suffix_tree_t;
+
+static std::string s(const char *str)
+{
+    return std::string(str);
+}
+
+static radix_reverse_key<> k(const char *str)
+{
+    return radix_reverse_key<>(str);
+}
+
+TEST(reverse_key, longest_suffix_match)
+{
+    suffix_tree_t tree;
+
+    tree[k(".com")]             = 0;
+    tree[k(".example.com")]     = 1;
+    tree[k(".api.example.com")] = 2;
+    tree[k(".org")]             = 3;
+
+    suffix_tree_t::iterator it;
+
+    it = longest_suffix_match(tree, s("www.example.com"));
+    ASSERT_NE(tree.end(), it);
+    ASSERT_EQ(".example.com", it->first.str());
+
+    it = longest_suffix_match(tree, s("v1.api.example.com"));
+    ASSERT_NE(tree.end(), it);
+    ASSERT_EQ(2, it->second);
+
+    it = longest_suffix_match(tree, s("google.com"));
+    ASSERT_NE(tree.end(), it);
+    ASSERT_EQ(0, it->second);
+
+    it = longest_suffix_match(tree, s("example.net"));
+    ASSERT_EQ(tree.end(), it);
+
+    const suffix_tree_t &ctree = tree;
+    suffix_tree_t::const_iterator cit = longest_suffix_match(ctree, s("a.org"));
+    ASSERT_NE(ctree.end(), cit);
+    ASSERT_EQ(3, cit->second);
+}
+
+TEST(reverse_key, suffix_match)
+{
+    suffix_tree_t tree;
+
+    tree[k("archive.tar.gz")] = 0;
+    tree[k("notes.gz")]       = 1;
+    tree[k("image.tar")]      = 2;
+    tree[k("data.tar.gz")]    = 3;
+
+    std::vector<suffix_tree_t::iterator> vec;
+    suffix_match(tree, s(".tar.gz"), vec);
+
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < vec.size(); i++)
+        keys.push_back(vec[i]->first.str());
+    std::sort(keys.begin(), keys.end());
+
+    ASSERT_EQ(2u, keys.size());
+    ASSERT_EQ("archive.tar.gz", keys[0]);
+    ASSERT_EQ("data.tar.gz", keys[1]);
+
+    suffix_match(tree, s("gz"), vec);
+    ASSERT_EQ(3u, vec.size());
+
+    suffix_match(tree, s(".zip"), vec);
+    ASSERT_TRUE(vec.empty());
+}
+
+TEST(reverse_key, ordinary_operations)
+{
+    suffix_tree_t tree;
+
+    tree[k("abc")] = 0;
+    tree[k("xbc")] = 1;
+    tree[k("bc")]  = 2;
+    tree[k("c")]   = 3;
+    tree[k("cba")] = 4;
+
+    ASSERT_EQ(5u, tree.size());
+    ASSERT_NE(tree.end(), tree.find(k("xbc")));
+    ASSERT_EQ(tree.end(), tree.find(k("b")));
+
+    // iteration runs in order of the reversed keys
+    std::vector<std::string> keys;
+    for (suffix_tree_t::iterator it = tree.begin(); it != tree.end(); ++it)
+        keys.push_back(it->first.str());
+
+    ASSERT_EQ(5u, keys.size());
+    ASSERT_EQ("cba", keys[0]);
+    ASSERT_EQ("c", keys[1]);
+    ASSERT_EQ("bc", keys[2]);
+    ASSERT_EQ("abc", keys[3]);
+    ASSERT_EQ("xbc", keys[4]);
+
+    ASSERT_TRUE(tree.erase(k("bc")));
+    ASSERT_EQ(tree.end(), tree.find(k("bc")));
+    ASSERT_NE(tree.end(), tree.find(k("abc")));
+    ASSERT_EQ(2u, tree.erase_prefix(k("bc")));
+    ASSERT_EQ(2u, tree.size());
+}
+
+TEST(reverse_key, stored_keys_own_their_data)
+{
+    suffix_tree_t tree;
+
+    // the temporary strings are gone by the time the keys are read
+    tree[radix_reverse_key<>(std::string("com.example"))] = 1;
+    tree.insert(std::make_pair(radix_reverse_key<>(std::string("org.example")), 2));
+
+    std::string probe("www.com.example");
+    ASSERT_EQ(1, longest_suffix_match(tree, probe)->second);
+
+    radix_reverse_key<> borrowed(probe, radix_borrow);
+    radix_reverse_key<> copy(borrowed);
+    probe = "changed";
+    ASSERT_EQ("www.com.example", copy.str());
+    ASSERT_EQ("changed", borrowed.str());
+
+    std::vector<std::string> keys;
+    for (suffix_tree_t::iterator it = tree.begin(); it != tree.end(); ++it)
+        keys.push_back(it->first.str());
+    ASSERT_EQ(2u, keys.size());
+    ASSERT_EQ("org.example", keys[0]);
+    ASSERT_EQ("com.example", keys[1]);
+}
@@ -0,0 +1,188 @@
+#include "common.hpp"
+
+#include <set>
+
+static std::vector<std::string> random_keys(size_t count, size_t max_len)
+{
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < count; i++) {
+        std::string key;
+        size_t len = rand() % (max_len + 1);
+        for (size_t j = 0; j < len; j++)
+            key += char('a' + rand() % 3);
+        keys.push_back(key);
+    }
+    return keys;
+}
+
+static map_found_t tree_to_map(tree_t &tree)
+{
+    map_found_t result;
+    for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it)
+        result[it->first] = it->second;
+    return result;
+}
+
+static void fill(tree_t &tree, map_found_t &map, const std::vector<std::string> &keys, int value)
+{
+    for (size_t i = 0; i < keys.size(); i++) {
+        tree[keys[i]] = value;
+        map[keys[i]] = value;
+    }
+}
+
+TEST(set_ops, merge)
+{
+    for (int round = 0; round < 50; round++) {
+        tree_t a, b;
+        map_found_t map_a, map_b;
+        fill(a, map_a, random_keys(rand() % 40, 6), 1);
+        fill(b, map_b, random_keys(rand() % 40, 6), 2);
+
+        map_found_t expected_a = map_a, expected_b;
+        for (map_found_t::iterator it = map_b.begin(); it != map_b.end(); ++it) {
+            if (map_a.count(it->first))
+                expected_b[it->first] = it->second;
+            else
+                expected_a[it->first] = it->second;
+        }
+
+        a.merge(b);
+
+        ASSERT_EQ(expected_a, tree_to_map(a));
+        ASSERT_EQ(expected_b, tree_to_map(b));
+        ASSERT_EQ(expected_a.size(), a.size());
+        ASSERT_EQ(expected_b.size(), b.size());
+        for (map_found_t::iterator it = expected_a.begin(); it != expected_a.end(); ++it)
+            ASSERT_NE(a.end(), a.find(it->first));
+        for (map_found_t::iterator it = expected_b.begin(); it != expected_b.end(); ++it)
+            ASSERT_NE(b.end(), b.find(it->first));
+
+        // both trees must still be consistent after further updates
+        b["abcabc"] = 3;
+        a.erase("abcabc");
+        ASSERT_EQ(a.end(), a.find("abcabc"));
+        ASSERT_EQ(3, b.find("abcabc")->second);
+    }
+}
+
+TEST(set_ops, merge_splits_edges)
+{
+    tree_t a, b;
+    a["abcdef"] = 1;
+    a["abcdxy"] = 2;
+    b["abcdeg"] = 3;
+    b["ab"] = 4;
+    b["abcdef"] = 5;
+
+    a.merge(b);
+
+    ASSERT_EQ(4u, a.size());
+    ASSERT_EQ(1, a["abcdef"]);
+    ASSERT_EQ(3, a["abcdeg"]);
+    ASSERT_EQ(4, a["ab"]);
+    ASSERT_EQ(1u, b.size());
+    ASSERT_EQ(5, b["abcdef"]);
+
+    vector_found_t vec;
+    a.prefix_match("abcde", vec);
+    ASSERT_EQ(2u, vec.size());
+}
+
+TEST(set_ops, intersect_and_subtract)
+{
+    for (int round = 0; round < 50; round++) {
+        tree_t a, b;
+        map_found_t map_a, map_b;
+        fill(a, map_a, random_keys(rand() % 40, 6), 1);
+        fill(b, map_b, random_keys(rand() % 40, 6), 2);
+
+        map_found_t common, only_a;
+        for (map_found_t::iterator it = map_a.begin(); it != map_a.end(); ++it) {
+            if (map_b.count(it->first))
+                common[it->first] = it->second;
+            else
+                only_a[it->first] = it->second;
+        }
+
+        tree_t c(a);
+        a.intersect(b);
+        c.subtract(b);
+
+        ASSERT_EQ(common, tree_to_map(a));
+        ASSERT_EQ(common.size(), a.size());
+        ASSERT_EQ(only_a, tree_to_map(c));
+        ASSERT_EQ(only_a.size(), c.size());
+        ASSERT_EQ(map_b, tree_to_map(b));
+    }
+}
+
+TEST(set_ops, diff)
+{
+    for (int round = 0; round < 50; round++) {
+        tree_t a, b;
+        map_found_t map_a, map_b;
+        fill(a, map_a, random_keys(rand() % 40, 6), 1);
+        fill(b, map_b, random_keys(rand() % 40, 6), 2);
+        std::vector<std::string> same = random_keys(5, 6);
+        fill(a, map_a, same, 7);
+        fill(b, map_b, same, 7);
+
+        std::vector<tree_t::diff_type> vec;
+        a.diff(b, vec);
+
+        std::vector<std::string> removed, added, changed;
+        for (map_found_t::iterator it = map_a.begin(); it != map_a.end(); ++it) {
+            if (! map_b.count(it->first))
+                removed.push_back(it->first);
+            else if (map_b[it->first] != it->second)
+                changed.push_back(it->first);
+        }
+        for (map_found_t::iterator it = map_b.begin(); it != map_b.end(); ++it) {
+            if (! map_a.count(it->first))
+                added.push_back(it->first);
+        }
+
+        std::vector<std::string> got_removed, got_added, got_changed;
+        for (size_t i = 0; i < vec.size(); i++) {
+            switch (vec[i].kind) {
+            case tree_t::diff_removed:
+                got_removed.push_back(vec[i].lhs->first);
+                break;
+            case tree_t::diff_added:
+                got_added.push_back(vec[i].rhs->first);
+                break;
+            case tree_t::diff_changed:
+                ASSERT_EQ(vec[i].lhs->first, vec[i].rhs->first);
+                got_changed.push_back(vec[i].lhs->first);
+                break;
+            }
+        }
+
+        // entries come out in key order
+        ASSERT_EQ(removed, got_removed);
+        ASSERT_EQ(added, got_added);
+        ASSERT_EQ(changed, got_changed);
+    }
+}
+
+TEST(set_ops, diff_of_snapshot)
+{
+    tree_t a;
+    a["abc"] = 1;
+    a["abd"] = 2;
+    tree_t b = a.snapshot();
+
+    std::vector<tree_t::diff_type> vec;
+    a.diff(b, vec);
+    ASSERT_TRUE(vec.empty());
+
+    b["abe"] = 3;
+    b.erase("abc");
+    a.diff(b, vec);
+    ASSERT_EQ(2u, vec.size());
+    ASSERT_EQ(tree_t::diff_removed, vec[0].kind);
+    ASSERT_EQ("abc", vec[0].lhs->first);
+    ASSERT_EQ(tree_t::diff_added, vec[1].kind);
+    ASSERT_EQ("abe", vec[1].rhs->first);
+}
@@ -0,0 +1,119 @@
+#include "common.hpp"
+
+#include <radix_tree_sharded.hpp>
+
+#include <sstream>
+#include <thread>
+
+typedef sharded_radix_tree<std::string, int> sharded_t;
+
+struct collect_keys {
+    std::vector<std::string> *keys;
+    void operator() (const std::pair<const std::string, int> &entry) const {
+        keys->push_back(entry.first);
+    }
+};
+
+TEST(sharded, basic_operations)
+{
+    sharded_t tree(8);
+    ASSERT_TRUE(tree.empty());
+
+    ASSERT_TRUE(tree.insert("apache", 0));
+    ASSERT_TRUE(tree.insert("bind", 1));
+    ASSERT_TRUE(tree.insert("binary", 2));
+    ASSERT_FALSE(tree.insert("bind", 10));
+    ASSERT_FALSE(tree.insert_or_assign("binary", 20));
+    ASSERT_EQ(3u, tree.size());
+
+    int value = 0;
+    ASSERT_TRUE(tree.find("bind", value));
+    ASSERT_EQ(1, value);
+    ASSERT_TRUE(tree.find("binary", value));
+    ASSERT_EQ(20, value);
+    ASSERT_FALSE(tree.find("bin", value));
+
+    ASSERT_TRUE(tree.erase("bind"));
+    ASSERT_FALSE(tree.erase("bind"));
+    ASSERT_EQ(2u, tree.size());
+}
+
+TEST(sharded, ordered_iteration_across_shards)
+{
+    std::vector<std::string> unique_keys = get_unique_keys();
+    unique_keys.push_back("");
+    unique_keys.push_back("zz");
+    unique_keys.push_back("Mm");
+    sharded_t tree(5);
+    for (size_t i = 0; i < unique_keys.size(); i++)
+        tree.insert(unique_keys[i], int(i));
+
+    std::vector<std::string> keys;
+    collect_keys fn;
+    fn.keys = &keys;
+    tree.for_each(fn);
+
+    std::sort(unique_keys.begin(), unique_keys.end());
+    ASSERT_EQ(unique_keys, keys);
+}
+
+TEST(sharded, matches_across_shards)
+{
+    sharded_t tree(16);
+    tree.insert("", 0);
+    tree.insert("a", 1);
+    tree.insert("ab", 2);
+    tree.insert("z", 3);
+
+    sharded_t::entry_type entry;
+    ASSERT_TRUE(tree.longest_match("abc", entry));
+    ASSERT_EQ("ab", entry.first);
+    ASSERT_TRUE(tree.longest_match("zebra", entry));
+    ASSERT_EQ("z", entry.first);
+    {
+        SCOPED_TRACE("the empty key is found from any shard");
+        ASSERT_TRUE(tree.longest_match("xyz", entry));
+        ASSERT_EQ("", entry.first);
+        ASSERT_EQ(0, entry.second);
+    }
+
+    std::vector<sharded_t::entry_type> vec;
+    tree.prefix_match("a", vec);
+    ASSERT_EQ(2u, vec.size());
+    tree.prefix_match("", vec);
+    ASSERT_EQ(4u, vec.size());
+    ASSERT_EQ("", vec[0].first);
+    ASSERT_EQ("z", vec[3].first);
+
+    ASSERT_EQ(2u, tree.erase_prefix("a"));
+    ASSERT_EQ(2u, tree.erase_prefix(""));
+    ASSERT_TRUE(tree.empty());
+}
+
+TEST(sharded, concurrent_writers)
+{
+    sharded_t tree(16);
+    const int per_thread = 2000;
+    std::vector<std::thread> writers;
+
+    for (int t = 0; t < 4; t++) {
+        writers.push_back(std::thread([&tree, t, per_thread]() {
+            for (int i = 0; i < per_thread; i++) {
+                std::ostringstream key;
+                key << char('a' + (i % 26)) << t << "-" << i;
+                tree.insert(key.str(), i);
+            }
+        }));
+    }
+    for (size_t t = 0; t < writers.size(); t++)
+        writers[t].join();
+
+    ASSERT_EQ(size_t(4 * per_thread), tree.size());
+
+    std::vector<sharded_radix_tree<std::string, int>::tree_type> snaps;
+    tree.snapshot(snaps);
+    size_t total = 0;
+    for (size_t i = 0; i < snaps.size(); i++)
+        total += snaps[i].size();
+    ASSERT_EQ(size_t(4 * per_thread), total);
+}
@@ -0,0 +1,217 @@
+#include "common.hpp"
+
+#include <radix_tree_shm.hpp>
+#include <sstream>
+#include <sys/wait.h>
+
+static std::string segment_name()
+{
+    std::ostringstream os;
+    os << "/radix_tree_test_" << getpid();
+    return os.str();
+}
+
+static std::string key_of(int i)
+{
+    std::ostringstream os;
+    os << "host" << i % 13 << ".example" << i << ".com";
+    return os.str();
+}
+
+TEST(shm, insert_find_erase)
+{
+    shm_radix_tree<int> tree(segment_name());
+    ASSERT_TRUE(tree.create(1 << 20));
+
+    std::map<std::string, int> model;
+    for (int i = 0; i < 2000; i++) {
+        ASSERT_TRUE(tree.insert(key_of(i), i));
+        model[key_of(i)] = i;
+    }
+    ASSERT_FALSE(tree.insert(key_of(5), -1));
+    ASSERT_FALSE(tree.insert_or_assign(key_of(6), -6));
+    model[key_of(6)] = -6;
+    ASSERT_TRUE(tree.insert("", 100));
+    model[""] = 100;
+    ASSERT_EQ(model.size(), tree.size());
+
+    for (int i = 0; i < 2000; i += 3) {
+        ASSERT_TRUE(tree.erase(key_of(i)));
+        model.erase(key_of(i));
+    }
+    ASSERT_FALSE(tree.erase(key_of(0)));
+    ASSERT_FALSE(tree.erase("host1"));
+    ASSERT_EQ(model.size(), tree.size());
+
+    for (int i = 0; i < 2000; i++) {
+        int val = 0;
+        bool found = tree.find(key_of(i), val);
+        ASSERT_EQ(model.count(key_of(i)) == 1, found) << key_of(i);
+        if (found) {
+            ASSERT_EQ(model[key_of(i)], val);
+        }
+    }
+    int val;
+    ASSERT_FALSE(tree.find("host1", val));
+    ASSERT_TRUE(tree.find("", val));
+    ASSERT_EQ(100, val);
+
+    // a second mapping in the same process sees the same tree
+    shm_radix_tree<int> reader(segment_name());
+    ASSERT_TRUE(reader.open());
+    ASSERT_EQ(tree.size(), reader.size());
+    ASSERT_TRUE(reader.find(key_of(7), val));
+    ASSERT_EQ(7, val);
+
+    // the reader's mapping is read-only, so its writers refuse
+    ASSERT_THROW(reader.insert("x", 1), std::logic_error);
+    ASSERT_THROW(reader.erase(key_of(7)), std::logic_error);
+    ASSERT_EQ(tree.size(), reader.size());
+
+    shm_radix_tree<int> unmapped(segment_name());
+    ASSERT_THROW(unmapped.insert_or_assign("x", 1), std::logic_error);
+
+    size_t used = tree.bytes_used();
+    for (std::map<std::string, int>::iterator it = model.begin(); it != model.end(); ++it)
+        ASSERT_TRUE(tree.erase(it->first));
+    ASSERT_EQ(0u, reader.size());
+    ASSERT_GT(used, tree.bytes_used());
+
+    // freed blocks are reused
+    used = tree.bytes_used();
+    for (int i = 0; i < 100; i++)
+        tree.insert(key_of(i), i);
+    for (int i = 0; i < 100; i++)
+        tree.erase(key_of(i));
+    ASSERT_EQ(used, tree.bytes_used());
+
+    ASSERT_TRUE(tree.unlink());
+}
+
+TEST(shm, longest_match)
+{
+    shm_radix_tree<int> tree(segment_name());
+    ASSERT_TRUE(tree.create(1 << 16));
+
+    tree.insert("10.", 1);
+    tree.insert("10.1.", 2);
+    tree.insert("10.1.2.", 3);
+    tree.insert("192.168.", 4);
+
+    std::string match;
+    int val;
+    ASSERT_TRUE(tree.longest_match("10.1.2.3", match, val));
+    ASSERT_EQ("10.1.2.", match);
+    ASSERT_EQ(3, val);
+    ASSERT_TRUE(tree.longest_match("10.1.3.1", match, val));
+    ASSERT_EQ("10.1.", match);
+    ASSERT_TRUE(tree.longest_match("10.2", match, val));
+    ASSERT_EQ(1, val);
+    ASSERT_FALSE(tree.longest_match("172.16.0.1", match, val));
+
+    ASSERT_TRUE(tree.unlink());
+}
+
+TEST(shm, full_segment)
+{
+    shm_radix_tree<int> tree(segment_name());
+    ASSERT_TRUE(tree.create(16 << 10));
+
+    int inserted = 0;
+    try {
+        for (int i = 0; i < 10000; i++) {
+            tree.insert(key_of(i), i);
+            inserted++;
+        }
+        FAIL();
+    } catch (std::bad_alloc &) {
+    }
+
+    // the failed update changed nothing
+    ASSERT_EQ(static_cast<size_t>(inserted), tree.size());
+    for (int i = 0; i < inserted; i++) {
+        int val = -1;
+        ASSERT_TRUE(tree.find(key_of(i), val));
+        ASSERT_EQ(i, val);
+    }
+
+    ASSERT_TRUE(tree.unlink());
+}
+
+TEST(shm, create_leaves_old_mappings)
+{
+    std::string name = segment_name();
+    shm_radix_tree<int> old_tree(name);
+    ASSERT_TRUE(old_tree.create(1 << 20));
+    ASSERT_TRUE(old_tree.insert("apache", 1));
+
+    shm_radix_tree<int> reader(name);
+    ASSERT_TRUE(reader.open());
+
+    // a new segment under the same name leaves the mapped one whole
+    shm_radix_tree<int> tree(name);
+    ASSERT_TRUE(tree.create(1 << 20));
+    ASSERT_EQ(0u, tree.size());
+
+    int val = -1;
+    ASSERT_TRUE(reader.find("apache", val));
+    ASSERT_EQ(1, val);
+    ASSERT_TRUE(old_tree.insert("bind", 2));
+    ASSERT_TRUE(reader.find("bind", val));
+    ASSERT_EQ(2, val);
+    ASSERT_FALSE(tree.find("bind", val));
+
+    ASSERT_TRUE(tree.unlink());
+}
+
+TEST(shm, other_processes)
+{
+    std::string name = segment_name();
+    shm_radix_tree<int> tree(name);
+    ASSERT_TRUE(tree.create(4 << 20));
+
+    for (int i = 0; i < 1000; i++)
+        tree.insert(key_of(i), i);
+
+    // readers in child processes, while the parent keeps writing: a key
+    // is either absent or maps to its own number
+    std::vector<pid_t> children;
+    for (int c = 0; c < 2; c++) {
+        pid_t pid = fork();
+        ASSERT_LE(0, pid);
+
+        if (pid == 0) {
+            shm_radix_tree<int> reader(name);
+            if (! reader.open())
+                _exit(2);
+
+            for (int round = 0; round < 200; round++) {
+                for (int i = 0; i < 2000; i += 7) {
+                    int val = -1;
+                    if (reader.find(key_of(i), val) && val != i)
+                        _exit(1);
+                    if (i < 1000 && ! reader.find(key_of(i), val))
+                        _exit(1);
+                }
+            }
+            _exit(0);
+        }
+        children.push_back(pid);
+    }
+
+    for (int round = 0; round < 20; round++) {
+        for (int i = 1000; i < 2000; i++)
+            tree.insert(key_of(i), i);
+        for (int i = 1000; i < 2000; i++)
+            tree.erase(key_of(i));
+    }
+
+    for (size_t c = 0; c < children.size(); c++) {
+        int status = -1;
+        ASSERT_EQ(children[c], waitpid(children[c], &status, 0));
+        ASSERT_TRUE(WIFEXITED(status));
+        ASSERT_EQ(0, WEXITSTATUS(status));
+    }
+
+    ASSERT_TRUE(tree.unlink());
+}
@@ -0,0 +1,235 @@
+#include "common.hpp"
+
+TEST(snapshot, shares_until_write)
+{
+    tree_t tree;
+    tree["abc"] = 1;
+    tree["abd"] = 2;
+
+    tree_t snap = tree.snapshot();
+    ASSERT_TRUE(tree.shared());
+    ASSERT_TRUE(snap.shared());
+    ASSERT_EQ(tree.size(), snap.size());
+
+    // the nodes off the written paths stay shared
+    tree["abe"] = 3;
+    tree.erase("abc");
+    ASSERT_TRUE(tree.shared());
+    ASSERT_TRUE(snap.shared());
+
+    {
+        SCOPED_TRACE("snapshot keeps the old state");
+        ASSERT_EQ(2u, snap.size());
+        ASSERT_NE(snap.end(), snap.find("abc"));
+        ASSERT_EQ(snap.end(), snap.find("abe"));
+    }
+    {
+        SCOPED_TRACE("tree has the new state");
+        ASSERT_EQ(2u, tree.size());
+        ASSERT_EQ(tree.end(), tree.find("abc"));
+        ASSERT_EQ(3, tree.find("abe")->second);
+    }
+}
+
+TEST(snapshot, value_write_through_iterator)
+{
+    tree_t tree;
+    tree["abc"] = 1;
+
+    tree_t snap(tree);
+    tree.find("abc")->second = 10;
+
+    ASSERT_EQ(10, tree["abc"]);
+    ASSERT_EQ(1, snap["abc"]);
+}
+
+TEST(snapshot, assignment_and_clear)
+{
+    std::vector<std::string> unique_keys = get_unique_keys();
+    tree_t tree;
+    for (size_t i = 0; i < unique_keys.size(); i++)
+        tree[unique_keys[i]] = int(i);
+
+    tree_t copy;
+    copy["zzz"] = 0;
+    copy = tree;
+    ASSERT_TRUE(copy.shared());
+
+    tree.clear();
+    ASSERT_FALSE(copy.shared());
+    ASSERT_EQ(0u, tree.size());
+    ASSERT_EQ(unique_keys.size(), copy.size());
+    for (size_t i = 0; i < unique_keys.size(); i++) {
+        ASSERT_NE(copy.end(), copy.find(unique_keys[i]));
+        ASSERT_EQ(int(i), copy.find(unique_keys[i])->second);
+    }
+    ASSERT_EQ(copy.end(), copy.find("zzz"));
+}
+
+TEST(snapshot, copies_are_independent)
+{
+    std::vector<std::string> unique_keys = get_unique_keys();
+    tree_t tree;
+    for (size_t i = 0; i < unique_keys.size(); i++)
+        tree[unique_keys[i]] = int(i);
+
+    tree_t a(tree), b(tree);
+    a.erase(unique_keys[0]);
+    b[unique_keys[0]] = -1;
+
+    ASSERT_EQ(unique_keys.size(), tree.size());
+    ASSERT_EQ(unique_keys.size() - 1, a.size());
+    ASSERT_EQ(unique_keys.size(), b.size());
+    ASSERT_EQ(0, tree[unique_keys[0]]);
+    ASSERT_EQ(-1, b[unique_keys[0]]);
+    ASSERT_EQ(std::distance(tree.begin(), tree.end()), std::distance(b.begin(), b.end()));
+}
+
+TEST(snapshot, reads_leave_it_shared)
+{
+    std::vector<std::string> unique_keys = get_unique_keys();
+    tree_t tree;
+    for (size_t i = 0; i < unique_keys.size(); i++)
+        tree[unique_keys[i]] = int(i);
+
+    tree_t snap = tree.snapshot();
+    const tree_t &view = snap;
+    std::vector<tree_t::const_iterator> cvec;
+
+    ASSERT_EQ(unique_keys.size(), size_t(std::distance(view.begin(), view.end())));
+    ASSERT_EQ(0, view.find("a")->second);
+    view.prefix_match("ab", cvec);
+    ASSERT_EQ(3u, cvec.size());
+    ASSERT_TRUE(snap.shared());
+
+    // lookups that find nothing hand out nothing to write through
+    std::vector<tree_t::iterator> vec;
+    ASSERT_EQ(snap.end(), snap.find("abc"));
+    ASSERT_EQ(snap.end(), snap.longest_match("c"));
+    snap.prefix_match("c", vec);
+    ASSERT_TRUE(vec.empty());
+    ASSERT_FALSE(snap.erase("abc"));
+    ASSERT_EQ(0u, snap.erase_prefix("c"));
+    ASSERT_TRUE(snap.shared());
+
+    // nor does one that finds something, until it is written through
+    snap.prefix_match("ab", vec);
+    ASSERT_EQ(3u, vec.size());
+    ASSERT_TRUE(snap.shared());
+    vec[0]->second = -1;
+    vec[2]->second = -2;
+    ASSERT_EQ("ab", vec[0]->first);
+    ASSERT_EQ(-1, snap["ab"]);
+    ASSERT_EQ(-2, snap["abb"]);
+    ASSERT_NE(-1, tree["ab"]);
+    ASSERT_NE(-2, tree["abb"]);
+
+    snap = tree;
+    ASSERT_TRUE(snap.erase("ab"));
+    ASSERT_EQ(snap.end(), snap.find("ab"));
+    ASSERT_NE(tree.end(), tree.find("ab"));
+}
+
+TEST(snapshot, writes_copy_one_path)
+{
+    typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_counting_stats> counted_t;
+
+    counted_t tree;
+    for (int i = 0; i < 4096; i++) {
+        std::string key = "k0000";
+        for (int j = 4, n = i; j > 0; j--, n /= 10)
+            key[j] = char('0' + n % 10);
+        tree[key] = i;
+    }
+
+    counted_t snap = tree.snapshot();
+    tree.stats().reset();
+
+    tree["k1234x"] = -1;
+    tree.erase("k2048");
+    tree["k3000"] = -3;
+    tree.find("k4000")->second = -4;
+
+    // a path is a handful of nodes; the whole tree is over 4096
+    ASSERT_LT(tree.stats().counters().allocs, 40u);
+
+    ASSERT_EQ(4096u, snap.size());
+    ASSERT_EQ(1234, snap["k1234"]);
+    ASSERT_EQ(snap.end(), snap.find("k1234x"));
+    ASSERT_EQ(2048, snap["k2048"]);
+    ASSERT_EQ(3000, snap["k3000"]);
+    ASSERT_EQ(4000, snap["k4000"]);
+
+    ASSERT_EQ(4096u, tree.size());
+    ASSERT_EQ(-1, tree["k1234x"]);
+    ASSERT_EQ(tree.end(), tree.find("k2048"));
+    ASSERT_EQ(-3, tree["k3000"]);
+    ASSERT_EQ(-4, tree["k4000"]);
+}
+
+TEST(snapshot, iterating_after_copied_paths)
+{
+    std::vector<std::string> unique_keys = get_unique_keys();
+    std::map<std::string, int> expect;
+    tree_t tree;
+    for (size_t i = 0; i < unique_keys.size(); i++)
+        tree[unique_keys[i]] = expect[unique_keys[i]] = int(i);
+
+    tree_t snap = tree.snapshot();
+
+    tree.erase("ab");
+    tree["abc"] = 20;
+    expect.erase("ab");
+    expect["abc"] = 20;
+
+    // the nodes below a copied one still link to the snapshot's, so
+    // both trees must be walked by key
+    std::map<std::string, int> seen;
+    for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it) {
+        it->second += 100;
+        seen[it->first] = it->second - 100;
+    }
+    ASSERT_EQ(expect, seen);
+
+    const tree_t &view = snap;
+    size_t count = 0;
+    for (tree_t::const_iterator it = view.begin(); it != view.end(); ++it, ++count)
+        ASSERT_LT(it->second, 100);
+    ASSERT_EQ(unique_keys.size(), count);
+
+    // once the snapshot is gone, the tree relinks its nodes
+    snap.clear();
+    ASSERT_FALSE(tree.shared());
+    std::vector<std::string> keys, sorted;
+    for (tree_t::iterator it = tree.begin(); it != tree.end(); ++it) {
+        ASSERT_GE(it->second, 100);
+        keys.push_back(it->first);
+    }
+    for (std::map<std::string, int>::iterator it = expect.begin(); it != expect.end(); ++it)
+        sorted.push_back(it->first);
+    ASSERT_EQ(sorted, keys);
+}
+
+TEST(snapshot, assignment_keeps_the_filter)
+{
+    tree_t tree, other;
+    tree.set_filter_size(1024);
+    other.set_filter_size(1024);
+
+    tree["apple"] = 1;
+    other["banana"] = 2;
+    other["cherry"] = 3;
+
+    tree = other;
+    ASSERT_EQ(1024u, tree.filter_size());
+    ASSERT_EQ(tree.end(), tree.find("apple"));
+    ASSERT_EQ(2, tree.find("banana")->second);
+    ASSERT_EQ(3, tree.find("cherry")->second);
+
+    // without a filter of the same size on other, it is rebuilt
+    tree_t plain;
+    plain["durian"] = 4;
+    tree = plain;
+    ASSERT_EQ(4, tree.find("durian")->second);
+    ASSERT_EQ(tree.end(), tree.find("banana"));
+}
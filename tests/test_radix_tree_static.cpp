@@ -0,0 +1,121 @@
+#include "common.hpp"
+
+#include <radix_tree_static.hpp>
+#include <sstream>
+
+static constexpr auto methods = make_static_radix_tree<int>({
+    { "GET", 1 }, { "HEAD", 2 }, { "POST", 3 }, { "PUT", 4 }, { "DELETE", 5 },
+    { "CONNECT", 6 }, { "OPTIONS", 7 }, { "TRACE", 8 }, { "PATCH", 9 },
+});
+
+// the lookups run in the compiler
+static_assert(methods.size() == 9);
+static_assert(methods.find("PUT")->second == 4);
+static_assert(methods.find("PATCH")->second == 9);
+static_assert(methods.find("PU") == nullptr);
+static_assert(methods.find("PUTS") == nullptr);
+static_assert(methods.find("") == nullptr);
+static_assert(methods.prefix_match("P").size() == 3);
+static_assert(methods.prefix_match("PO").first->second == 3);
+static_assert(methods.prefix_match("X").empty());
+static_assert(methods.longest_match("GETTER")->second == 1);
+static_assert(methods.longest_match("GE") == nullptr);
+
+TEST(static_tree, http_methods)
+{
+    std::string method = "OPTIONS";
+    ASSERT_NE(nullptr, methods.find(method));
+    ASSERT_EQ(7, methods.find(method)->second);
+    ASSERT_EQ(nullptr, methods.find("options"));
+
+    // iteration is in key order
+    std::vector<std::string> keys;
+    for (const auto &e : methods)
+        keys.push_back(std::string(e.first));
+    ASSERT_EQ(9u, keys.size());
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    ASSERT_EQ("CONNECT", keys.front());
+    ASSERT_EQ("TRACE", keys.back());
+
+    std::vector<int> post_put;
+    for (const auto &e : methods.prefix_match("P"))
+        post_put.push_back(e.second);
+    ASSERT_EQ(3u, post_put.size());
+    ASSERT_EQ(9, post_put[0]);
+    ASSERT_EQ(3, post_put[1]);
+    ASSERT_EQ(4, post_put[2]);
+}
+
+TEST(static_tree, nested_keys)
+{
+    static constexpr auto tree = make_static_radix_tree<int>({
+        { "", 0 }, { "a", 1 }, { "ab", 2 }, { "abc", 3 }, { "abd", 4 },
+        { "b", 5 }, { "\xff", 6 }, { "\xff\x01", 7 },
+    });
+    static_assert(tree.find("")->second == 0);
+    static_assert(tree.longest_match("zzz")->second == 0);
+    static_assert(tree.longest_match("abcd")->second == 3);
+    static_assert(tree.longest_match("abx")->second == 2);
+    static_assert(tree.prefix_match("ab").size() == 3);
+    static_assert(tree.prefix_match("").size() == 8);
+    static_assert(tree.find("\xff\x01")->second == 7);
+    static_assert(tree.prefix_match("\xff").size() == 2);
+
+    ASSERT_LE(tree.node_count(), 2 * tree.size());
+    ASSERT_EQ(std::string("\xff\x01"), std::string(tree.end()[-1].first));
+}
+
+TEST(static_tree, against_radix_tree)
+{
+    // a tree built at run time from keys that are not literals
+    std::vector<std::string> storage;
+    for (int i = 0; i < 300; i++) {
+        std::ostringstream os;
+        os << "/api/v" << i % 3 << "/item" << (i * 37) % 1000;
+        storage.push_back(os.str());
+    }
+
+    static_radix_entry<int> entries[300];
+    tree_t tree;
+    for (int i = 0; i < 300; i++) {
+        entries[i].first = storage[i];
+        entries[i].second = i;
+        tree[storage[i]] = i;
+    }
+    static_radix_tree<int, 300> fixed(entries);
+
+    // truncated and extended keys, besides the keys themselves
+    std::vector<std::string> probes;
+    for (int i = 0; i < 300; i++) {
+        probes.push_back(storage[i].substr(0, i % (storage[i].size() + 1)));
+        probes.push_back(storage[i] + "x");
+    }
+    probes.push_back("/b");
+
+    for (size_t p = 0; p < probes.size(); p++) {
+        const std::string &probe = probes[p];
+
+        tree_t::iterator it = tree.find(probe);
+        if (it == tree.end())
+            ASSERT_EQ(nullptr, fixed.find(probe)) << probe;
+        else
+            ASSERT_EQ(it->second, fixed.find(probe)->second) << probe;
+
+        it = tree.longest_match(probe);
+        if (it == tree.end())
+            ASSERT_EQ(nullptr, fixed.longest_match(probe)) << probe;
+        else
+            ASSERT_EQ(it->second, fixed.longest_match(probe)->second) << probe;
+
+        vector_found_t vec;
+        tree.prefix_match(probe, vec);
+        ASSERT_EQ(vec.size(), fixed.prefix_match(probe).size()) << probe;
+    }
+
+    for (int i = 0; i < 300; i++)
+        ASSERT_EQ(i, fixed.find(storage[i])->second);
+
+    entries[1].first = entries[0].first;
+    typedef static_radix_tree<int, 300> fixed_t;
+    ASSERT_THROW(fixed_t dup(entries), std::invalid_argument);
+}
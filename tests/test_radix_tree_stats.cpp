@@ -0,0 +1,140 @@
+#include "common.hpp"
+
+#include <thread>
+
+typedef radix_tree<std::string, int, std::less<std::string>, radix_tree_counting_stats> counted_tree_t;
+
+TEST(stats, null_policy_by_default)
+{
+    tree_t tree;
+    tree["abc"] = 1;
+    radix_tree_null_stats &stats = tree.stats();
+    (void)stats;
+    ASSERT_EQ(1u, tree.size());
+}
+
+TEST(stats, lookup_counters)
+{
+    counted_tree_t tree;
+    tree["abcdef"] = 1;
+    tree["abcdege"] = 2;
+    tree["bcdef"] = 3;
+
+    tree.stats().reset();
+    ASSERT_NE(tree.end(), tree.find("abcdef"));
+
+    const radix_tree_counters &c = tree.stats().counters();
+    ASSERT_EQ(1u, c.lookups);
+    // (root) -> abcde -> f, which holds the entry
+    ASSERT_EQ(3u, c.nodes_visited);
+    ASSERT_LT(0u, c.children_scanned);
+    ASSERT_EQ(6u, c.label_units_compared);
+    ASSERT_EQ(0u, c.allocs);
+    ASSERT_EQ(0u, c.frees);
+}
+
+TEST(stats, alloc_free_split_merge)
+{
+    counted_tree_t tree;
+    tree["abcdef"] = 1;
+    {
+        SCOPED_TRACE("first key allocates root and the node holding it");
+        ASSERT_EQ(2u, tree.stats().counters().allocs);
+        ASSERT_EQ(0u, tree.stats().counters().splits);
+    }
+
+    tree["abcdege"] = 2;
+    {
+        SCOPED_TRACE("diverging key splits an edge");
+        ASSERT_EQ(1u, tree.stats().counters().splits);
+        ASSERT_EQ(4u, tree.stats().counters().allocs);
+    }
+
+    tree.erase("abcdege");
+    {
+        SCOPED_TRACE("erase frees the node and merges the chain above it");
+        ASSERT_EQ(1u, tree.stats().counters().merges);
+        ASSERT_EQ(2u, tree.stats().counters().frees);
+    }
+
+    tree.clear();
+    {
+        SCOPED_TRACE("every allocated node is freed");
+        ASSERT_EQ(tree.stats().counters().allocs, tree.stats().counters().frees);
+    }
+}
+
+TEST(stats, concurrent_const_readers)
+{
+    counted_tree_t tree;
+    tree["abcdef"] = 1;
+    tree["abcdege"] = 2;
+    tree.stats().reset();
+
+    // const lookups count from several threads without losing updates
+    const counted_tree_t &ctree = tree;
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.push_back(std::thread([&ctree]() {
+            for (int i = 0; i < 1000; i++)
+                ctree.find(i % 2 ? "abcdef" : "abcdege");
+        }));
+    }
+    for (size_t t = 0; t < readers.size(); t++)
+        readers[t].join();
+
+    ASSERT_EQ(4000u, tree.stats().counters().lookups);
+    ASSERT_EQ(3 * 4000u, tree.stats().counters().nodes_visited);
+
+    // copies of the tree carry the counts over
+    counted_tree_t copy(tree);
+    ASSERT_EQ(4000u, copy.stats().counters().lookups);
+}
+
+TEST(stats, per_thread_counters)
+{
+    radix_tree<std::string, int, std::less<std::string>, radix_tree_thread_stats> tree;
+    radix_tree_thread_stats::reset();
+
+    tree["abc"] = 1;
+    tree.find("abc");
+
+    ASSERT_EQ(2u, radix_tree_thread_stats::counters().allocs);
+    ASSERT_LT(0u, radix_tree_thread_stats::counters().lookups);
+}
+
+TEST(stats, sparse_suffixes)
+{
+    counted_tree_t tree;
+    const char *ids[] = {
+        "0b7e2f7c-5d0a-4c43-9f55-1c9a7b1d2e01", "3f1c9a4e-8b2d-4f6a-a1e3-7d5c2b9e8f10",
+        "7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c22", "c4e8a2f6-1b3d-4e5f-8a9b-0c2d4e6f8a33",
+        "e5f7a9b1-3c5d-4e7f-9a1b-2c3d4e5f6a44",
+    };
+
+    for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+        tree[std::string("obj/") + ids[i]] = static_cast<int>(i);
+
+    {
+        SCOPED_TRACE("the root, the obj/ branch and one leaf per key");
+        ASSERT_EQ(7u, tree.stats().counters().allocs);
+    }
+
+    tree.stats().reset();
+    ASSERT_EQ(2, tree.find(std::string("obj/") + ids[2])->second);
+    {
+        SCOPED_TRACE("(root) -> obj/ -> leaf");
+        ASSERT_EQ(3u, tree.stats().counters().nodes_visited);
+    }
+
+    // same length, differs only in the last unit
+    ASSERT_EQ(tree.end(), tree.find("obj/7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c23"));
+    ASSERT_EQ(tree.end(), tree.find("obj/7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c2"));
+    ASSERT_EQ(tree.end(), tree.find("obj/7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c222"));
+
+    tree["obj/7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c23"] = 9;
+    ASSERT_EQ(2, tree.find(std::string("obj/") + ids[2])->second);
+    ASSERT_EQ(9, tree.find("obj/7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c23")->second);
+    ASSERT_EQ(tree.end(), tree.longest_match("obj/7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c2"));
+    ASSERT_EQ(9, tree.longest_match("obj/7a9d3c1b-2e4f-4b8a-9c6d-5e1f3a7b9c23/x")->second);
+}
@@ -0,0 +1,246 @@
+#include "common.hpp"
+
+#include <radix_tree_wal.hpp>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+typedef durable_radix_tree<std::string, int> durable_t;
+
+class wal : public ::testing::Test {
+protected:
+    std::string path;
+
+    virtual void SetUp() {
+        std::ostringstream os;
+        os << "radix_tree_wal_test." << ::getpid();
+        path = os.str();
+        remove_files();
+    }
+    virtual void TearDown() {
+        remove_files();
+    }
+    void remove_files() {
+        std::remove((path + ".wal").c_str());
+        std::remove((path + ".ckpt").c_str());
+        std::remove((path + ".ckpt.tmp").c_str());
+    }
+};
+
+TEST_F(wal, recover_from_log)
+{
+    {
+        durable_t tree(path);
+        ASSERT_TRUE(tree.open());
+
+        ASSERT_TRUE(tree.insert("apache", 0));
+        ASSERT_TRUE(tree.insert("bind", 1));
+        ASSERT_TRUE(tree.insert("binary", 2));
+        ASSERT_FALSE(tree.insert_or_assign("bind", 10));
+        ASSERT_TRUE(tree.erase("apache"));
+        ASSERT_FALSE(tree.erase("apache"));
+
+        ASSERT_TRUE(tree.sync());
+        ASSERT_EQ(5u, tree.durable_lsn());
+    }
+
+    durable_t tree(path);
+    ASSERT_TRUE(tree.open());
+    ASSERT_EQ(2u, tree.size());
+    ASSERT_EQ(5u, tree.last_lsn());
+
+    int value = 0;
+    ASSERT_TRUE(tree.find("bind", value));
+    ASSERT_EQ(10, value);
+    ASSERT_TRUE(tree.find("binary", value));
+    ASSERT_EQ(2, value);
+    ASSERT_FALSE(tree.find("apache", value));
+}
+
+TEST_F(wal, recover_from_checkpoint_and_tail)
+{
+    {
+        durable_t tree(path);
+        ASSERT_TRUE(tree.open());
+
+        for (int i = 0; i < 100; i++) {
+            std::ostringstream os;
+            os << "key" << i;
+            tree.insert(os.str(), i);
+        }
+
+        ASSERT_TRUE(tree.checkpoint());
+
+        std::ifstream log((path + ".wal").c_str(), std::ios::binary | std::ios::ate);
+        ASSERT_EQ(0, log.tellg());
+
+        tree.erase("key0");
+        tree.insert_or_assign("key1", -1);
+        tree.insert("extra", 1000);
+    }
+
+    durable_t tree(path);
+    ASSERT_TRUE(tree.open());
+    ASSERT_EQ(100u, tree.size());
+
+    int value = 0;
+    ASSERT_FALSE(tree.find("key0", value));
+    ASSERT_TRUE(tree.find("key1", value));
+    ASSERT_EQ(-1, value);
+    ASSERT_TRUE(tree.find("key99", value));
+    ASSERT_EQ(99, value);
+    ASSERT_TRUE(tree.find("extra", value));
+    ASSERT_EQ(1000, value);
+}
+
+TEST_F(wal, automatic_checkpoint)
+{
+    {
+        durable_t tree(path, 256);
+        ASSERT_TRUE(tree.open());
+
+        for (int i = 0; i < 1000; i++) {
+            std::ostringstream os;
+            os << "key" << i;
+            tree.insert(os.str(), i);
+            if (i % 100 == 0) {
+                ASSERT_TRUE(tree.sync());
+            }
+        }
+    }
+
+    std::ifstream ckpt((path + ".ckpt").c_str());
+    ASSERT_TRUE(ckpt.good());
+
+    durable_t tree(path);
+    ASSERT_TRUE(tree.open());
+    ASSERT_EQ(1000u, tree.size());
+}
+
+TEST_F(wal, torn_record_is_dropped)
+{
+    {
+        durable_t tree(path);
+        ASSERT_TRUE(tree.open());
+        tree.insert("apache", 0);
+        tree.insert("bind", 1);
+    }
+
+    {
+        std::ofstream log((path + ".wal").c_str(), std::ios::binary | std::ios::app);
+        log.write("\x20\x00\x00\x00garbage", 11);
+    }
+
+    {
+        durable_t tree(path);
+        ASSERT_TRUE(tree.open());
+        ASSERT_EQ(2u, tree.size());
+        tree.insert("binary", 2);
+    }
+
+    durable_t tree(path);
+    ASSERT_TRUE(tree.open());
+    ASSERT_EQ(3u, tree.size());
+}
+
+TEST_F(wal, corrupt_checkpoint_fails_open)
+{
+    {
+        std::ofstream ckpt((path + ".ckpt").c_str(), std::ios::binary);
+        ckpt << "not a checkpoint";
+    }
+
+    durable_t tree(path);
+    ASSERT_FALSE(tree.open());
+}
+
+TEST_F(wal, unknown_record_fails_open)
+{
+    {
+        durable_t tree(path);
+        ASSERT_TRUE(tree.open());
+        tree.insert("apache", 0);
+    }
+
+    std::string log;
+    {
+        std::ifstream in((path + ".wal").c_str(), std::ios::binary);
+        std::ostringstream os;
+        os << in.rdbuf();
+        log = os.str();
+    }
+    ASSERT_LT(9u, log.size());
+
+    // an op code no writer emits, under a checksum that still holds
+    log[8] = 7;
+
+    std::uint32_t sum = 2166136261u;
+    for (std::size_t i = 8; i < log.size(); i++) {
+        sum ^= static_cast<unsigned char>(log[i]);
+        sum *= 16777619u;
+    }
+    std::memcpy(&log[4], &sum, sizeof(sum));
+
+    {
+        std::ofstream out((path + ".wal").c_str(), std::ios::binary | std::ios::trunc);
+        out.write(log.data(), log.size());
+    }
+
+    durable_t tree(path);
+    ASSERT_FALSE(tree.open());
+}
+
+TEST_F(wal, failed_write_stops_the_log)
+{
+    durable_t tree(path);
+    ASSERT_TRUE(tree.open());
+    ASSERT_TRUE(tree.insert("apache", 0));
+    ASSERT_TRUE(tree.sync());
+
+    struct stat st;
+    ASSERT_EQ(0, ::stat((path + ".wal").c_str(), &st));
+
+    // the next record fits only in part: the write fails with EFBIG
+    struct rlimit saved, limit;
+    ASSERT_EQ(0, ::getrlimit(RLIMIT_FSIZE, &saved));
+    limit = saved;
+    limit.rlim_cur = st.st_size + 8;
+    void (*handler)(int) = ::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(0, ::setrlimit(RLIMIT_FSIZE, &limit));
+
+    ASSERT_TRUE(tree.insert("bind", 1));
+    bool synced = tree.sync();
+
+    ::setrlimit(RLIMIT_FSIZE, &saved);
+    ::signal(SIGXFSZ, handler);
+
+    ASSERT_FALSE(synced);
+    ASSERT_FALSE(tree.checkpoint());
+    ASSERT_EQ(1u, tree.durable_lsn());
+
+    ASSERT_THROW(tree.insert("binary", 2), std::runtime_error);
+    ASSERT_THROW(tree.insert_or_assign("apache", 1), std::runtime_error);
+    ASSERT_THROW(tree.erase("apache"), std::runtime_error);
+
+    int value = -1;
+    ASSERT_EQ(2u, tree.size());
+    ASSERT_TRUE(tree.find("apache", value));
+    ASSERT_EQ(0, value);
+
+    // nothing of the failed batch is left in the log
+    struct stat after;
+    ASSERT_EQ(0, ::stat((path + ".wal").c_str(), &after));
+    ASSERT_EQ(st.st_size, after.st_size);
+
+    tree.close();
+    ASSERT_TRUE(tree.open());
+    ASSERT_EQ(1u, tree.size());
+    ASSERT_TRUE(tree.insert("bind", 1));
+    ASSERT_TRUE(tree.sync());
+}